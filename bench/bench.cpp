@@ -0,0 +1,537 @@
+/**
+ * @file
+ * @brief
+ * The argagg_bench suite, which measures how parsing, validating
+ * definitions, converting arguments and formatting help scale with the
+ * number of arguments, the number of definitions, the size of values and
+ * the number of threads. It also parses the command lines of a synthetic
+ * /proc-like directory the way a monitoring agent would. Results can be
+ * written as JSON (see harness.hpp) to compare runs.
+ *
+ * $ mkdir build
+ * $ cd build
+ * $ cmake -DARGAGG_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release ..
+ * $ make
+ * $ ./bin/argagg_bench --json results.json
+ * $ ./bin/argagg_bench --filter parse/ --repetitions 31
+ */
+#include "harness.hpp"
+
+#include <argagg/argagg.hpp>
+#include <argagg/convert/csv.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef ARGAGG_HAS_POSIX_IO
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Results are added to this so that the work isn't optimized away.
+static std::size_t g_checksum = 0;
+
+/**
+ * @brief
+ * Owns the strings of a synthesized command line and points an argv at
+ * them.
+ */
+struct command_line_args {
+  std::vector<std::string> strings;
+  std::vector<const char*> argv;
+
+  void push_back(std::string arg)
+  {
+    strings.push_back(std::move(arg));
+  }
+
+  int argc()
+  {
+    argv.clear();
+    for (const auto& s : strings) {
+      argv.push_back(s.c_str());
+    }
+    return static_cast<int>(argv.size());
+  }
+};
+
+static argagg::parser gcc_like_parser()
+{
+  // The options of examples/gcc_like.cpp.
+  return argagg::parser {{
+    {"help", {"-h", "--help"}, "displays help information", 0},
+    {"verbose", {"-v", "--verbose"}, "increases verbosity", 0},
+    {"include_path", {"-I"}, "include path (can be repeated)", 1},
+    {"definition", {"-D"}, "preprocessor definitions (can be repeated)", 1},
+    {"output", {"-o", "--output"}, "output filename (default: stdout)", 1},
+  }};
+}
+
+static std::vector<argagg::definition> many_definitions(std::size_t count)
+{
+  std::vector<argagg::definition> definitions;
+  definitions.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const std::string n = std::to_string(i);
+    definitions.push_back({
+      "option" + n, {"--option-" + n, "--alias-" + n},
+      "sets option " + n + " of the subsystem it belongs to, which takes a "
+      "value that is checked when the daemon starts",
+      static_cast<unsigned int>(i % 2)});
+  }
+  return definitions;
+}
+
+static void bench_parse(bench::harness& h)
+{
+  if (h.selected("parse/gcc_like")) {
+    const auto argparser = gcc_like_parser();
+    for (const std::size_t num_inputs : {1000, 10000, 50000}) {
+      command_line_args args;
+      args.push_back("gcc_like");
+      for (std::size_t i = 0; i < num_inputs; ++i) {
+        const std::string n = std::to_string(i);
+        if (i % 20 == 0) {
+          args.push_back("-I");
+          args.push_back("include/dir" + n);
+        } else if (i % 20 == 1) {
+          args.push_back("-DNAME" + n + "=VALUE");
+        } else {
+          args.push_back("src/module" + n + ".cpp");
+        }
+      }
+      args.push_back("-o");
+      args.push_back("a.out");
+      const int argc = args.argc();
+      h.run("parse/gcc_like", num_inputs, [&]() {
+          g_checksum += argparser.parse(argc, &args.argv.front()).count();
+        });
+    }
+  }
+
+  if (h.selected("parse/definitions")) {
+    for (const std::size_t count : {10, 100, 1000}) {
+      const argagg::parser argparser(many_definitions(count));
+      command_line_args args;
+      args.push_back("daemon");
+      for (std::size_t i = 0; i < 1000; ++i) {
+        const std::size_t option = (i * 7919) % count;
+        args.push_back("--option-" + std::to_string(option));
+        if (option % 2 == 1) {
+          args.push_back(std::to_string(i));
+        }
+      }
+      const int argc = args.argc();
+      h.run("parse/definitions", count, [&]() {
+          g_checksum += argparser.parse(argc, &args.argv.front()).count();
+        });
+    }
+  }
+
+  if (h.selected("validate_definitions")) {
+    for (const std::size_t count : {10, 100, 1000}) {
+      const auto definitions = many_definitions(count);
+      h.run("validate_definitions", count, [&]() {
+          g_checksum +=
+            argagg::validate_definitions(definitions).long_flags.size();
+        });
+    }
+  }
+}
+
+static void bench_convert(bench::harness& h)
+{
+  const argagg::parser argparser {{
+      {"items", {"--items"}, "comma separated values", 1},
+    }};
+  const std::size_t num_values = 100000;
+
+  if (h.any_selected({"convert/int", "convert/double", "convert/string"})) {
+    command_line_args args;
+    args.push_back("convert");
+    for (std::size_t i = 0; i < num_values; ++i) {
+      args.push_back(std::to_string(i * 977 % 1000003) + ".25");
+    }
+    const int argc = args.argc();
+    const auto results = argparser.parse(argc, &args.argv.front());
+    h.run("convert/int", num_values, [&]() {
+        for (std::size_t i = 0; i < results.count(); ++i) {
+          g_checksum += static_cast<std::size_t>(results.as<int>(i));
+        }
+      });
+    h.run("convert/double", num_values, [&]() {
+        for (std::size_t i = 0; i < results.count(); ++i) {
+          g_checksum += static_cast<std::size_t>(results.as<double>(i));
+        }
+      });
+    h.run("convert/string", num_values, [&]() {
+        for (std::size_t i = 0; i < results.count(); ++i) {
+          g_checksum += results.as<std::string>(i).size();
+        }
+      });
+  }
+
+  for (const std::size_t count : {1000, 100000}) {
+    if (!h.any_selected({"csv/int", "csv/string"})) {
+      break;
+    }
+    std::string ints;
+    std::string strings;
+    for (std::size_t i = 0; i < count; ++i) {
+      ints += (i == 0 ? "" : ",") + std::to_string(i * 31);
+      strings += (i == 0 ? "" : ",") + ("host" + std::to_string(i));
+    }
+    const char* int_argv[] = {"csv", "--items", ints.c_str()};
+    const char* string_argv[] = {"csv", "--items", strings.c_str()};
+    const auto int_results = argparser.parse(3, int_argv);
+    const auto string_results = argparser.parse(3, string_argv);
+    h.run("csv/int", count, [&]() {
+        g_checksum +=
+          int_results["items"].as<argagg::csv<int>>().values.size();
+      });
+    h.run("csv/string", count, [&]() {
+        g_checksum +=
+          string_results["items"].as<argagg::csv<std::string>>().values.size();
+      });
+  }
+}
+
+static void bench_all_as(bench::harness& h)
+{
+  if (!h.any_selected({"all_as/serial", "all_as/threads"})) {
+    return;
+  }
+
+  // Synthesize a command line of file offsets like the ones an ETL launcher
+  // would receive.
+  const std::size_t num_args = 1000000;
+  command_line_args args;
+  args.push_back("etl");
+  for (std::size_t i = 0; i < num_args; ++i) {
+    args.push_back(std::to_string(i * 4096 + i % 4093));
+  }
+  const argagg::parser argparser {{
+      {"help", {"-h", "--help"}, "shows this help message", 0},
+    }};
+  const int argc = args.argc();
+  const auto results = argparser.parse(argc, &args.argv.front());
+
+  h.run("all_as/serial", num_args, [&]() {
+      g_checksum += results.all_as<unsigned long long>().back();
+    });
+  const unsigned int max_threads =
+    std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned int threads = 1; threads <= max_threads; threads *= 2) {
+    h.run("all_as/threads", threads, [&]() {
+        g_checksum += results.all_as<unsigned long long>(threads).back();
+      });
+  }
+}
+
+// The implementation of argagg::fmt_string() before it was rewritten as a
+// single pass, kept as the baseline of the fmt_string benchmarks. It read
+// the text with std::getline() and built every wrapped line out of
+// temporary strings.
+namespace previous {
+
+static std::string lstrip(const std::string& text)
+{
+  auto result = text;
+  result.erase(
+    result.begin(),
+    std::find_if(
+      result.begin(), result.end(), [](int ch) { return !std::isspace(ch); }));
+  return result;
+}
+
+static std::string rstrip(const std::string& text)
+{
+  auto result = text;
+  result.erase(
+    std::find_if(
+      result.rbegin(), result.rend(),
+      [](int ch) { return !std::isspace(ch); }).base(),
+    result.end());
+  return result;
+}
+
+static std::string construct_line(
+  const std::string& indent,
+  const std::string& contents)
+{
+  return indent + rstrip(contents) + "\n";
+}
+
+static std::string wrap_line(
+  const std::string& single_line,
+  const std::size_t wrap_width)
+{
+  auto indentation_spaces = single_line.find_first_not_of(" ");
+  if (indentation_spaces == std::string::npos) {
+    indentation_spaces = 0;
+  }
+  const auto line = lstrip(single_line);
+  const auto indent = std::string(indentation_spaces, ' ');
+  std::string result;
+  std::size_t position = 0;
+  std::size_t line_start = 0;
+  while (true) {
+    const auto new_position = line.find_first_of(" ", position);
+    if (new_position == std::string::npos) {
+      break;
+    }
+    if (new_position + indentation_spaces > line_start + wrap_width) {
+      result += construct_line(
+        indent, line.substr(line_start, position - line_start - 1));
+      line_start = position;
+    }
+    position = new_position + 1;
+  }
+  return result + construct_line(indent, line.substr(line_start));
+}
+
+static std::string fmt_string(const std::string& s)
+{
+  std::stringstream ss(s);
+  std::string line;
+  std::string result;
+  while (std::getline(ss, line, '\n')) {
+    result += wrap_line(line, 75);
+  }
+  return result;
+}
+
+} // namespace previous
+
+static void bench_help(bench::harness& h)
+{
+  for (const std::size_t count : {100, 1000, 3000}) {
+    if (!h.any_selected({"fmt_string", "wrap_text", "help/render",
+                         "help/search_index", "help/search"})) {
+      break;
+    }
+    const auto definitions = many_definitions(count);
+    const std::string text = argagg::render_help(definitions);
+    h.run("fmt_string", count, [&]() {
+        g_checksum += argagg::fmt_string(text).size();
+      });
+    h.run("fmt_string/previous", count, [&]() {
+        g_checksum += previous::fmt_string(text).size();
+      });
+    std::string buffer;
+    h.run("wrap_text", count, [&]() {
+        buffer.clear();
+        argagg::wrap_text(text.data(), text.size(), 75, buffer);
+        g_checksum += buffer.size();
+      });
+    h.run("help/render", count, [&]() {
+        g_checksum += argagg::render_help(definitions).size();
+      });
+    h.run("help/search_index", count, [&]() {
+        g_checksum +=
+          argagg::build_help_search_index(definitions).terms.size();
+      });
+    const auto index = argagg::build_help_search_index(definitions);
+    h.run("help/search", count, [&]() {
+        g_checksum += argagg::search_help(
+          index, definitions, "subsystem option 42").size();
+      });
+  }
+}
+
+#ifdef ARGAGG_HAS_POSIX_IO
+static std::string synthetic_cmdline(std::size_t pid)
+{
+  static const char* const programs[] = {
+    "/usr/sbin/sshd", "/usr/bin/dockerd", "/usr/lib/systemd/systemd-journald",
+    "/opt/service/bin/worker", "/usr/sbin/nginx",
+  };
+  std::string cmdline = programs[pid % 5];
+  cmdline += '\0';
+  if (pid % 2 == 0) {
+    cmdline += "--foreground";
+    cmdline += '\0';
+  }
+  cmdline += "--config=/etc/service/" + std::to_string(pid % 97) + ".conf";
+  cmdline += '\0';
+  cmdline += "-l";
+  cmdline += '\0';
+  cmdline += "/var/log/service-" + std::to_string(pid) + ".log";
+  cmdline += '\0';
+  for (std::size_t i = 0; i < pid % 7; ++i) {
+    cmdline += "-vt" + std::to_string(i + 1);
+    cmdline += '\0';
+    cmdline += "/srv/data/shard-" + std::to_string(i);
+    cmdline += '\0';
+  }
+  return cmdline;
+}
+
+static std::string read_file(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::string(
+    std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief
+ * Parses the command lines of a synthetic /proc-like directory of
+ * <pid>/cmdline files. Building an argv array for parser::parse(argc, argv)
+ * is compared against parsing the raw NUL-separated buffers in place with
+ * parser::parse(buffer, len) and against parse_arguments() with
+ * definitions that were validated once up front.
+ */
+static void bench_proc_cmdline(bench::harness& h)
+{
+  if (!h.any_selected({"proc/scan", "proc/scan_and_parse", "proc/argv",
+                       "proc/buffers", "proc/prevalidated"})) {
+    return;
+  }
+
+  const std::size_t num_processes = 10000;
+  char root_template[] = "/tmp/argagg_bench_procXXXXXX";
+  const char* root = ::mkdtemp(root_template);
+  if (root == nullptr) {
+    std::cerr << "unable to create a temporary directory\n";
+    return;
+  }
+  for (std::size_t pid = 1; pid <= num_processes; ++pid) {
+    const std::string dir = std::string(root) + "/" + std::to_string(pid);
+    ::mkdir(dir.c_str(), 0755);
+    std::ofstream out(dir + "/cmdline", std::ios::binary);
+    out << synthetic_cmdline(pid);
+  }
+
+  const argagg::parser argparser {{
+      {"foreground", {"-f", "--foreground"}, "stay in the foreground", 0},
+      {"config", {"-c", "--config"}, "configuration file", 1},
+      {"log", {"-l", "--log"}, "log file", 1},
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"threads", {"-t", "--threads"}, "worker threads", 1},
+      {"help", {"-h", "--help"}, "shows this help message", 0},
+    }};
+
+  // Reading the files is the same for every approach so the parsing itself
+  // is also measured on command lines that were read ahead of time.
+  std::vector<std::string> cmdlines;
+  auto scan = [&]() {
+      cmdlines.clear();
+      DIR* dir = ::opendir(root);
+      while (const dirent* entry = ::readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+          cmdlines.push_back(read_file(
+            std::string(root) + "/" + entry->d_name + "/cmdline"));
+        }
+      }
+      ::closedir(dir);
+    };
+  h.run("proc/scan", num_processes, scan);
+  h.run("proc/scan_and_parse", num_processes, [&]() {
+      scan();
+      for (const auto& cmdline : cmdlines) {
+        g_checksum += argparser.parse(cmdline.data(), cmdline.size()).count();
+      }
+    });
+
+  scan();
+  h.run("proc/argv", num_processes, [&]() {
+      std::vector<const char*> args;
+      for (const auto& cmdline : cmdlines) {
+        args.clear();
+        for (std::size_t i = 0; i < cmdline.size();
+             i += std::strlen(cmdline.data() + i) + 1) {
+          args.push_back(cmdline.data() + i);
+        }
+        g_checksum += argparser.parse(args.size(), &(args.front())).count();
+      }
+    });
+  h.run("proc/buffers", num_processes, [&]() {
+      for (const auto& cmdline : cmdlines) {
+        g_checksum += argparser.parse(cmdline.data(), cmdline.size()).count();
+      }
+    });
+  const auto map = argagg::validate_definitions(argparser.definitions);
+  h.run("proc/prevalidated", num_processes, [&]() {
+      for (const auto& cmdline : cmdlines) {
+        const char* end = cmdline.data() + cmdline.size();
+        g_checksum += argagg::parse_arguments(
+          argparser.definitions, map,
+          argagg::nul_separated_iterator(cmdline.data(), end),
+          argagg::nul_separated_iterator(end, end), {}).count();
+      }
+    });
+
+  for (std::size_t pid = 1; pid <= num_processes; ++pid) {
+    const std::string dir = std::string(root) + "/" + std::to_string(pid);
+    std::remove((dir + "/cmdline").c_str());
+    ::rmdir(dir.c_str());
+  }
+  ::rmdir(root);
+}
+#endif
+
+int main(int argc, const char** argv)
+{
+  argagg::parser argparser {{
+      {"help", {"-h", "--help"}, "shows this help message", 0},
+      {"warmup", {"-w", "--warmup"}, "untimed runs of each benchmark "
+        "(default: 2)", 1},
+      {"repetitions", {"-r", "--repetitions"}, "timed runs of each benchmark "
+        "(default: 15)", 1},
+      {"filter", {"-f", "--filter"}, "only runs the benchmarks whose names "
+        "contain this", 1},
+      {"json", {"-j", "--json"}, "writes the results as JSON to this file", 1},
+    }};
+
+  argagg::parser_results args;
+  try {
+    args = argparser.parse(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+  if (args["help"]) {
+    std::cerr << "Usage: argagg_bench [options]\n" << argparser;
+    return EXIT_SUCCESS;
+  }
+
+  bench::harness h {
+    args["warmup"].as<unsigned int>(2),
+    std::max(args["repetitions"].as<unsigned int>(15), 1u),
+    args["filter"].as<std::string>(""),
+    std::cout,
+    {}};
+
+  bench_parse(h);
+  bench_convert(h);
+  bench_all_as(h);
+  bench_help(h);
+#ifdef ARGAGG_HAS_POSIX_IO
+  bench_proc_cmdline(h);
+#endif
+
+  if (args["json"]) {
+    const auto path = args["json"].as<std::string>();
+    std::ofstream out(path);
+    h.write_json(out);
+    if (!out) {
+      std::cerr << "unable to write " << path << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Keep the benchmarks from being optimized away.
+  return (h.results.empty() || g_checksum != 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
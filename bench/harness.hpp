@@ -0,0 +1,181 @@
+/**
+ * @file
+ * @brief
+ * A small timing harness for the argagg_bench suite. Each benchmark is run a
+ * few times to warm up and then timed over a number of repetitions, which
+ * are summarized by their median and percentiles and can be written out as
+ * JSON to compare runs.
+ */
+#ifndef ARGAGG_BENCH_HARNESS_HPP
+#define ARGAGG_BENCH_HARNESS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/**
+ * @brief
+ * The timings of one benchmark at one size, in milliseconds.
+ */
+struct result {
+
+  /**
+   * @brief
+   * Name of the benchmark, like "parse/gcc_like".
+   */
+  std::string name;
+
+  /**
+   * @brief
+   * What the benchmark scales with, like the number of arguments.
+   */
+  std::size_t size;
+
+  /**
+   * @brief
+   * The time of every repetition, sorted.
+   */
+  std::vector<double> times;
+
+  /**
+   * @brief
+   * Returns the p-th percentile (0 to 100) of the times, interpolating
+   * between the closest two.
+   */
+  double percentile(double p) const
+  {
+    if (times.empty()) {
+      return 0.0;
+    }
+    const double rank = p / 100.0 * static_cast<double>(times.size() - 1);
+    const auto below = static_cast<std::size_t>(rank);
+    const std::size_t above = std::min(below + 1, times.size() - 1);
+    const double fraction = rank - static_cast<double>(below);
+    return times[below] + (times[above] - times[below]) * fraction;
+  }
+
+};
+
+
+/**
+ * @brief
+ * Runs benchmarks and collects their results.
+ */
+struct harness {
+
+  /**
+   * @brief
+   * Untimed runs before the timed ones.
+   */
+  unsigned int warmup;
+
+  /**
+   * @brief
+   * Timed runs.
+   */
+  unsigned int repetitions;
+
+  /**
+   * @brief
+   * Only benchmarks whose name contains this are run.
+   */
+  std::string filter;
+
+  /**
+   * @brief
+   * Where a line is written as each benchmark finishes.
+   */
+  std::ostream& progress;
+
+  /**
+   * @brief
+   * The results of the benchmarks run so far.
+   */
+  std::vector<result> results;
+
+  /**
+   * @brief
+   * Returns true if the benchmark passes the filter. Benchmarks check this
+   * before setting up their inputs so filtered ones cost nothing.
+   */
+  bool selected(const std::string& name) const
+  {
+    return name.find(filter) != std::string::npos;
+  }
+
+  /**
+   * @brief
+   * Returns true if any of the benchmarks pass the filter, for benchmarks
+   * that share their inputs.
+   */
+  bool any_selected(const std::vector<std::string>& names) const
+  {
+    return std::any_of(names.begin(), names.end(),
+                       [this](const std::string& name) {
+                         return this->selected(name);
+                       });
+  }
+
+  /**
+   * @brief
+   * Times f, which runs the benchmark once.
+   */
+  template <typename F>
+  void run(const std::string& name, std::size_t size, F f)
+  {
+    if (!selected(name)) {
+      return;
+    }
+    for (unsigned int i = 0; i < warmup; ++i) {
+      f();
+    }
+    result r {name, size, {}};
+    r.times.reserve(repetitions);
+    for (unsigned int i = 0; i < repetitions; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      f();
+      const auto stop = std::chrono::steady_clock::now();
+      r.times.push_back(
+        std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+    std::sort(r.times.begin(), r.times.end());
+    progress << name << " [" << size << "]: median " << r.percentile(50)
+             << " ms, p90 " << r.percentile(90) << " ms\n";
+    results.push_back(std::move(r));
+  }
+
+  /**
+   * @brief
+   * Writes the results as a JSON object with a "benchmarks" array.
+   */
+  void write_json(std::ostream& out) const
+  {
+    out << "{\n"
+        << "  \"warmup\": " << warmup << ",\n"
+        << "  \"repetitions\": " << repetitions << ",\n"
+        << "  \"benchmarks\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const auto& r = results[i];
+      out << (i == 0 ? "\n" : ",\n")
+          << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size
+          << ", \"min_ms\": " << r.times.front()
+          << ", \"p10_ms\": " << r.percentile(10)
+          << ", \"median_ms\": " << r.percentile(50)
+          << ", \"p90_ms\": " << r.percentile(90)
+          << ", \"p99_ms\": " << r.percentile(99)
+          << ", \"max_ms\": " << r.times.back() << "}";
+    }
+    out << "\n  ]\n"
+        << "}\n";
+  }
+
+};
+
+} // namespace bench
+
+#endif // ARGAGG_BENCH_HARNESS_HPP
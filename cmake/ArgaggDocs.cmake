@@ -0,0 +1,86 @@
+# Generates documentation of a program from its argagg::parser definitions at
+# build time.
+#
+#   argagg_generate_docs(
+#     <name>
+#     GENERATOR <target>
+#     [MAN_SECTION <section>]
+#     [OUTPUT_DIRECTORY <dir>]
+#     [HELP_SOURCE <variable>]
+#     [HELP_SYMBOL <symbol>]
+#   )
+#
+# GENERATOR is an executable target whose main() calls
+# argagg::generate_documentation() with the program's definitions. It's run
+# on the build host to write "<name>.<section>" (a roff man page, section 1
+# by default) and "<name>.md" into OUTPUT_DIRECTORY, which defaults to
+# "share/man/man<section>" and "share/doc/<name>" in the build folder. A
+# "<name>_docs" target that is part of "all" depends on them.
+#
+# If HELP_SOURCE is given the generator also writes "<name>_help.cpp" which
+# defines the rendered usage and help as "const char <symbol>[]" and its
+# length as "const std::size_t <symbol>_size". The path of that file is
+# stored in the named variable so it can be added to the program's sources.
+# HELP_SYMBOL defaults to "<name>_help".
+
+include( CMakeParseArguments )
+
+function( argagg_generate_docs name )
+  cmake_parse_arguments(
+    ARGAGG_DOCS
+    ""
+    "GENERATOR;MAN_SECTION;OUTPUT_DIRECTORY;HELP_SOURCE;HELP_SYMBOL"
+    ""
+    ${ARGN}
+  )
+  if( NOT ARGAGG_DOCS_GENERATOR )
+    message( FATAL_ERROR "argagg_generate_docs(${name}) needs a GENERATOR" )
+  endif()
+  if( NOT ARGAGG_DOCS_MAN_SECTION )
+    set( ARGAGG_DOCS_MAN_SECTION 1 )
+  endif()
+  if( NOT ARGAGG_DOCS_HELP_SYMBOL )
+    string( MAKE_C_IDENTIFIER "${name}_help" ARGAGG_DOCS_HELP_SYMBOL )
+  endif()
+
+  if( ARGAGG_DOCS_OUTPUT_DIRECTORY )
+    set( man_dir "${ARGAGG_DOCS_OUTPUT_DIRECTORY}" )
+    set( markdown_dir "${ARGAGG_DOCS_OUTPUT_DIRECTORY}" )
+  else()
+    set( man_dir "${CMAKE_BINARY_DIR}/share/man/man${ARGAGG_DOCS_MAN_SECTION}" )
+    set( markdown_dir "${CMAKE_BINARY_DIR}/share/doc/${name}" )
+  endif()
+  set( man_page "${man_dir}/${name}.${ARGAGG_DOCS_MAN_SECTION}" )
+  set( markdown_page "${markdown_dir}/${name}.md" )
+
+  add_custom_command(
+    OUTPUT "${man_page}" "${markdown_page}"
+    COMMAND ${CMAKE_COMMAND} -E make_directory "${man_dir}"
+    COMMAND ${CMAKE_COMMAND} -E make_directory "${markdown_dir}"
+    COMMAND ${ARGAGG_DOCS_GENERATOR}
+      --man-section "${ARGAGG_DOCS_MAN_SECTION}"
+      --man "${man_page}"
+      --markdown "${markdown_page}"
+    DEPENDS ${ARGAGG_DOCS_GENERATOR}
+    COMMENT "Generating documentation of ${name}"
+  )
+  add_custom_target(
+    ${name}_docs ALL
+    DEPENDS "${man_page}" "${markdown_page}"
+  )
+
+  # The help source is generated by a command of its own so that the program
+  # only depends on it and not on the documentation.
+  if( ARGAGG_DOCS_HELP_SOURCE )
+    set( help_source "${CMAKE_CURRENT_BINARY_DIR}/${name}_help.cpp" )
+    add_custom_command(
+      OUTPUT "${help_source}"
+      COMMAND ${ARGAGG_DOCS_GENERATOR}
+        --symbol "${ARGAGG_DOCS_HELP_SYMBOL}"
+        --help-source "${help_source}"
+      DEPENDS ${ARGAGG_DOCS_GENERATOR}
+      COMMENT "Rendering the help of ${name}"
+    )
+    set( ${ARGAGG_DOCS_HELP_SOURCE} "${help_source}" PARENT_SCOPE )
+  endif()
+endfunction()
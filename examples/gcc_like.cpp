@@ -36,6 +36,9 @@ int main(int argc, const char** argv)
     {"output", {"-o", "--output"}, "output filename (default: stdout)", 1},
   }};
 
+  // Like GCC, accept "@file" arguments that read more arguments from a file.
+  argparser.expand_response_files = true;
+
   // Define our usage text.
   std::ostringstream usage;
   usage
@@ -65,17 +68,10 @@ int main(int argc, const char** argv)
     return EXIT_SUCCESS;
   }
 
-  // Process include paths
-  std::vector<std::string> include_paths;
-  for (const auto& include_path_option : args["include_path"].all) {
-    include_paths.emplace_back(include_path_option.as<std::string>());
-  }
-
-  // Process definitions
-  std::vector<std::string> definitions;
-  for (const auto& definition_option : args["definition"].all) {
-    definitions.emplace_back(definition_option.as<std::string>());
-  }
+  // Process include paths and definitions. These point straight into argv so
+  // nothing is copied.
+  const auto include_paths = args["include_path"].all_views();
+  const auto definitions = args["definition"].all_views();
 
   // Regurgitate arguments
   std::cout << "include paths:\n";
@@ -8,10 +8,47 @@
  * sections, word wrapping, and a few other features.
  */
 #include <argagg/argagg.hpp>
+#include <argagg/convert/choices.hpp>
 
 #include <iostream>
 #include <cstdlib>
 
+enum class enum_opt {
+  foo,
+  bar,
+  hello,
+  bye,
+};
+
+namespace argagg {
+  template <>
+  struct choices<enum_opt> {
+    static std::array<choice<enum_opt>, 4> values()
+    {
+      return {{
+        {"foo", enum_opt::foo},
+        {"bar", enum_opt::bar},
+        {"hello", enum_opt::hello},
+        {"bye", enum_opt::bye},
+      }};
+    }
+  };
+namespace convert {
+  template <>
+  struct converter<enum_opt> : choice_converter<enum_opt> {};
+} // namespace convert
+} // namespace argagg
+
+static const char* enum_opt_name(enum_opt value)
+{
+  for (const auto& c : argagg::choices<enum_opt>::values()) {
+    if (c.value == value) {
+      return c.name;
+    }
+  }
+  return "?";
+}
+
 int main(int argc, char **argv)
 {
   using argagg::parser_results;
@@ -53,8 +90,8 @@ int main(int argc, char **argv)
         "A string option with default (default: 'Hello')", 1},
       {
         "enum-opt", {"--enum-opt"},
-        "A string option with list of values (possible values=\"foo\", "
-        "\"bar\", \"hello\", \"bye\"; default=\"hello\")", 1},
+        "A string option with list of values (possible values: " +
+        argagg::choices_list<enum_opt>() + "; default: hello)", 1},
       {
         "dependant", {"--dependant"},
         "option that depends on str-opt", 1},
@@ -133,7 +170,14 @@ int main(int argc, char **argv)
   cout << "The flag is " << flag_opt_arg << ".\n";
 
   if (args["enum-opt"]) {
-    cout << "enum-opt value: " << args["enum-opt"].as<string>() << '\n';
+    enum_opt value;
+    try {
+      value = args["enum-opt"].as<enum_opt>();
+    } catch (const std::exception& e) {
+      cerr << args.program << ": '--enum-opt': " << e.what() << '\n';
+      return EXIT_FAILURE;
+    }
+    cout << "enum-opt value: " << enum_opt_name(value) << '\n';
     cout << "enum-opt (original specified) value: hello\n";
   }
 
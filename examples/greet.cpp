@@ -0,0 +1,49 @@
+/**
+ * @file
+ * @brief
+ * Prints a greeting. Its --help prints help that was rendered at build time
+ * from the same definitions (see greet_docgen.cpp), which is linked in as
+ * greet_help.
+ */
+#include "greet_options.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+extern const char greet_help[];
+extern const std::size_t greet_help_size;
+
+int main(
+  int argc,
+  const char** argv)
+{
+  argagg::parser_results args;
+  try {
+    args = greet_parser().parse(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  if (args["help"]) {
+    std::cout.write(greet_help, static_cast<std::streamsize>(greet_help_size));
+    return EXIT_SUCCESS;
+  }
+
+  std::string greeting = "Hello, " + args["name"].as<std::string>("world");
+  if (args["shout"]) {
+    std::transform(greeting.begin(), greeting.end(), greeting.begin(),
+                   [](char c) {
+                     return static_cast<char>(
+                       std::toupper(static_cast<unsigned char>(c)));
+                   });
+  }
+  const int repeat = args["repeat"].as<int>(1);
+  for (int i = 0; i < repeat; ++i) {
+    std::cout << greeting << "!\n";
+  }
+  return EXIT_SUCCESS;
+}
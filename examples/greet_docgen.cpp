@@ -0,0 +1,18 @@
+/**
+ * @file
+ * @brief
+ * Generates the man page, markdown page and pre-rendered help of the greet
+ * example. It's run at build time by argagg_generate_docs() in
+ * cmake/ArgaggDocs.cmake.
+ */
+#include "greet_options.hpp"
+
+#include <iostream>
+
+int main(
+  int argc,
+  const char** argv)
+{
+  return argagg::generate_documentation(
+    argc, argv, greet_documentation(), greet_parser(), std::cerr);
+}
@@ -0,0 +1,38 @@
+/**
+ * @file
+ * @brief
+ * The options of the greet example, shared by the program and the generator
+ * of its documentation (see greet_docgen.cpp).
+ */
+#ifndef ARGAGG_EXAMPLES_GREET_OPTIONS_HPP
+#define ARGAGG_EXAMPLES_GREET_OPTIONS_HPP
+
+#include <argagg/argagg.hpp>
+
+inline
+argagg::parser greet_parser()
+{
+  return argagg::parser {{
+      {"help", {"-h", "--help"}, "shows this help message", 0},
+      {"name", {"-n", "--name"}, "who to greet (default: world)", 1},
+      {"repeat", {"-r", "--repeat"}, "how many times to greet (default: 1)", 1},
+      {"shout", {"-s", "--shout"}, "greets in upper case", 0},
+    }};
+}
+
+inline
+argagg::documentation greet_documentation()
+{
+  return argagg::documentation {
+    "greet",
+    "1",
+    "print a greeting",
+    "[options]",
+    "Prints a greeting to standard output.\n"
+    "\n"
+    "The help printed by --help was rendered when greet was built, so it is "
+    "written with a single write of static data.",
+  };
+}
+
+#endif // ARGAGG_EXAMPLES_GREET_OPTIONS_HPP
@@ -33,18 +33,57 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cctype>
+#include <cerrno>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <istream>
 #include <iterator>
+#include <map>
+#include <memory>
 #include <ostream>
 #include <sstream>
 #include <stdexcept>
+#include <streambuf>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ARGAGG_HAS_POSIX_IO 1
+#endif
+
+#if defined(__APPLE__)
+#include <crt_externs.h>
+#elif defined(__unix__)
+extern char** environ;
+#endif
+
+// The free std::atomic_load() and std::atomic_store() overloads for
+// std::shared_ptr are deprecated since C++20 in favour of this.
+#if defined(__cpp_lib_atomic_shared_ptr) && \
+    __cpp_lib_atomic_shared_ptr >= 201711L
+#define ARGAGG_HAS_ATOMIC_SHARED_PTR 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ARGAGG_HAS_SSE2 1
+#endif
+
 
 /**
  * @brief
@@ -119,6 +158,18 @@ struct unexpected_option_error
 };
 
 
+/**
+ * @brief
+ * This exception is thrown when abbreviated long flags are allowed (see
+ * argagg::parser::allow_abbreviations) and a long flag is a prefix of the
+ * long flags of more than one option. The message lists the candidates.
+ */
+struct ambiguous_option_error
+: public unexpected_option_error {
+  using unexpected_option_error::unexpected_option_error;
+};
+
+
 /**
  * @brief
  * This exception is thrown when an option requires an argument but is not
@@ -155,6 +206,53 @@ struct unknown_option
 };
 
 
+/**
+ * @brief
+ * This exception is thrown when the first positional argument of a
+ * argagg::command that has subcommands doesn't name one of them, or when an
+ * unknown subcommand is requested by name.
+ */
+struct unknown_subcommand
+: public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+
+/**
+ * @brief
+ * This exception is thrown when response files (see
+ * argagg::parser::expand_response_files) include each other recursively or
+ * are nested more than argagg::max_response_file_depth deep.
+ */
+struct response_file_error
+: public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+
+/**
+ * @brief
+ * This exception is thrown when a command line string (see
+ * argagg::split_command_line()) has a quote that is never closed.
+ */
+struct invalid_command_line
+: public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+
+/**
+ * @brief
+ * This exception is thrown when a config file (see
+ * argagg::merge_config_file()) can't be read or has an invalid line. The
+ * message starts with the path and line number of the problem.
+ */
+struct config_file_error
+: public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+
 /**
  * @brief
  * The set of template instantiations that convert C-strings to other types for
@@ -378,6 +476,27 @@ struct option_results {
   template <typename T>
   T as(const T& t) const;
 
+  /**
+   * @brief
+   * Converts the arguments of ALL option parse results for the parent
+   * definition to the provided type, in the order they were parsed. For
+   * example, if this was for "-I a -I b" then calling this method for
+   * std::string returns {"a", "b"}. The result is reserved up front and
+   * filled in a single pass. Any exceptions thrown by option_result::as() are
+   * not handled.
+   */
+  template <typename T>
+  std::vector<T> all_as() const;
+
+  /**
+   * @brief
+   * Gets the arguments of ALL option parse results for the parent definition
+   * without converting or copying them. Like option_result::arg these point
+   * into the original command line arguments and are nullptr for option parse
+   * results without an argument.
+   */
+  std::vector<const char*> all_views() const;
+
   /**
    * @brief
    * Since we have the option_results::as() API we might as well alias
@@ -430,6 +549,14 @@ struct parser_results {
    */
   std::vector<const char*> pos;
 
+  /**
+   * @brief
+   * Buffers that the C-strings in these results may point into instead of
+   * the original command line arguments, such as expanded response files.
+   * They're kept alive for as long as these results are.
+   */
+  std::vector<std::shared_ptr<void>> buffers;
+
   /**
    * @brief
    * Used to check if an option was specified at all.
@@ -478,6 +605,26 @@ struct parser_results {
   template <typename T>
   std::vector<T> all_as() const;
 
+  /**
+   * @brief
+   * Gets all positional arguments converted to the given type, splitting the
+   * conversion into contiguous chunks that are converted in parallel on up to
+   * num_threads threads (including the calling thread). If num_threads is
+   * zero then std::thread::hardware_concurrency() is used. Each chunk has at
+   * least min_chunk_size arguments so small argument lists are simply
+   * converted serially on the calling thread.
+   *
+   * If any conversions fail then the exception thrown for the lowest failing
+   * index is rethrown once all threads have finished. This is the same
+   * exception the serial all_as() would have thrown. Like the serial
+   * all_as(), T only has to be move constructible, not default
+   * constructible.
+   */
+  template <typename T>
+  std::vector<T> all_as(
+    unsigned int num_threads,
+    std::size_t min_chunk_size = 4096) const;
+
 };
 
 
@@ -514,6 +661,61 @@ struct definition {
    */
   unsigned int num_args;
 
+  /**
+   * @brief
+   * Name of an environment variable that provides this option when none of
+   * its flags show up in the command line arguments. Empty if there isn't
+   * one. See argagg::merge_environment() for the details.
+   */
+  std::string env;
+
+  /**
+   * @brief
+   * Name of the section of the help this option is listed in. Empty for
+   * options that are listed before all of the sections. See
+   * argagg::parser::help(const std::string&).
+   */
+  std::string group;
+
+  /**
+   * @brief
+   * Constructs a definition without a name, flags or arguments, like value
+   * initializing it did before it had constructors.
+   */
+  definition();
+
+  /**
+   * @brief
+   * Constructs a definition. This is what allows definitions to be brace
+   * initialized with or without an environment variable and help group:
+   *
+   * @code
+   * argagg::definition threads {
+   *   "threads", {"-t", "--threads"}, "number of threads", 1, "APP_THREADS"};
+   * argagg::definition cache {
+   *   "cache", {"--cache-size"}, "cache size in MiB", 1, "", "storage"};
+   * @endcode
+   */
+  definition(
+    std::string name,
+    std::vector<std::string> flags,
+    std::string help,
+    unsigned int num_args,
+    std::string env = std::string(),
+    std::string group = std::string());
+
+  /**
+   * @brief
+   * Returns true if every member of both definitions is the same.
+   */
+  bool operator == (const definition& other) const;
+
+  /**
+   * @brief
+   * Returns true if any member of the definitions differs.
+   */
+  bool operator != (const definition& other) const;
+
   /**
    * @brief
    * Returns true if this option does not want any arguments.
@@ -540,6 +742,16 @@ bool cmd_line_arg_is_option_flag(
   const char* s);
 
 
+/**
+ * @brief
+ * Same as argagg::cmd_line_arg_is_option_flag(const char*) for an argument
+ * whose length is already known.
+ */
+bool cmd_line_arg_is_option_flag(
+  const char* s,
+  std::size_t len);
+
+
 /**
  * @brief
  * Checks whether a flag in an option definition is valid. I suggest reading
@@ -558,13 +770,136 @@ bool flag_is_short(
   const char* s);
 
 
+/**
+ * @brief
+ * Returns the Levenshtein distance between two strings, which don't need to
+ * be NUL-terminated: the number of single character insertions, deletions
+ * and substitutions it takes to turn one into the other.
+ */
+unsigned int edit_distance(
+  const char* a,
+  std::size_t a_len,
+  const char* b,
+  std::size_t b_len);
+
+
+/**
+ * @brief
+ * A std::shared_ptr that can be loaded and replaced from several threads at
+ * once. Copies load the pointer so that objects holding one stay copyable.
+ */
+template <typename T>
+struct atomic_shared_ptr {
+
+  atomic_shared_ptr();
+
+  atomic_shared_ptr(const atomic_shared_ptr& other);
+
+  atomic_shared_ptr& operator = (const atomic_shared_ptr& other);
+
+  /**
+   * @brief
+   * Returns the pointer.
+   */
+  std::shared_ptr<T> load() const;
+
+  /**
+   * @brief
+   * Replaces the pointer.
+   */
+  void store(std::shared_ptr<T> ptr);
+
+private:
+
+#ifdef ARGAGG_HAS_ATOMIC_SHARED_PTR
+  std::atomic<std::shared_ptr<T>> ptr;
+#else
+  std::shared_ptr<T> ptr;
+#endif
+
+};
+
+
+/**
+ * @brief
+ * Something a parser cached along with the copy of the definitions it was
+ * made from (see argagg::parser::definitions_snapshot()). The value is
+ * current as long as that's still the parser's copy.
+ */
+template <typename T>
+struct parser_cache_entry {
+
+  /**
+   * @brief
+   * The copy of the definitions the value was made from.
+   */
+  std::shared_ptr<const std::vector<definition>> definitions;
+
+  /**
+   * @brief
+   * The cached value.
+   */
+  std::shared_ptr<const T> value;
+
+};
+
+
+/**
+ * @brief
+ * A BK-tree of strings for finding the ones within an edit distance of a
+ * query without comparing the query to all of them. Every child of a node
+ * is labelled with its distance to the node, and because edit distance is
+ * a metric only the children whose labels are within the query's bound of
+ * the query's distance to the node can hold matches.
+ */
+struct bk_tree {
+
+  /**
+   * @brief
+   * A string in the tree. Children are kept in a singly linked list through
+   * their siblings.
+   */
+  struct node {
+    std::string key;
+    unsigned int distance;
+    std::size_t first_child;
+    std::size_t next_sibling;
+  };
+
+  /**
+   * @brief
+   * The nodes, the root being the first one. Zero stands for no node in the
+   * child and sibling links since the root is never anyone's child.
+   */
+  std::vector<node> nodes;
+
+  /**
+   * @brief
+   * Adds the string to the tree unless it's already there.
+   */
+  void insert(std::string key);
+
+  /**
+   * @brief
+   * Returns the strings within max_distance of the key (which doesn't need
+   * to be NUL-terminated) paired with their distances, sorted by distance
+   * and then by string.
+   */
+  std::vector<std::pair<unsigned int, const std::string*>> find(
+    const char* key,
+    std::size_t len,
+    unsigned int max_distance) const;
+
+};
+
+
 /**
  * @brief
  * Contains two maps which aid in option parsing. The first map, @ref
  * short_map, maps from a short flag (just a character) to a pointer to the
  * original @ref definition that the flag represents. The second map, @ref
- * long_map, maps from a long flag (an std::string) to a pointer to the
- * original @ref definition that the flag represents.
+ * long_flags, is a sorted vector of the long flags paired with pointers to
+ * the original @ref definition that each flag represents.
  *
  * This object is usually a temporary that only exists during the parsing
  * operation. It is typically constructed using @ref validate_definitions().
@@ -578,13 +913,6 @@ struct parser_map {
    */
   std::array<const definition*, 256> short_map;
 
-  /**
-   * @brief
-   * Maps from a long flag (an std::string) to a pointer to the original @ref
-   * definition that the flag represents.
-   */
-  std::unordered_map<std::string, const definition*> long_map;
-
   /**
    * @brief
    * Returns true if the provided short flag exists in the map object.
@@ -615,6 +943,106 @@ struct parser_map {
   const definition* get_definition_for_long_flag(
     const std::string& flag) const;
 
+  /**
+   * @brief
+   * The long flags of all definitions, sorted, paired with their
+   * definitions. It's searched with a binary search, which doesn't need an
+   * std::string of the flag to search for.
+   */
+  std::vector<std::pair<std::string, const definition*>> long_flags;
+
+  /**
+   * @brief
+   * If the long flag (which doesn't need to be NUL-terminated) exists in the
+   * map object then it is returned by this method. If it doesn't then
+   * nullptr will be returned.
+   */
+  const definition* get_definition_for_long_flag(
+    const char* flag,
+    std::size_t len) const;
+
+  /**
+   * @brief
+   * The environment variable names of the definitions that have one, sorted
+   * by name, paired with those definitions.
+   */
+  std::vector<std::pair<std::string, const definition*>> env_vars;
+
+  /**
+   * @brief
+   * If an environment variable with the given name (which doesn't need to be
+   * NUL-terminated) exists in the map object then its definition is
+   * returned. If it doesn't then nullptr will be returned.
+   */
+  const definition* get_definition_for_env_var(
+    const char* name,
+    std::size_t len) const;
+
+  /**
+   * @brief
+   * The keys that config files may use for each definition, sorted by key,
+   * paired with those definitions. A definition's keys are its name and its
+   * long flags without the leading hyphens. Names win over long flags of
+   * other definitions. Only config files need them, so they're made by
+   * get_definition_for_config_key() the first time it's called.
+   */
+  mutable atomic_shared_ptr<
+    const std::vector<std::pair<std::string, const definition*>>>
+    config_keys;
+
+  /**
+   * @brief
+   * If a config file key with the given name (which doesn't need to be
+   * NUL-terminated) exists in the map object then its definition is
+   * returned. If it doesn't then nullptr will be returned.
+   */
+  const definition* get_definition_for_config_key(
+    const char* name,
+    std::size_t len) const;
+
+  /**
+   * @brief
+   * If true then long flags may be abbreviated to any prefix that only
+   * belongs to a single option, like getopt_long() allows. Defaults to false.
+   */
+  bool allow_abbreviations;
+
+  /**
+   * @brief
+   * Looks up a possibly abbreviated long flag (which doesn't need to be
+   * NUL-terminated) in @ref long_flags. Returns the entry of the exact match
+   * if there is one, otherwise the first entry that starts with the flag if
+   * all such entries belong to the same definition, otherwise nullptr if
+   * there aren't any. Throws an argagg::ambiguous_option_error if entries of
+   * several definitions start with the flag.
+   */
+  const std::pair<std::string, const definition*>* find_long_flag_prefix(
+    const char* flag,
+    std::size_t len) const;
+
+  /**
+   * @brief
+   * A BK-tree of all of the flags, built by suggest_flags() the first time
+   * it's asked for suggestions so that only parses that fail pay for it.
+   * An argagg::parser keeps its map, and so the tree, for as long as its
+   * definitions don't change.
+   */
+  mutable atomic_shared_ptr<const bk_tree> flag_tree;
+
+  /**
+   * @brief
+   * Returns up to max_suggestions known flags that are closest to the given
+   * unknown flag (which doesn't need to be NUL-terminated), nearest first.
+   * Flags are only suggested if they're within an edit distance of about a
+   * quarter of the flag's length (at least one), not counting the leading
+   * hyphens. Threads that ask for suggestions at the same time may each
+   * build a tree, only one of which is kept.
+   */
+  std::vector<std::string> suggest_flags(
+    const char* flag,
+    std::size_t len,
+    std::size_t max_suggestions = 3) const;
+
 };
 
 
@@ -631,1056 +1059,6207 @@ parser_map validate_definitions(
 
 /**
  * @brief
- * A list of option definitions used to inform how to parse arguments.
+ * Returns the environment of the process as a nullptr terminated array of
+ * "NAME=value" C-strings.
  */
-struct parser {
+const char* const* environment();
 
-  /**
-   * @brief
-   * Vector of the option definitions which inform this parser how to parse
-   * the command line arguments.
-   */
-  std::vector<definition> definitions;
 
-  /**
-   * @brief
-   * Parses the provided command line arguments and returns the results as
-   * @ref parser_results.
-   *
-   * @note
-   * This method is not thread-safe and assumes that no modifications are made
-   * to the definitions member field during the extent of this method call.
-   */
-  parser_results parse(int argc, const char** argv) const;
+/**
+ * @brief
+ * Fills in options that didn't show up in the command line arguments from
+ * the environment variables named by their definitions (see
+ * argagg::definition::env). The environment is a nullptr terminated array
+ * of "NAME=value" C-strings which is scanned once, looking each name up in
+ * the parser map. Command line arguments always take precedence: an option
+ * that already has results is left alone.
+ *
+ * An option that expects an argument gets a single option result whose
+ * argument is the variable's value. An option that doesn't expect an
+ * argument is considered given unless the value is empty or "0". The
+ * option results point into the environment, just like std::getenv(), so
+ * they shouldn't be used after the variable is modified.
+ */
+void merge_environment(
+  const parser_map& map,
+  const char* const* env,
+  parser_results& results);
 
-  /**
-   * @brief
-   * Through strict interpretation of pointer casting rules, despite this being
-   * a safe operation, C++ doesn't allow implicit casts from <tt>char**</tt> to
-   * <tt>const char**</tt> so here's an overload that performs a const_cast,
-   * which is typically frowned upon but is safe here.
-   */
-  parser_results parse(int argc, char** argv) const;
 
-};
+/**
+ * @brief
+ * Like argagg::merge_environment() but the option results to fill in for a
+ * definition are the ones that results_for(definition) returns.
+ */
+template <typename ResultsFor>
+void merge_environment_with(
+  const parser_map& map,
+  const char* const* env,
+  ResultsFor&& results_for);
 
 
 /**
  * @brief
- * A convenience output stream that will accumulate what is streamed to it and
- * then, on destruction, format the accumulated string (via the
- * argagg::fmt_string() function) to the provided std::ostream.
- *
- * Example use:
- *
- * @code
- * {
- *   argagg::fmt_ostream f(std::cerr);
- *   f << "Usage: " << really_long_string << '\n';
- * } // on destruction here the formatted string will be streamed to std::cerr
- * @endcode
+ * The contents of a response file, read into a single heap buffer so that
+ * it can be tokenized in place. There's always one byte past the end of the
+ * contents so that the last argument can be NUL-terminated. A private
+ * mapping of the file would be copied page by page as soon as tokenizing
+ * writes to it, which costs more than reading the file in one go.
  */
-struct fmt_ostream : public std::ostringstream {
+struct response_file {
 
   /**
    * @brief
-   * Reference to the final output stream that the formatted string will be
-   * streamed to.
+   * The contents of the file.
    */
-  std::ostream& output;
+  char* data;
 
   /**
    * @brief
-   * Construct to output to the provided output stream when this object is
-   * destroyed.
+   * Size of the contents of the file.
    */
-  fmt_ostream(std::ostream& output);
+  std::size_t size;
+
+  /**
+   * @brief
+   * Constructs an empty response file.
+   */
+  response_file();
+
+  response_file(const response_file&) = delete;
+  response_file& operator = (const response_file&) = delete;
 
   /**
    * @brief
-   * Special destructor that will format the accumulated string using fmt (via
-   * the argagg::fmt_string() function) and stream it to the std::ostream
-   * stored.
+   * Frees @ref data.
    */
-  ~fmt_ostream();
+  ~response_file();
 
 };
 
 
 /**
  * @brief
- * Processes the provided string using the fmt utility and returns the
- * resulting output as a string. Not the most efficient (in time or space) but
- * gets the job done.
+ * How deeply response files may include each other. Cycles are caught by
+ * comparing the identities of the files, this is a backstop in case two
+ * paths to the same file aren't recognized as such.
  */
-std::string fmt_string(const std::string& s);
-
-
-} // namespace argagg
+constexpr std::size_t max_response_file_depth = 64;
 
 
 /**
  * @brief
- * Writes the option help to the given stream.
+ * Opens the response file at the given path. Returns nullptr if the path
+ * can't be read as a regular file in which case GCC treats the "@file"
+ * argument as an ordinary argument. The identity is set to a string that is
+ * the same for any two paths that refer to the same file.
+ */
+std::shared_ptr<response_file> open_response_file(
+  const char* path,
+  std::string& identity);
+
+
+/**
+ * @brief
+ * Splits the contents of a response file into arguments in place and appends
+ * the resulting NUL-terminated C-strings to args. This follows the rules that
+ * GCC uses for response files: arguments are separated by white space, white
+ * space can be quoted with single or double quotes, and a backslash escapes
+ * the next character, even inside quotes. The data must have one byte past
+ * size available to NUL-terminate the last argument.
+ */
+void tokenize_response_file(
+  char* data,
+  std::size_t size,
+  std::vector<const char*>& args);
+
+
+/**
+ * @brief
+ * Returns a copy of the given command line arguments with each "@file"
+ * argument replaced by the arguments in that file, recursively. The returned
+ * C-strings point either into the original arguments or into the response
+ * files, which are appended to buffers to keep them alive. If a file can't be
+ * read then the "@file" argument is kept as is. A argagg::response_file_error
+ * is thrown if a response file includes itself, directly or indirectly.
+ */
+std::vector<const char*> expand_response_files(
+  int argc,
+  const char** argv,
+  std::vector<std::shared_ptr<void>>& buffers);
+
+
+/**
+ * @brief
+ * A config file that has been merged into some parser results by
+ * argagg::merge_config_file(). The option results point into its contents
+ * which are kept alive by the parser results. It remembers which line each
+ * value came from so that errors found later, such as failed conversions,
+ * can still point at the offending line.
+ */
+struct config_file {
+
+  /**
+   * @brief
+   * Path of the config file.
+   */
+  std::string path;
+
+  /**
+   * @brief
+   * The contents of the config file which values are NUL-terminated in.
+   */
+  std::shared_ptr<response_file> contents;
+
+  /**
+   * @brief
+   * Each value in the order they appear in the file paired with the line
+   * number it's on.
+   */
+  std::vector<std::pair<const char*, std::size_t>> lines;
+
+  /**
+   * @brief
+   * Returns the line number that an option result's argument came from or
+   * zero if it didn't come from this file.
+   */
+  std::size_t line_of(const char* arg) const;
+
+};
+
+
+/**
+ * @brief
+ * Reads the config file at path and adds its values to the results for any
+ * options that don't have results yet. Since argagg::parser::parse() fills
+ * in environment variables first, the command line takes precedence over
+ * the environment which takes precedence over the file.
+ *
+ * Each line holds a "key = value" pair. The key is a definition's name or
+ * one of its long flags without the hyphens. White space around keys and
+ * values is ignored and a value can be put in single or double quotes to
+ * keep white space. Repeated keys add an option result each, like repeated
+ * flags. Options that don't expect an argument may leave out the value or
+ * give a boolean ("true", "yes", "on", "1", "false", "no", "off", "0").
+ * Blank lines, lines starting with '#' or ';' and INI "[section]" headers
+ * are skipped.
+ *
+ * The file is read into a single buffer and parsed in one pass, with
+ * values NUL-terminated in place and keys looked up without copying them.
+ * Throws an argagg::config_file_error naming the line of the problem.
+ */
+std::shared_ptr<config_file> merge_config_file(
+  const parser_map& map,
+  const char* path,
+  parser_results& results);
+
+
+/**
+ * @brief
+ * A command line argument that is a NUL-terminated C-string whose length is
+ * already known so that the parser doesn't need to measure it again.
+ */
+struct arg_view {
+
+  /**
+   * @brief
+   * The NUL-terminated argument.
+   */
+  const char* data;
+
+  /**
+   * @brief
+   * Length of the argument, not including the NUL terminator.
+   */
+  std::size_t size;
+
+};
+
+
+/**
+ * @brief
+ * A forward iterator over a buffer of NUL-terminated arguments laid out back
+ * to back, yielding an argagg::arg_view for each argument. This is the
+ * layout of argagg::command_line and of /proc/<pid>/cmdline on Linux. Each
+ * argument is measured once as the iterator reaches it, never looking past
+ * the end of the buffer.
+ */
+struct nul_separated_iterator {
+
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = arg_view;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const arg_view*;
+  using reference = const arg_view&;
+
+  /**
+   * @brief
+   * The argument the iterator is at.
+   */
+  arg_view arg;
+
+  /**
+   * @brief
+   * One past the last byte of the buffer.
+   */
+  const char* end;
+
+  /**
+   * @brief
+   * Constructs an iterator at the argument that starts at pos. The iterator
+   * equals the end iterator when pos is end.
+   */
+  nul_separated_iterator(const char* pos, const char* end);
+
+  const arg_view& operator * () const;
+  const arg_view* operator -> () const;
+  nul_separated_iterator& operator ++ ();
+  nul_separated_iterator operator ++ (int);
+  bool operator == (const nul_separated_iterator& other) const;
+  bool operator != (const nul_separated_iterator& other) const;
+
+};
+
+
+/**
+ * @brief
+ * A command line string that has been split into arguments by
+ * argagg::split_command_line(). The arguments are stored in a single buffer
+ * as NUL-terminated C-strings laid out back to back so that they can be
+ * parsed in place with argagg::parser::parse(const command_line&).
+ */
+struct command_line {
+
+  /**
+   * @brief
+   * The buffer holding the arguments.
+   */
+  std::shared_ptr<char> data;
+
+  /**
+   * @brief
+   * Number of bytes used by the arguments, including their NUL terminators.
+   */
+  std::size_t size;
+
+  /**
+   * @brief
+   * Number of arguments.
+   */
+  std::size_t count;
+
+  /**
+   * @brief
+   * Returns an iterator at the first argument.
+   */
+  nul_separated_iterator begin() const;
+
+  /**
+   * @brief
+   * Returns an iterator past the last argument.
+   */
+  nul_separated_iterator end() const;
+
+};
+
+
+/**
+ * @brief
+ * Splits a command line string into arguments in place following the
+ * quoting rules of the POSIX shell. Arguments are separated by spaces, tabs
+ * and newlines. Single quotes preserve everything up to the closing quote.
+ * Inside double quotes a backslash only escapes '$', '`', '"', '\\' and a
+ * newline, otherwise it's kept. Outside quotes a backslash escapes any
+ * character. A backslash followed by a newline is removed entirely. No
+ * expansions of any kind are performed.
+ *
+ * The unescaped arguments are written back to back into data as
+ * NUL-terminated C-strings. Since they only ever shrink there must only be
+ * one byte past size available for the last terminator. Returns the number
+ * of bytes used by the arguments and sets count to the number of arguments.
+ * Throws an argagg::invalid_command_line if a quote isn't closed.
+ */
+std::size_t tokenize_command_line(
+  char* data,
+  std::size_t size,
+  std::size_t& count);
+
+
+/**
+ * @brief
+ * Copies the command line string into a buffer and splits it into arguments
+ * with argagg::tokenize_command_line().
+ */
+command_line split_command_line(
+  const char* command,
+  std::size_t len);
+
+
+/**
+ * @brief
+ * Copies the command line string into a buffer and splits it into arguments
+ * with argagg::tokenize_command_line().
+ */
+command_line split_command_line(
+  const std::string& command);
+
+
+/**
+ * @brief
+ * Gets the characters of an argument for the parser. The arguments that
+ * argagg::parser::parse(first, last) accepts are C-strings, std::string,
+ * argagg::arg_view, pairs of a pointer and a length, and anything with
+ * data() and size() methods like std::string_view.
+ */
+const char* arg_data(const char* arg);
+const char* arg_data(const arg_view& arg);
+const char* arg_data(const std::string& arg);
+
+template <typename Pointer, typename Size>
+const char* arg_data(const std::pair<Pointer, Size>& arg);
+
+/**
+ * @brief
+ * Gets the length of an argument for the parser. See argagg::arg_data().
+ * Only C-strings need to be measured.
+ */
+std::size_t arg_length(const char* arg);
+std::size_t arg_length(const arg_view& arg);
+std::size_t arg_length(const std::string& arg);
+
+template <typename Pointer, typename Size>
+std::size_t arg_length(const std::pair<Pointer, Size>& arg);
+
+
+/**
+ * @brief
+ * True if T has data() and size() methods like std::string_view.
+ */
+template <typename T, typename = void>
+struct is_string_view_like
+: public std::false_type {
+};
+
+template <typename T>
+struct is_string_view_like<T, decltype(
+  static_cast<void>(std::declval<const T&>().data()),
+  static_cast<void>(std::declval<const T&>().size()))>
+: public std::true_type {
+};
+
+template <typename T>
+typename std::enable_if<is_string_view_like<T>::value, const char*>::type
+arg_data(const T& arg);
+
+template <typename T>
+typename std::enable_if<is_string_view_like<T>::value, std::size_t>::type
+arg_length(const T& arg);
+
+
+/**
+ * @brief
+ * True if arguments of type T are known to be NUL-terminated right after
+ * their length, so that the parser can point into them. That's the case for
+ * C-strings, std::string and argagg::arg_view. Other arguments, like
+ * string views and pointer and length pairs, are copied into a single
+ * buffer first.
+ */
+template <typename T>
+struct arg_is_nul_terminated
+: public std::false_type {
+};
+
+template <>
+struct arg_is_nul_terminated<const char*>
+: public std::true_type {
+};
+
+template <>
+struct arg_is_nul_terminated<char*>
+: public std::true_type {
+};
+
+template <>
+struct arg_is_nul_terminated<arg_view>
+: public std::true_type {
+};
+
+template <>
+struct arg_is_nul_terminated<std::string>
+: public std::true_type {
+};
+
+
+/**
+ * @brief
+ * An iterator over arguments that have been copied back to back into a
+ * single buffer as NUL-terminated C-strings, yielding an argagg::arg_view
+ * for each one. It walks the original arguments alongside to get their
+ * lengths so the copies never need to be measured.
+ */
+template <typename Iterator>
+struct packed_arg_iterator {
+
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = arg_view;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const arg_view*;
+  using reference = arg_view;
+
+  /**
+   * @brief
+   * The original argument.
+   */
+  Iterator source;
+
+  /**
+   * @brief
+   * The copy of the original argument.
+   */
+  const char* pos;
+
+  arg_view operator * () const;
+  packed_arg_iterator& operator ++ ();
+  bool operator == (const packed_arg_iterator& other) const;
+  bool operator != (const packed_arg_iterator& other) const;
+
+};
+
+
+/**
+ * @brief
+ * The state of a parse between command line arguments. Arguments are fed in
+ * one at a time and whatever they turn out to mean is handed to a handler
+ * right away. A handler is any object with these two methods:
+ *
+ * @code
+ * void option(const argagg::definition& defn, const char* arg);
+ * void positional(const char* arg);
+ * @endcode
+ *
+ * An option that expects arguments is handed over once its last argument
+ * has been fed in, with arg pointing to that argument. Otherwise arg is
+ * nullptr for options or points into the argument that was fed in. Either
+ * way it's only guaranteed to live as long as that argument so handlers
+ * that need to keep it must copy it.
+ *
+ * This is what all of the parse methods are built on, but it can also be
+ * fed arguments as they arrive, say from an interactive session or a
+ * network protocol:
+ *
+ * @code
+ * argagg::parser_map map = argagg::validate_definitions(argparser.definitions);
+ * argagg::parser_results results {nullptr, {}, {}, {}};
+ * for (const auto& defn : argparser.definitions) {
+ *   results.options.insert(
+ *     std::make_pair(defn.name, argagg::option_results {{}}));
+ * }
+ * argagg::parser_results_handler handler {results};
+ * argagg::parse_state state(map);
+ * std::string token;
+ * while (read_token(token)) {
+ *   // The results point into the tokens so they have to keep them alive.
+ *   auto kept = std::make_shared<std::string>(std::move(token));
+ *   results.buffers.push_back(kept);
+ *   state.feed(kept->c_str(), kept->size(), handler);
+ * }
+ * state.finish();
+ * @endcode
+ *
+ * Like parse() this gives every definition an empty argagg::option_results
+ * up front so that options that didn't show up can still be looked up.
+ *
+ * The state is just a few pointers and flags that refer to the parser map
+ * and never allocates, so it's cheap to copy. A copy is a snapshot which
+ * can be fed different arguments (with a different handler) to explore a
+ * speculative parse without disturbing the original.
+ */
+struct parse_state {
+
+  /**
+   * @brief
+   * The map of the definitions being parsed.
+   */
+  const parser_map* map;
+
+  /**
+   * @brief
+   * True once the special "--" argument has been seen, after which every
+   * argument is positional.
+   */
+  bool ignore_flags;
+
+  /**
+   * @brief
+   * The option that is waiting for arguments or nullptr if none is.
+   */
+  const definition* pending_option;
+
+  /**
+   * @brief
+   * The flag of the pending option as it appears in its definition.
+   */
+  const std::string* pending_flag;
+
+  /**
+   * @brief
+   * Number of arguments the pending option is still waiting for.
+   */
+  unsigned int num_option_args_to_consume;
+
+  /**
+   * @brief
+   * Constructs the state at the start of parsing using the given map, which
+   * must outlive the state.
+   */
+  explicit parse_state(const parser_map& map);
+
+  /**
+   * @brief
+   * Parses the next argument, which must be NUL-terminated at arg[len].
+   * Throws the same exceptions as argagg::parser::parse().
+   */
+  template <typename Handler>
+  void feed(const char* arg, std::size_t len, Handler& handler);
+
+  /**
+   * @brief
+   * Parses the next argument, which is a C-string.
+   */
+  template <typename Handler>
+  void feed(const char* arg, Handler& handler);
+
+  /**
+   * @brief
+   * Returns true if an option is waiting for arguments, in which case the
+   * next argument goes to that option no matter what it looks like.
+   */
+  bool expects_option_argument() const;
+
+  /**
+   * @brief
+   * Finishes parsing. Throws an argagg::option_lacks_argument_error if an
+   * option is still waiting for arguments.
+   */
+  void finish() const;
+
+};
+
+
+/**
+ * @brief
+ * A argagg::parse_state handler that collects everything into
+ * argagg::parser_results.
+ */
+struct parser_results_handler {
+
+  /**
+   * @brief
+   * The results being collected into.
+   */
+  parser_results& results;
+
+  void option(const definition& defn, const char* arg);
+  void positional(const char* arg);
+
+};
+
+
+/**
+ * @brief
+ * A argagg::parse_state handler that ignores everything, for when only the
+ * state itself is of interest.
+ */
+struct discarding_handler {
+
+  void option(const definition&, const char*) {}
+  void positional(const char*) {}
+
+};
+
+
+/**
+ * @brief
+ * The ways a word of a partially typed command line could be completed.
+ */
+struct completion {
+
+  /**
+   * @brief
+   * The sorted flags (or subcommand names) that start with the word. Empty
+   * if the word is an option argument or a positional argument, which are
+   * left to the shell (usually to complete file names).
+   */
+  std::vector<std::string> candidates;
+
+  /**
+   * @brief
+   * The option whose argument the word is, either because the option
+   * before it is waiting for an argument or because the word is of the form
+   * "--flag=partial", or nullptr if it isn't an option argument.
+   */
+  const definition* option;
+
+};
+
+
+/**
+ * @brief
+ * Completes the word that follows the arguments that were fed to the state.
+ * Flags are looked up in the parser map's sorted argagg::parser_map::long_flags
+ * so finding the ones that start with the word is a binary search.
+ */
+completion complete_argument(const parse_state& state, const char* word);
+
+
+/**
+ * @brief
+ * Parses the arguments in the range [arg_i, arg_end) using the parser map
+ * built from the given definitions. The first argument in the range is the
+ * program name. The buffers are moved into the results. This is the heart of
+ * argagg::parser::parse().
+ */
+template <typename ArgIterator>
+parser_results parse_arguments(
+  const std::vector<definition>& definitions,
+  const parser_map& map,
+  ArgIterator arg_i,
+  ArgIterator arg_end,
+  std::vector<std::shared_ptr<void>> buffers);
+
+
+/**
+ * @brief
+ * Parses NUL-separated arguments, like the output of "find -print0", read in
+ * chunks of chunk_size bytes by calling read(buffer, size). The reader
+ * returns how many bytes it read and zero at the end of the input. Every
+ * argument is parsed (there's no program name) and handed to the handler as
+ * soon as its chunk has been read (see argagg::parse_state). Arguments that
+ * span chunks are carried over to the next one so the memory used is
+ * bounded by the chunk size, or the longest argument if that's longer. The
+ * last argument doesn't need to be NUL-terminated.
+ */
+template <typename Reader, typename Handler>
+void parse_nul_separated_stream(
+  const parser_map& map,
+  Reader&& read,
+  Handler& handler,
+  std::size_t chunk_size);
+
+
+/**
+ * @brief
+ * Help for a set of definitions rendered by argagg::render_help(), along
+ * with the fingerprint of the definitions it was rendered from.
+ */
+struct parser_help {
+
+  /**
+   * @brief
+   * The argagg::definitions_fingerprint() of the definitions.
+   */
+  std::uint64_t fingerprint;
+
+  /**
+   * @brief
+   * The rendered help.
+   */
+  std::string text;
+
+};
+
+
+/**
+ * @brief
+ * Returns a hash of the names, flags, help and groups of the definitions.
+ * It's much cheaper than rendering the help and tells whether help or a
+ * search index that was built earlier is still current.
+ */
+std::uint64_t definitions_fingerprint(
+  const std::vector<definition>& definitions);
+
+
+/**
+ * @brief
+ * Renders the help of the definitions, one option per line with the help
+ * strings aligned in a column after the flags:
+ *
+ * @code
+ *     -h, --help     shows this help message
+ *     -o, --output   output filename
+ * @endcode
+ *
+ * The flags column is as wide as the widest flags (measured in one pass over
+ * the definitions) but the help column starts no later than column 30. The
+ * help of options whose flags don't fit goes on the next line. Help strings
+ * are wrapped under their column so lines stay within 76 columns, which
+ * argagg::fmt_ostream leaves as they are. Newlines in help strings are
+ * kept.
+ */
+std::string render_help(const std::vector<definition>& definitions);
+
+
+/**
+ * @brief
+ * Returns the help groups of the definitions (see argagg::definition::group)
+ * in the order they first show up. The empty group comes first if any
+ * definitions aren't in a group.
+ */
+std::vector<std::string> definition_groups(
+  const std::vector<definition>& definitions);
+
+
+/**
+ * @brief
+ * Renders the help of only the definitions in the group, under a "group:"
+ * heading unless the group is empty. Only those definitions are measured,
+ * so their help column may differ from the one in the help of all of the
+ * definitions. That help, from argagg::render_help(), lists the definitions
+ * that aren't in a group first and then each group, in the order of
+ * argagg::definition_groups(), like this.
+ */
+std::string render_help(
+  const std::vector<definition>& definitions,
+  const std::string& group);
+
+
+/**
+ * @brief
+ * Renders an index of the help groups with the number of options in each:
+ *
+ * @code
+ *     network  12 options
+ *     storage  340 options
+ * @endcode
+ */
+std::string render_help_index(const std::vector<definition>& definitions);
+
+
+/**
+ * @brief
+ * The help groups of a parser's definitions, their index and the groups
+ * that have been rendered so far, along with the fingerprint of the
+ * definitions. See argagg::parser::help_groups().
+ */
+struct parser_help_groups {
+
+  /**
+   * @brief
+   * The argagg::definitions_fingerprint() of the definitions.
+   */
+  std::uint64_t fingerprint;
+
+  /**
+   * @brief
+   * The argagg::definition_groups() of the definitions.
+   */
+  std::vector<std::string> names;
+
+  /**
+   * @brief
+   * The argagg::render_help_index() of the definitions.
+   */
+  std::shared_ptr<const parser_help> index;
+
+  /**
+   * @brief
+   * The groups rendered so far by argagg::parser::help(const std::string&)
+   * keyed by the group name.
+   */
+  std::map<std::string, std::shared_ptr<const parser_help>> rendered;
+
+};
+
+
+/**
+ * @brief
+ * A word of the definitions in an argagg::help_search_index. The lower case
+ * text of the word is at its offset in argagg::help_search_index::text.
+ */
+struct help_search_term {
+
+  /**
+   * @brief
+   * Offset of the word in the text of the index.
+   */
+  std::uint32_t offset;
+
+  /**
+   * @brief
+   * Length of the word.
+   */
+  std::uint32_t length;
+
+  /**
+   * @brief
+   * Index of the first posting of the word. Its postings end where the
+   * postings of the next term begin.
+   */
+  std::uint32_t first_posting;
+
+};
+
+
+/**
+ * @brief
+ * A definition that contains a word of an argagg::help_search_index.
+ */
+struct help_search_posting {
+
+  /**
+   * @brief
+   * Index of the definition.
+   */
+  std::uint32_t definition;
+
+  /**
+   * @brief
+   * How often the word shows up in the definition, counting each time it
+   * shows up in the name or flags as four times.
+   */
+  std::uint32_t weight;
+
+};
+
+
+/**
+ * @brief
+ * An inverted index of the words in the names, flags and help of a set of
+ * definitions, built by argagg::build_help_search_index(). The terms are
+ * sorted by their lower case text and each has a range of postings sorted
+ * by definition, all in two flat arrays, and their text is in a third. The
+ * postings refer to the definitions by index.
+ */
+struct help_search_index {
+
+  /**
+   * @brief
+   * The lower case text of all of the terms, one after another.
+   */
+  std::string text;
+
+  /**
+   * @brief
+   * The distinct words, sorted by their lower case text.
+   */
+  std::vector<help_search_term> terms;
+
+  /**
+   * @brief
+   * The postings of all of the terms, one range after another.
+   */
+  std::vector<help_search_posting> postings;
+
+};
+
+
+/**
+ * @brief
+ * A definition found by argagg::search_help().
+ */
+struct help_match {
+
+  /**
+   * @brief
+   * The definition that matched.
+   */
+  const definition* option;
+
+  /**
+   * @brief
+   * How many of the words of the query matched the definition.
+   */
+  unsigned int matched_words;
+
+  /**
+   * @brief
+   * The sum of the weights of the matched words, doubled for words that
+   * matched in full rather than as a prefix.
+   */
+  unsigned int score;
+
+};
+
+
+/**
+ * @brief
+ * Builds an inverted index of the words in the names, flags and help of the
+ * definitions. Words are runs of letters, digits and non-ASCII characters
+ * and are matched regardless of ASCII case.
+ */
+help_search_index build_help_search_index(
+  const std::vector<definition>& definitions);
+
+
+/**
+ * @brief
+ * Finds the definitions that contain words of the query, either in full or
+ * as a prefix, through an index of those definitions. Definitions that
+ * match more of the words come first, then those with a higher score and
+ * then the definitions in their order. Postings of definitions past the end
+ * of the given ones are ignored.
+ */
+std::vector<help_match> search_help(
+  const help_search_index& index,
+  const std::vector<definition>& definitions,
+  const std::string& query);
+
+
+/**
+ * @brief
+ * Renders the help of the matched definitions in the order they were ranked
+ * (see argagg::render_help()).
+ */
+std::string render_help_matches(const std::vector<help_match>& matches);
+
+
+/**
+ * @brief
+ * A list of option definitions used to inform how to parse arguments.
+ */
+struct parser {
+
+  /**
+   * @brief
+   * Vector of the option definitions which inform this parser how to parse
+   * the command line arguments.
+   */
+  std::vector<definition> definitions;
+
+  /**
+   * @brief
+   * If true then GCC style response files are expanded before parsing (see
+   * argagg::expand_response_files()). Any argument of the form "@file" is
+   * replaced by the arguments in that file. Defaults to false.
+   */
+  bool expand_response_files;
+
+  /**
+   * @brief
+   * If true then long flags may be abbreviated to any unambiguous prefix,
+   * like getopt_long() allows, so "--verb" is the same as "--verbose". A
+   * prefix shared by several options throws an
+   * argagg::ambiguous_option_error. Exact matches always win so "--in"
+   * isn't ambiguous if "--in" and "--input" are both defined. Defaults to
+   * false.
+   */
+  bool allow_abbreviations;
+
+  /**
+   * @brief
+   * The copy of the definitions made by the last call to
+   * definitions_snapshot() that the caches below are checked against.
+   */
+  mutable atomic_shared_ptr<const std::vector<definition>>
+    cached_definitions;
+
+  /**
+   * @brief
+   * The help rendered by the last call to help(). Access it through help()
+   * which makes sure that it's current.
+   */
+  mutable atomic_shared_ptr<const parser_cache_entry<parser_help>>
+    cached_help;
+
+  /**
+   * @brief
+   * The help groups as of the last call to help_groups(). Access them
+   * through help_groups() which makes sure that they're current.
+   */
+  mutable atomic_shared_ptr<const parser_cache_entry<parser_help_groups>>
+    cached_help_groups;
+
+  /**
+   * @brief
+   * The search index as of the last call to help_search_index(). Access it
+   * through help_search_index() which makes sure that it's current.
+   */
+  mutable atomic_shared_ptr<
+    const parser_cache_entry<argagg::help_search_index>> cached_search_index;
+
+  /**
+   * @brief
+   * The map validated by the last call to compile(). Access it through
+   * compile() which makes sure that it's current.
+   */
+  mutable atomic_shared_ptr<const parser_cache_entry<parser_map>> cached_map;
+
+  /**
+   * @brief
+   * Constructs a parser without any definitions.
+   */
+  parser();
+
+  /**
+   * @brief
+   * Constructs a parser with the given definitions. This is what allows a
+   * parser to be brace initialized with its definitions:
+   *
+   * @code
+   * argagg::parser argparser {{
+   *     { "help", {"-h", "--help"}, "shows this help message", 0},
+   *   }};
+   * @endcode
+   */
+  parser(std::vector<definition> definitions);
+
+  /**
+   * @brief
+   * Parses the provided command line arguments and returns the results as
+   * @ref parser_results.
+   *
+   * @note
+   * This method is not thread-safe and assumes that no modifications are made
+   * to the definitions member field during the extent of this method call.
+   */
+  parser_results parse(int argc, const char** argv) const;
+
+  /**
+   * @brief
+   * Through strict interpretation of pointer casting rules, despite this being
+   * a safe operation, C++ doesn't allow implicit casts from <tt>char**</tt> to
+   * <tt>const char**</tt> so here's an overload that performs a const_cast,
+   * which is typically frowned upon but is safe here.
+   */
+  parser_results parse(int argc, char** argv) const;
+
+  /**
+   * @brief
+   * Parses the arguments in the range [first, last) of forward iterators
+   * where the first argument is the program name. The arguments may be
+   * anything argagg::arg_data() accepts, such as std::string,
+   * std::string_view or std::pair<const char*, std::size_t>, and their
+   * lengths are used as is.
+   *
+   * The results point into C-strings, std::string and argagg::arg_view
+   * arguments so they must outlive the results. Other arguments, which
+   * aren't necessarily NUL-terminated, are copied into a single buffer that
+   * the results keep alive (see argagg::arg_is_nul_terminated).
+   */
+  template <typename Iterator>
+  parser_results parse(Iterator first, Iterator last) const;
+
+  /**
+   * @brief
+   * Parses the arguments of a command line string split by
+   * argagg::split_command_line(). The first argument is the program name.
+   * The arguments are parsed in place and the results keep the command
+   * line's buffer alive.
+   */
+  parser_results parse(const command_line& command) const;
+
+  /**
+   * @brief
+   * Parses a buffer of len bytes holding NUL-terminated arguments laid out
+   * back to back, such as the contents of /proc/<pid>/cmdline, in place.
+   * The first argument is the program name. The results point into the
+   * buffer so it must outlive them. If the last argument isn't
+   * NUL-terminated, as happens when a process rewrites its command line,
+   * then the buffer is copied and the results keep the copy alive instead.
+   *
+   * Like the other parse methods this only validates the definitions again
+   * once they change (see compile()), so parsing many command lines with the
+   * same definitions builds the sorted long flags and environment variables
+   * of the map once.
+   */
+  parser_results parse(const char* buffer, std::size_t len) const;
+
+  /**
+   * @brief
+   * Merges the config file at path into the results through the map of
+   * compile(), which makes the config keys the first time a config file is
+   * merged. See argagg::merge_config_file().
+   */
+  std::shared_ptr<config_file> merge_config_file(
+    const char* path,
+    parser_results& results) const;
+
+  /**
+   * @brief
+   * Parses NUL-separated arguments read from the stream, handing options
+   * and positional arguments to the handler as they're parsed instead of
+   * collecting them. See argagg::parse_nul_separated_stream(). A stream
+   * that goes bad is thrown as std::system_error rather than taken for the
+   * end of the arguments.
+   */
+  template <typename Handler>
+  void parse_stream(
+    std::istream& in,
+    Handler& handler,
+    std::size_t chunk_size = 65536) const;
+
+#ifdef ARGAGG_HAS_POSIX_IO
+  /**
+   * @brief
+   * Parses NUL-separated arguments read from the file descriptor, handing
+   * options and positional arguments to the handler as they're parsed
+   * instead of collecting them. See argagg::parse_nul_separated_stream().
+   * Read errors are thrown as std::system_error.
+   */
+  template <typename Handler>
+  void parse_stream(
+    int fd,
+    Handler& handler,
+    std::size_t chunk_size = 65536) const;
+#endif
+
+  /**
+   * @brief
+   * Returns a copy of the definitions which is only made again once they
+   * differ from it, however they were changed. Caches are checked against
+   * it by comparing pointers. Comparing the definitions to the copy costs
+   * less than half of what hashing them with
+   * argagg::definitions_fingerprint() does.
+   */
+  std::shared_ptr<const std::vector<definition>> definitions_snapshot() const;
+
+  /**
+   * @brief
+   * Validates the definitions (see argagg::validate_definitions()) into a
+   * map that parses with the settings of this parser. The map is kept until
+   * the definitions or settings change (see definitions_snapshot()), along
+   * with the flag suggestion tree it builds when a flag is unknown. It
+   * points into the copy of the definitions which the returned pointer
+   * keeps alive.
+   */
+  std::shared_ptr<const parser_map> compile() const;
+
+  /**
+   * @brief
+   * Returns the help of the definitions (see argagg::render_help()). It's
+   * rendered once and kept until the definitions change (see
+   * definitions_snapshot()), so printing it again costs a comparison of the
+   * definitions and a single write. Calling this from several threads at
+   * once is safe as long as nobody modifies the definitions meanwhile.
+   */
+  std::shared_ptr<const parser_help> help() const;
+
+  /**
+   * @brief
+   * Returns the help of only the definitions in the group (see
+   * argagg::render_help(const std::vector<definition>&, const std::string&))
+   * or nullptr if there are no definitions in the group. Each group is
+   * rendered the first time it's asked for and cached like help() is, so
+   * showing one group of a large parser doesn't render the others.
+   */
+  std::shared_ptr<const parser_help> help(const std::string& group) const;
+
+  /**
+   * @brief
+   * Returns the index of the help groups (see argagg::render_help_index()).
+   */
+  std::shared_ptr<const parser_help> help_index() const;
+
+  /**
+   * @brief
+   * Returns the help groups of the definitions, their index and the groups
+   * rendered so far. The groups are found again whenever the definitions
+   * change like help()'s.
+   */
+  std::shared_ptr<const parser_help_groups> help_groups() const;
+
+  /**
+   * @brief
+   * Returns the definitions that match the query, best first (see
+   * argagg::search_help()). The index is built the first time the help is
+   * searched and cached like help() is, so each query only costs a binary
+   * search per word.
+   */
+  std::vector<help_match> search_help(const std::string& query) const;
+
+  /**
+   * @brief
+   * Returns the search index of the definitions, building it if the
+   * definitions changed since it was last built.
+   */
+  std::shared_ptr<const argagg::help_search_index> help_search_index() const;
+
+  /**
+   * @brief
+   * Completes the last of the arguments, which is the word being typed
+   * (possibly empty). The first argument is the program name. The arguments
+   * in between are fed to a argagg::parse_state, ignoring errors since a
+   * command line that's still being typed is often invalid.
+   */
+  completion complete(int argc, const char** argv) const;
+
+  /**
+   * @brief
+   * See argagg::parser::parse(int, char**).
+   */
+  completion complete(int argc, char** argv) const;
+
+private:
+
+  /**
+   * @brief
+   * Implements parse(first, last) for arguments that are NUL-terminated,
+   * which are parsed in place.
+   */
+  template <typename Iterator>
+  parser_results parse(Iterator first, Iterator last, std::true_type) const;
+
+  /**
+   * @brief
+   * Implements parse(first, last) for arguments that might not be
+   * NUL-terminated, which are copied into a single buffer first.
+   */
+  template <typename Iterator>
+  parser_results parse(Iterator first, Iterator last, std::false_type) const;
+
+};
+
+
+struct command_results;
+
+
+/**
+ * @brief
+ * The definitions of a argagg::command and all of its ancestors, validated
+ * into a parser map. The map points into the definitions.
+ */
+struct compiled_command {
+
+  /**
+   * @brief
+   * The command's own definitions followed by its ancestors', innermost
+   * first. Flags and environment variables of the command shadow those of
+   * its ancestors, so the ancestors' definitions are left without them and
+   * dropped if that leaves them without flags.
+   */
+  std::vector<definition> definitions;
+
+  /**
+   * @brief
+   * For each of the definitions, the depth of the command it belongs to,
+   * which is its index in argagg::command_results::path.
+   */
+  std::vector<std::size_t> depths;
+
+  /**
+   * @brief
+   * The map of the definitions.
+   */
+  parser_map map;
+
+};
+
+
+/**
+ * @brief
+ * A node in a tree of git style subcommands. Each command has its own option
+ * definitions and a dispatch table from subcommand names to child commands.
+ * The first positional argument of a command that has subcommands names the
+ * subcommand to continue parsing with. Options of a command are global to
+ * its subcommands, so they're recognized after the subcommand's name too,
+ * unless the subcommand has flags of its own that are the same. So each
+ * subcommand can have its own -h and --help for instance.
+ *
+ * @code
+ * argagg::command git {{
+ *     {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+ *   }};
+ * git.add("commit", {
+ *     {"message", {"-m", "--message"}, "commit message", 1},
+ *   });
+ * argagg::command_results args = git.parse(argc, argv);
+ * if (args.selected == &git.subcommand("commit")) { ... }
+ * @endcode
+ *
+ * A command's definitions are only validated (together with those of its
+ * ancestors) the first time parsing reaches it, and then they're kept. So
+ * with many subcommands only the selected ones are ever validated, and only
+ * once. The definitions must not be changed after that. Like
+ * argagg::parser::parse() this is not thread-safe.
+ */
+struct command {
+
+  /**
+   * @brief
+   * Definitions of the options of this command.
+   */
+  std::vector<definition> definitions;
+
+  /**
+   * @brief
+   * Maps from the name of a subcommand to the subcommand.
+   */
+  std::map<std::string, std::shared_ptr<command>> subcommands;
+
+  /**
+   * @brief
+   * The parent of this command or nullptr for the root.
+   */
+  const command* parent;
+
+  /**
+   * @brief
+   * The validated definitions of this command and its ancestors, made on
+   * first use by compile().
+   */
+  mutable std::shared_ptr<const compiled_command> compiled;
+
+  /**
+   * @brief
+   * Constructs a command without any definitions.
+   */
+  command();
+
+  /**
+   * @brief
+   * Constructs a command with the given definitions.
+   */
+  command(std::vector<definition> definitions);
+
+  command(const command&) = delete;
+  command& operator = (const command&) = delete;
+
+  /**
+   * @brief
+   * Adds a subcommand with the given name and definitions and returns it so
+   * that it can be given subcommands of its own.
+   */
+  command& add(std::string name, std::vector<definition> definitions);
+
+  /**
+   * @brief
+   * Gets the subcommand with the given name. Throws an
+   * argagg::unknown_subcommand if there isn't one.
+   */
+  const command& subcommand(const std::string& name) const;
+
+  /**
+   * @brief
+   * Validates the definitions of this command and its ancestors if that
+   * hasn't been done yet and returns the result.
+   */
+  const compiled_command& compile() const;
+
+  /**
+   * @brief
+   * Parses the command line arguments, dispatching to subcommands along the
+   * way in a single pass. Throws an argagg::unknown_subcommand if the first
+   * positional argument of a command with subcommands doesn't name one.
+   */
+  command_results parse(int argc, const char** argv) const;
+
+  /**
+   * @brief
+   * See argagg::parser::parse(int, char**).
+   */
+  command_results parse(int argc, char** argv) const;
+
+  /**
+   * @brief
+   * Like argagg::parser::complete() but dispatches to subcommands along the
+   * way, which only compiles the commands on the path. Subcommand names are
+   * the candidates for the first positional argument of a command that has
+   * subcommands.
+   */
+  completion complete(int argc, const char** argv) const;
+
+  /**
+   * @brief
+   * See argagg::parser::parse(int, char**).
+   */
+  completion complete(int argc, char** argv) const;
+
+};
+
+
+/**
+ * @brief
+ * The results of parsing with a argagg::command.
+ */
+struct command_results {
+
+  /**
+   * @brief
+   * The commands that were dispatched to, starting with the root command.
+   */
+  std::vector<const command*> path;
+
+  /**
+   * @brief
+   * The names of the subcommands as they appeared in the arguments.
+   */
+  std::vector<const char*> names;
+
+  /**
+   * @brief
+   * The command that was selected last, which is the one to run.
+   */
+  const command* selected;
+
+  /**
+   * @brief
+   * The options of all of the commands along the path and all of the
+   * positional arguments. An option of a command hides the options of its
+   * ancestors that have the same name, like its flags do.
+   */
+  parser_results results;
+
+  /**
+   * @brief
+   * The results of each command along the path, in the same order: the
+   * options of the command's own definitions and the positional arguments
+   * that were parsed while it was selected.
+   */
+  std::vector<parser_results> scopes;
+
+};
+
+
+/**
+ * @brief
+ * Writes a bash completion script for the program that completes the flags
+ * of the parser's definitions. The flags are embedded in the script so
+ * pressing TAB doesn't run the program. Arguments of options are completed
+ * as file names. Load it with "source" or install it into
+ * bash-completion's completions directory.
+ */
+void write_bash_completion(
+  std::ostream& out,
+  const std::string& program,
+  const parser& argparser);
+
+/**
+ * @brief
+ * Writes a bash completion script for the program that completes the flags
+ * and subcommand names of the command tree. Each command's flags, including
+ * those of its ancestors, are embedded in the script. Subcommand names must
+ * be plain shell words.
+ */
+void write_bash_completion(
+  std::ostream& out,
+  const std::string& program,
+  const command& cmd);
+
+/**
+ * @brief
+ * Writes a zsh completion script for the program, like
+ * argagg::write_bash_completion(). Save it as "_program" in a directory on
+ * $fpath or source it after compinit.
+ */
+void write_zsh_completion(
+  std::ostream& out,
+  const std::string& program,
+  const parser& argparser);
+
+/**
+ * @brief
+ * Writes a zsh completion script for the program that completes the flags
+ * and subcommand names of the command tree.
+ */
+void write_zsh_completion(
+  std::ostream& out,
+  const std::string& program,
+  const command& cmd);
+
+
+/**
+ * @brief
+ * What a man page or markdown page says about a program besides its options.
+ * The synopsis follows the program name and the description may have blank
+ * lines between paragraphs.
+ */
+struct documentation {
+
+  /**
+   * @brief
+   * Name of the program.
+   */
+  std::string name;
+
+  /**
+   * @brief
+   * Manual section, usually "1" for user commands.
+   */
+  std::string section;
+
+  /**
+   * @brief
+   * One line summary of what the program does.
+   */
+  std::string summary;
+
+  /**
+   * @brief
+   * The arguments after the program name, like "[options] FILE...".
+   */
+  std::string synopsis;
+
+  /**
+   * @brief
+   * Longer description of the program.
+   */
+  std::string description;
+
+};
+
+
+/**
+ * @brief
+ * Writes a roff man page of the program with an OPTIONS section listing the
+ * flags and help of the parser's definitions.
+ */
+void write_man_page(
+  std::ostream& out,
+  const documentation& doc,
+  const parser& argparser);
+
+
+/**
+ * @brief
+ * Writes a markdown page of the program with the same sections as
+ * argagg::write_man_page().
+ */
+void write_markdown(
+  std::ostream& out,
+  const documentation& doc,
+  const parser& argparser);
+
+
+/**
+ * @brief
+ * Returns the usage line followed by the help of the parser, wrapped the way
+ * a program would print it with argagg::fmt_ostream.
+ */
+std::string render_usage_and_help(
+  const documentation& doc,
+  const parser& argparser);
+
+
+/**
+ * @brief
+ * Writes a C++ source file that defines the text as a static character
+ * array named symbol and its length as symbol_size, so a program can print
+ * pre-rendered help with a single write. Declare them in the program with:
+ *
+ * @code
+ * extern const char symbol[];
+ * extern const std::size_t symbol_size;
+ * @endcode
+ */
+void write_help_source(
+  std::ostream& out,
+  const std::string& symbol,
+  const std::string& text);
+
+
+/**
+ * @brief
+ * A main() for a documentation generator that is run at build time (see
+ * cmake/ArgaggDocs.cmake). It accepts --man, --markdown and --help-source
+ * followed by the file to write, --symbol to name the help blob and
+ * --man-section to override the section of the documentation. Errors are
+ * written to err, usually std::cerr. Returns the exit status.
+ */
+int generate_documentation(
+  int argc,
+  const char** argv,
+  const documentation& doc,
+  const parser& argparser,
+  std::ostream& err);
+
+
+/**
+ * @brief
+ * A stream buffer that wraps the text written to it line by line (like
+ * argagg::fmt_string()) and writes each wrapped line to the output stream as
+ * soon as its newline arrives. Only the last, incomplete line is held back.
+ * It's wrapped and written when the buffer is destroyed or finish() is
+ * called.
+ */
+struct fmt_streambuf : public std::streambuf {
+
+  /**
+   * @brief
+   * The output stream that wrapped lines are written to.
+   */
+  std::ostream& output;
+
+  /**
+   * @brief
+   * The width (in columns, not counting indentation) that lines are wrapped
+   * to.
+   */
+  std::size_t wrap_width;
+
+  /**
+   * @brief
+   * The text written since the last newline.
+   */
+  std::string partial_line;
+
+  /**
+   * @brief
+   * Wrapped lines waiting to be written to the output stream. It's only
+   * kept as a member so that its capacity is reused.
+   */
+  std::string wrapped;
+
+  /**
+   * @brief
+   * Construct to write to the provided output stream wrapped to the given
+   * width.
+   */
+  fmt_streambuf(std::ostream& output, std::size_t wrap_width);
+
+  /**
+   * @brief
+   * Writes the incomplete line, if any (see finish()).
+   */
+  ~fmt_streambuf();
+
+  /**
+   * @brief
+   * Wraps and writes the incomplete line, if any, ending it with a newline.
+   * Returns false if writing to the output stream failed.
+   */
+  bool finish();
+
+protected:
+
+  /**
+   * @brief
+   * Appends a single character.
+   */
+  int_type overflow(int_type c) override;
+
+  /**
+   * @brief
+   * Appends n characters, wrapping every line that they complete.
+   */
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+  /**
+   * @brief
+   * Flushes the output stream. The incomplete line is still held back
+   * because how it wraps depends on the rest of it.
+   */
+  int sync() override;
+
+private:
+
+  /**
+   * @brief
+   * Writes and clears the wrapped lines. Returns false if that failed.
+   */
+  bool write_wrapped();
+
+};
+
+
+/**
+ * @brief
+ * A convenience output stream that word wraps what is streamed to it (via
+ * argagg::fmt_streambuf) to the provided std::ostream. Complete lines are
+ * written as they arrive, so even very large reports are never held in
+ * memory, and the last line is written when the stream is destroyed.
+ *
+ * Example use:
+ *
+ * @code
+ * {
+ *   argagg::fmt_ostream f(std::cerr);
+ *   f << "Usage: " << really_long_string << '\n';
+ * } // the last line, if it wasn't ended, is written to std::cerr here
+ * @endcode
+ */
+struct fmt_ostream : public std::ostream {
+
+  /**
+   * @brief
+   * Reference to the final output stream that the formatted text is
+   * streamed to.
+   */
+  std::ostream& output;
+
+  /**
+   * @brief
+   * The stream buffer that wraps the text. Its wrap_width can be changed
+   * to wrap the following lines differently.
+   */
+  fmt_streambuf buffer;
+
+  /**
+   * @brief
+   * Construct to output to the provided output stream wrapped to 75 columns
+   * like the fmt utility.
+   */
+  fmt_ostream(std::ostream& output);
+
+  /**
+   * @brief
+   * Construct to output to the provided output stream wrapped to the given
+   * width.
+   */
+  fmt_ostream(std::ostream& output, std::size_t wrap_width);
+
+};
+
+
+/**
+ * @brief
+ * Processes the provided string using the fmt utility and returns the
+ * resulting output as a string. Lines are wrapped to 75 columns by default.
+ */
+std::string fmt_string(const std::string& s, std::size_t wrap_width = 75);
+
+
+/**
+ * @brief
+ * Returns true if the text is plain ASCII. Checks sixteen bytes at a time
+ * with SSE2 when it's available.
+ */
+bool is_ascii(const char* text, std::size_t len);
+
+
+/**
+ * @brief
+ * Returns how many terminal columns a Unicode code point takes up: zero for
+ * combining marks and other zero width characters, two for East Asian wide
+ * and fullwidth characters (including emoji) and one for everything else.
+ * The ranges are a compact table covering the common scripts rather than
+ * the full Unicode database.
+ */
+unsigned int codepoint_width(char32_t codepoint);
+
+
+/**
+ * @brief
+ * Returns how many terminal columns the UTF-8 text takes up (see
+ * argagg::codepoint_width()). ASCII text is just its length. Bytes that
+ * aren't valid UTF-8 count as one column each.
+ */
+std::size_t display_width(const char* text, std::size_t len);
+
+
+/**
+ * @brief
+ * Appends the text wrapped to lines of at most wrap_width columns (plus
+ * their indentation) to out. Each line of the text is scanned once and its
+ * words are appended straight from the text, so apart from growing out
+ * nothing is allocated. Widths are display widths of UTF-8 (see
+ * argagg::display_width()) but lines that are plain ASCII, which is checked
+ * once per line, are measured in bytes. This is the engine behind
+ * argagg::fmt_string().
+ */
+void wrap_text(
+  const char* text,
+  std::size_t len,
+  std::size_t wrap_width,
+  std::string& out);
+
+
+} // namespace argagg
+
+
+/**
+ * @brief
+ * Writes the option help to the given stream (see argagg::parser::help()).
  */
 std::ostream& operator << (std::ostream& os, const argagg::parser& x);
 
 
-// ---- end of declarations, header-only implementations follow ----
+// ---- end of declarations, header-only implementations follow ----
+
+
+namespace argagg {
+
+
+template <typename T>
+T option_result::as() const
+{
+  if (this->arg) {
+    return convert::arg<T>(this->arg);
+  } else {
+    throw option_lacks_argument_error("option has no argument");
+  }
+}
+
+
+template <typename T>
+T option_result::as(const T& t) const
+{
+  if (this->arg) {
+    try {
+      return convert::arg<T>(this->arg);
+    } catch (...) {
+      return t;
+    }
+  } else {
+    // I actually think this will never happen. To call this method you have
+    // to access a specific option_result for an option. If there's a
+    // specific option_result then the option was found. If the option
+    // requires an argument then it will definitely have an argument
+    // otherwise the parser would have complained.
+    return t;
+  }
+}
+
+
+template <typename T>
+option_result::operator T () const
+{
+  return this->as<T>();
+}
+
+
+template <> inline
+option_result::operator bool () const
+{
+  return this->arg != nullptr;
+}
+
+
+inline
+bool option_result::operator ! () const
+{
+  return !static_cast<bool>(*this);
+}
+
+
+inline
+std::size_t option_results::count() const
+{
+  return this->all.size();
+}
+
+
+inline
+option_result& option_results::operator [] (std::size_t index)
+{
+  return this->all[index];
+}
+
+
+inline
+const option_result& option_results::operator [] (std::size_t index) const
+{
+  return this->all[index];
+}
+
+
+template <typename T>
+T option_results::as() const
+{
+  if (this->all.size() == 0) {
+    throw std::out_of_range("no option arguments to convert");
+  }
+  return this->all.back().as<T>();
+}
+
+
+template <typename T>
+T option_results::as(const T& t) const
+{
+  if (this->all.size() == 0) {
+    return t;
+  }
+  return this->all.back().as<T>(t);
+}
+
+
+template <typename T>
+std::vector<T> option_results::all_as() const
+{
+  std::vector<T> v;
+  v.reserve(this->all.size());
+  for (const auto& result : this->all) {
+    v.emplace_back(result.as<T>());
+  }
+  return v;
+}
+
+
+inline
+std::vector<const char*> option_results::all_views() const
+{
+  std::vector<const char*> v;
+  v.reserve(this->all.size());
+  for (const auto& result : this->all) {
+    v.push_back(result.arg);
+  }
+  return v;
+}
+
+
+template <typename T>
+option_results::operator T () const
+{
+  return this->as<T>();
+}
+
+
+template <> inline
+option_results::operator bool () const
+{
+  return this->all.size() > 0;
+}
+
+
+inline
+bool option_results::operator ! () const
+{
+  return !static_cast<bool>(*this);
+}
+
+
+inline
+bool parser_results::has_option(const std::string& name) const
+{
+  const auto it = this->options.find(name);
+  return ( it != this->options.end()) && it->second.all.size() > 0;
+}
+
+
+inline
+option_results& parser_results::operator [] (const std::string& name)
+try {
+  return this->options.at(name);
+} catch (const std::out_of_range& e) {
+  std::ostringstream msg;
+  msg << "no option named \"" << name << "\" in parser_results";
+  throw unknown_option(msg.str());
+}
+
+
+inline
+const option_results&
+parser_results::operator [] (const std::string& name) const
+try {
+  return this->options.at(name);
+} catch (const std::out_of_range& e) {
+  std::ostringstream msg;
+  msg << "no option named \"" << name << "\" in parser_results";
+  throw unknown_option(msg.str());
+}
+
+
+inline
+std::size_t parser_results::count() const
+{
+  return this->pos.size();
+}
+
+
+inline
+const char* parser_results::operator [] (std::size_t index) const
+{
+  return this->pos[index];
+}
+
+
+template <typename T>
+T parser_results::as(std::size_t i) const
+{
+  return convert::arg<T>(this->pos[i]);
+}
+
+
+template <typename T>
+std::vector<T> parser_results::all_as() const
+{
+  std::vector<T> v;
+  v.reserve(this->pos.size());
+  std::transform(
+    this->pos.begin(), this->pos.end(), std::back_inserter(v),
+    [](const char* arg) {
+      return convert::arg<T>(arg);
+    });
+  return v;
+}
+
+
+template <typename T>
+std::vector<T> parser_results::all_as(
+  unsigned int num_threads,
+  std::size_t min_chunk_size) const
+{
+  if (num_threads == 0) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  const std::size_t num_args = this->pos.size();
+  std::size_t num_chunks = num_threads;
+  if (min_chunk_size > 0) {
+    num_chunks = std::min(num_chunks, num_args / min_chunk_size);
+  }
+
+  if (num_chunks <= 1) {
+    return this->all_as<T>();
+  }
+
+  // Each chunk is converted into its own vector so that T doesn't have to be
+  // default constructible, and so that elements of an std::vector<bool>,
+  // which share storage, are never written to concurrently. The first
+  // chunk's vector has room for all of them and the others are moved onto
+  // its end.
+  std::vector<std::vector<T>> converted(num_chunks);
+  converted[0].reserve(num_args);
+  std::vector<std::exception_ptr> errors(num_chunks);
+  auto convert_chunk = [&](std::size_t chunk) {
+    const std::size_t begin = num_args * chunk / num_chunks;
+    const std::size_t end = num_args * (chunk + 1) / num_chunks;
+    auto& v = converted[chunk];
+    try {
+      v.reserve(end - begin);
+      for (std::size_t i = begin; i < end; ++i) {
+        v.push_back(convert::arg<T>(this->pos[i]));
+      }
+    } catch (...) {
+      errors[chunk] = std::current_exception();
+    }
+  };
+
+  // The calling thread converts the first chunk itself. If we can't start
+  // as many threads as we'd like then the calling thread picks up the
+  // remaining chunks too.
+  std::vector<std::thread> threads;
+  threads.reserve(num_chunks - 1);
+  std::size_t chunk = 1;
+  try {
+    for (; chunk < num_chunks; ++chunk) {
+      threads.emplace_back(convert_chunk, chunk);
+    }
+  } catch (const std::system_error&) {
+    for (; chunk < num_chunks; ++chunk) {
+      convert_chunk(chunk);
+    }
+  }
+  convert_chunk(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Chunks are in index order and each chunk stops at its first failure so
+  // the first error found belongs to the lowest failing index.
+  for (const auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  auto& v = converted[0];
+  for (chunk = 1; chunk < num_chunks; ++chunk) {
+    v.insert(
+      v.end(),
+      std::make_move_iterator(converted[chunk].begin()),
+      std::make_move_iterator(converted[chunk].end()));
+  }
+  return std::move(v);
+}
+
+
+inline
+definition::definition()
+: name(), flags(), help(), num_args(0), env(), group()
+{
+}
+
+
+inline
+definition::definition(
+  std::string name,
+  std::vector<std::string> flags,
+  std::string help,
+  unsigned int num_args,
+  std::string env,
+  std::string group)
+: name(std::move(name)), flags(std::move(flags)), help(std::move(help)),
+  num_args(num_args), env(std::move(env)), group(std::move(group))
+{
+}
+
+
+inline
+bool definition::operator == (const definition& other) const
+{
+  return this->name == other.name && this->flags == other.flags
+    && this->help == other.help && this->num_args == other.num_args
+    && this->env == other.env && this->group == other.group;
+}
+
+
+inline
+bool definition::operator != (const definition& other) const
+{
+  return !(*this == other);
+}
+
+
+inline
+bool definition::wants_no_arguments() const
+{
+  return this->num_args == 0;
+}
+
+
+inline
+bool definition::requires_arguments() const
+{
+  return this->num_args > 0;
+}
+
+
+inline
+bool cmd_line_arg_is_option_flag(
+  const char* s)
+{
+  return cmd_line_arg_is_option_flag(s, std::strlen(s));
+}
+
+
+inline
+bool cmd_line_arg_is_option_flag(
+  const char* s,
+  std::size_t len)
+{
+  // The shortest possible flag has two characters: a hyphen and an
+  // alpha-numeric character.
+  if (len < 2) {
+    return false;
+  }
+
+  // All flags must start with a hyphen.
+  if (s[0] != '-') {
+    return false;
+  }
+
+  // Shift the name forward by a character to account for the initial hyphen.
+  // This means if s was originally "-v" then name will be "v".
+  const char* name = s + 1;
+
+  // Check if we're dealing with a long flag.
+  bool is_long = false;
+  if (s[1] == '-') {
+    is_long = true;
+
+    // Just -- is not a valid flag.
+    if (len == 2) {
+      return false;
+    }
+
+    // Shift the name forward to account for the extra hyphen. This means if s
+    // was originally "--output" then name will be "output".
+    name = s + 2;
+  }
+
+  // The first character of the flag name must be alpha-numeric. This is to
+  // prevent things like "---a" from being valid flags.
+  len -= name - s;
+  if (!std::isalnum(name[0])) {
+    return false;
+  }
+
+  // At this point in is_valid_flag_definition() we would check if the short
+  // flag has only one character. At command line specification you can group
+  // short flags together or even add an argument to a short flag without a
+  // space delimiter. Thus we don't check if this has only one character
+  // because it might not.
+
+  // If this is a long flag then we expect all characters *up to* an equal sign
+  // to be alpha-numeric or a hyphen. After the equal sign you are specify the
+  // argument to a long flag which can be basically anything.
+  if (is_long) {
+    bool encountered_equal = false;
+    return std::all_of(name, name + len, [&](const char& c) {
+        if (encountered_equal) {
+          return true;
+        } else {
+          if (c == '=') {
+            encountered_equal = true;
+            return true;
+          }
+          return std::isalnum(c) || c == '-';
+        }
+      });
+  }
+
+  // At this point we are not dealing with a long flag. We already checked that
+  // the first character is alpha-numeric so we've got the case of a single
+  // short flag covered. This might be a short flag group though and we might
+  // be tempted to check that each character of the short flag group is
+  // alpha-numeric. However, you can specify the argument for a short flag
+  // without a space delimiter (e.g. "-I/usr/local/include") so you can't tell
+  // if the rest of a short flag group is part of the argument or not unless
+  // you know what is a defined flag or not. We leave that kind of processing
+  // to the parser.
+  return true;
+}
+
+
+inline
+bool is_valid_flag_definition(
+  const char* s)
+{
+  auto len = std::strlen(s);
+
+  // The shortest possible flag has two characters: a hyphen and an
+  // alpha-numeric character.
+  if (len < 2) {
+    return false;
+  }
+
+  // All flags must start with a hyphen.
+  if (s[0] != '-') {
+    return false;
+  }
+
+  // Shift the name forward by a character to account for the initial hyphen.
+  // This means if s was originally "-v" then name will be "v".
+  const char* name = s + 1;
+
+  // Check if we're dealing with a long flag.
+  bool is_long = false;
+  if (s[1] == '-') {
+    is_long = true;
+
+    // Just -- is not a valid flag.
+    if (len == 2) {
+      return false;
+    }
+
+    // Shift the name forward to account for the extra hyphen. This means if s
+    // was originally "--output" then name will be "output".
+    name = s + 2;
+  }
+
+  // The first character of the flag name must be alpha-numeric. This is to
+  // prevent things like "---a" from being valid flags.
+  len = std::strlen(name);
+  if (!std::isalnum(name[0])) {
+    return false;
+  }
+
+  // If this is a short flag then it must only have one character.
+  if (!is_long && len > 1) {
+    return false;
+  }
+
+  // The rest of the characters must be alpha-numeric, but long flags are
+  // allowed to have hyphens too.
+  return std::all_of(name + 1, name + len, [&](const char& c) {
+      return std::isalnum(c) || (c == '-' && is_long);
+    });
+}
+
+
+inline
+bool flag_is_short(
+  const char* s)
+{
+  return s[0] == '-' && std::isalnum(s[1]);
+}
+
+
+inline
+bool parser_map::known_short_flag(
+  const char flag) const
+{
+  return this->short_map[flag] != nullptr;
+}
+
+
+inline
+const definition* parser_map::get_definition_for_short_flag(
+  const char flag) const
+{
+  return this->short_map[flag];
+}
+
+
+inline
+bool parser_map::known_long_flag(
+  const std::string& flag) const
+{
+  return this->get_definition_for_long_flag(flag.data(), flag.size())
+    != nullptr;
+}
+
+
+inline
+const definition* parser_map::get_definition_for_long_flag(
+  const std::string& flag) const
+{
+  return this->get_definition_for_long_flag(flag.data(), flag.size());
+}
+
+
+/**
+ * @brief
+ * Returns the first entry of a vector of keys and definitions sorted by key
+ * whose key isn't less than the given key, which doesn't need to be
+ * NUL-terminated. Keys that start with the given key follow it.
+ */
+inline
+std::vector<std::pair<std::string, const definition*>>::const_iterator
+lower_bound_sorted_definition(
+  const std::vector<std::pair<std::string, const definition*>>& sorted,
+  const char* key,
+  std::size_t len)
+{
+  return std::lower_bound(
+    sorted.begin(), sorted.end(), key,
+    [len](const std::pair<std::string, const definition*>& entry,
+          const char* key) {
+      return entry.first.compare(0, entry.first.size(), key, len) < 0;
+    });
+}
+
+
+/**
+ * @brief
+ * Binary searches a vector of keys and definitions sorted by key for the
+ * given key, which doesn't need to be NUL-terminated. Returns nullptr if it
+ * isn't there.
+ */
+inline
+const definition* find_sorted_definition(
+  const std::vector<std::pair<std::string, const definition*>>& sorted,
+  const char* key,
+  std::size_t len)
+{
+  const auto existing = lower_bound_sorted_definition(sorted, key, len);
+  if (existing == sorted.end()
+      || existing->first.compare(0, existing->first.size(), key, len) != 0) {
+    return nullptr;
+  }
+  return existing->second;
+}
+
+
+inline
+const definition* parser_map::get_definition_for_long_flag(
+  const char* flag,
+  std::size_t len) const
+{
+  return find_sorted_definition(this->long_flags, flag, len);
+}
+
+
+inline
+const std::pair<std::string, const definition*>*
+parser_map::find_long_flag_prefix(
+  const char* flag,
+  std::size_t len) const
+{
+  // Every flag starting with the prefix sorts at or after it and they're all
+  // next to each other, the exact match (if any) being the first.
+  const auto first = lower_bound_sorted_definition(
+    this->long_flags, flag, len);
+  auto last = first;
+  bool ambiguous = false;
+  while (last != this->long_flags.end()
+         && last->first.compare(0, len, flag, len) == 0) {
+    ambiguous = ambiguous || last->second != first->second;
+    ++last;
+  }
+  if (first == last) {
+    return nullptr;
+  }
+  if (first->first.size() == len || !ambiguous) {
+    return &*first;
+  }
+  std::ostringstream msg;
+  msg << "found ambiguous flag " << std::string(flag, len)
+      << " which could be";
+  for (auto entry = first; entry != last; ++entry) {
+    msg << (entry == first ? " " : ", ") << entry->first;
+  }
+  throw ambiguous_option_error(msg.str());
+}
+
+
+inline
+unsigned int edit_distance(
+  const char* a,
+  std::size_t a_len,
+  const char* b,
+  std::size_t b_len)
+{
+  // Only the previous row of the usual dynamic programming table is needed,
+  // and the cell diagonally up and to the left of the one being computed.
+  // Flags are short so the row is usually on the stack.
+  unsigned int small_row[64];
+  std::vector<unsigned int> large_row;
+  unsigned int* row = small_row;
+  if (b_len >= 64) {
+    large_row.resize(b_len + 1);
+    row = large_row.data();
+  }
+  for (std::size_t j = 0; j <= b_len; ++j) {
+    row[j] = static_cast<unsigned int>(j);
+  }
+  for (std::size_t i = 1; i <= a_len; ++i) {
+    unsigned int diagonal = row[0];
+    row[0] = static_cast<unsigned int>(i);
+    for (std::size_t j = 1; j <= b_len; ++j) {
+      const unsigned int above = row[j];
+      row[j] = std::min(
+        std::min(above, row[j - 1]) + 1,
+        diagonal + (a[i - 1] == b[j - 1] ? 0u : 1u));
+      diagonal = above;
+    }
+  }
+  return row[b_len];
+}
+
+
+/**
+ * @brief
+ * Sorts strings paired with their distances by distance and then by string.
+ */
+inline
+void sort_by_distance(
+  std::vector<std::pair<unsigned int, const std::string*>>& found)
+{
+  std::sort(found.begin(), found.end(),
+    [](const std::pair<unsigned int, const std::string*>& a,
+       const std::pair<unsigned int, const std::string*>& b) {
+      return a.first != b.first ? a.first < b.first : *a.second < *b.second;
+    });
+}
+
+
+inline
+void bk_tree::insert(std::string key)
+{
+  if (this->nodes.empty()) {
+    this->nodes.push_back(node {std::move(key), 0, 0, 0});
+    return;
+  }
+  std::size_t parent = 0;
+  for (;;) {
+    const auto& parent_key = this->nodes[parent].key;
+    const unsigned int distance = edit_distance(
+      parent_key.data(), parent_key.size(), key.data(), key.size());
+    if (distance == 0) {
+      return;
+    }
+    std::size_t child = this->nodes[parent].first_child;
+    while (child != 0 && this->nodes[child].distance != distance) {
+      child = this->nodes[child].next_sibling;
+    }
+    if (child == 0) {
+      const std::size_t first_child = this->nodes[parent].first_child;
+      this->nodes.push_back(node {std::move(key), distance, 0, first_child});
+      this->nodes[parent].first_child = this->nodes.size() - 1;
+      return;
+    }
+    parent = child;
+  }
+}
+
+
+inline
+std::vector<std::pair<unsigned int, const std::string*>> bk_tree::find(
+  const char* key,
+  std::size_t len,
+  unsigned int max_distance) const
+{
+  std::vector<std::pair<unsigned int, const std::string*>> found;
+  if (this->nodes.empty()) {
+    return found;
+  }
+  std::vector<std::size_t> pending {0};
+  while (!pending.empty()) {
+    const node& current = this->nodes[pending.back()];
+    pending.pop_back();
+    const unsigned int distance = edit_distance(
+      current.key.data(), current.key.size(), key, len);
+    if (distance <= max_distance) {
+      found.push_back(std::make_pair(distance, &current.key));
+    }
+    for (std::size_t child = current.first_child; child != 0;
+         child = this->nodes[child].next_sibling) {
+      const unsigned int label = this->nodes[child].distance;
+      if (label + max_distance >= distance
+          && label <= distance + max_distance) {
+        pending.push_back(child);
+      }
+    }
+  }
+  sort_by_distance(found);
+  return found;
+}
+
+
+inline
+std::vector<std::string> parser_map::suggest_flags(
+  const char* flag,
+  std::size_t len,
+  std::size_t max_suggestions) const
+{
+  std::size_t hyphens = 0;
+  while (hyphens < len && hyphens < 2 && flag[hyphens] == '-') {
+    ++hyphens;
+  }
+  const auto max_distance = static_cast<unsigned int>(
+    1 + (len - hyphens) / 4);
+
+  std::shared_ptr<const bk_tree> flag_tree = this->flag_tree.load();
+  if (flag_tree == nullptr) {
+    std::shared_ptr<bk_tree> tree = std::make_shared<bk_tree>();
+    for (int c = 0; c < 256; ++c) {
+      if (this->short_map[c] != nullptr) {
+        tree->insert({'-', static_cast<char>(c)});
+      }
+    }
+    for (const auto& entry : this->long_flags) {
+      tree->insert(entry.first);
+    }
+    flag_tree = std::move(tree);
+    this->flag_tree.store(flag_tree);
+  }
+  const auto found = flag_tree->find(flag, len, max_distance);
+
+  std::vector<std::string> suggestions;
+  for (std::size_t i = 0; i < found.size() && i < max_suggestions; ++i) {
+    suggestions.push_back(*found[i].second);
+  }
+  return suggestions;
+}
+
+
+/**
+ * @brief
+ * Returns " (did you mean ...?)" listing up to three known flags that are
+ * closest to the unknown flag, or an empty string if none are close. Short
+ * flags are left out when the unknown flag is a short flag group since
+ * every short flag is just as close to a single letter.
+ */
+inline
+std::string did_you_mean(
+  const parser_map& map,
+  const char* flag,
+  std::size_t len,
+  bool long_flags_only)
+{
+  const std::size_t all_flags = 256 + map.long_flags.size();
+  std::vector<std::string> suggestions;
+  for (auto& suggestion : map.suggest_flags(flag, len, all_flags)) {
+    if (suggestions.size() < 3
+        && !(long_flags_only && flag_is_short(suggestion.data()))) {
+      suggestions.push_back(std::move(suggestion));
+    }
+  }
+  if (suggestions.empty()) {
+    return "";
+  }
+  std::string hint = " (did you mean ";
+  for (std::size_t i = 0; i < suggestions.size(); ++i) {
+    if (i > 0) {
+      hint += (i + 1 == suggestions.size()) ? " or " : ", ";
+    }
+    hint += suggestions[i];
+  }
+  return hint + "?)";
+}
+
+
+inline
+const definition* parser_map::get_definition_for_env_var(
+  const char* name,
+  std::size_t len) const
+{
+  return find_sorted_definition(this->env_vars, name, len);
+}
+
+
+inline
+const definition* parser_map::get_definition_for_config_key(
+  const char* name,
+  std::size_t len) const
+{
+  auto keys = this->config_keys.load();
+  if (keys != nullptr) {
+    return find_sorted_definition(*keys, name, len);
+  }
+
+  // Every definition has a flag so they're all in the short map or the long
+  // flags. Sorting them by address puts them back in their order.
+  std::vector<const definition*> definitions;
+  for (const auto defn : this->short_map) {
+    if (defn != nullptr) {
+      definitions.push_back(defn);
+    }
+  }
+  for (const auto& entry : this->long_flags) {
+    definitions.push_back(entry.second);
+  }
+  std::sort(definitions.begin(), definitions.end());
+  definitions.erase(
+    std::unique(definitions.begin(), definitions.end()), definitions.end());
+
+  // Config file keys are definition names and long flags without their
+  // hyphens. Names go in first so that the stable sort keeps them ahead of
+  // any long flag of another definition that happens to look the same.
+  auto made = std::make_shared<
+    std::vector<std::pair<std::string, const definition*>>>();
+  for (const auto defn : definitions) {
+    made->push_back(std::make_pair(defn->name, defn));
+  }
+  for (const auto defn : definitions) {
+    for (const auto& flag : defn->flags) {
+      if (!flag_is_short(flag.data())) {
+        made->push_back(std::make_pair(flag.substr(2), defn));
+      }
+    }
+  }
+  std::stable_sort(
+    made->begin(), made->end(),
+    [](const std::pair<std::string, const definition*>& a,
+       const std::pair<std::string, const definition*>& b) {
+      return a.first < b.first;
+    });
+  made->erase(
+    std::unique(
+      made->begin(), made->end(),
+      [](const std::pair<std::string, const definition*>& a,
+         const std::pair<std::string, const definition*>& b) {
+        return a.first == b.first;
+      }),
+    made->end());
+  this->config_keys.store(made);
+  return find_sorted_definition(*made, name, len);
+}
+
+
+inline
+parser_map validate_definitions(
+  const std::vector<definition>& definitions)
+{
+  std::vector<std::pair<std::string, const definition*>> long_flags;
+  std::vector<std::pair<std::string, const definition*>> env_vars;
+  parser_map map {
+    {{nullptr}}, std::move(long_flags), std::move(env_vars),
+    atomic_shared_ptr<
+      const std::vector<std::pair<std::string, const definition*>>>(),
+    false, atomic_shared_ptr<const bk_tree>()};
+
+  for (auto& defn : definitions) {
+
+    if (!defn.env.empty()) {
+      if (defn.env.find('=') != std::string::npos) {
+        std::ostringstream msg;
+        msg << "environment variable \"" << defn.env
+            << "\" specified for option \"" << defn.name << "\" is invalid";
+        throw invalid_flag(msg.str());
+      }
+      map.env_vars.push_back(std::make_pair(defn.env, &defn));
+    }
+
+    if (defn.flags.size() == 0) {
+      std::ostringstream msg;
+      msg << "option \"" << defn.name << "\" has no flag definitions";
+      throw invalid_flag(msg.str());
+    }
+
+    for (auto& flag : defn.flags) {
+
+      if (!is_valid_flag_definition(flag.data())) {
+        std::ostringstream msg;
+        msg << "flag \"" << flag << "\" specified for option \"" << defn.name
+            << "\" is invalid";
+        throw invalid_flag(msg.str());
+      }
+
+      if (flag_is_short(flag.data())) {
+        const int short_flag_letter = flag[1];
+        const auto existing_short_flag = map.short_map[short_flag_letter];
+        bool short_flag_already_exists = (existing_short_flag != nullptr);
+        if (short_flag_already_exists) {
+          std::ostringstream msg;
+          msg << "duplicate short flag \"" << flag
+              << "\" found, specified by both option  \"" << defn.name
+              << "\" and option \"" << existing_short_flag->name;
+          throw invalid_flag(msg.str());
+        }
+        map.short_map[short_flag_letter] = &defn;
+        continue;
+      }
+
+      // If we're here then this is a valid, long-style flag. Duplicates are
+      // found once the flags are sorted.
+      map.long_flags.push_back(std::make_pair(flag, &defn));
+    }
+  }
+
+  // Ties are sorted by where the definitions are so the later definition
+  // comes second, just as if it had been checked against the earlier ones.
+  std::sort(map.long_flags.begin(), map.long_flags.end());
+  const auto duplicate_long_flag = std::adjacent_find(
+    map.long_flags.begin(), map.long_flags.end(),
+    [](const std::pair<std::string, const definition*>& a,
+       const std::pair<std::string, const definition*>& b) {
+      return a.first == b.first;
+    });
+  if (duplicate_long_flag != map.long_flags.end()) {
+    std::ostringstream msg;
+    msg << "duplicate long flag \"" << duplicate_long_flag->first
+        << "\" found, specified by both option  \""
+        << (duplicate_long_flag + 1)->second->name << "\" and option \""
+        << duplicate_long_flag->second->name;
+    throw invalid_flag(msg.str());
+  }
+
+  std::sort(map.env_vars.begin(), map.env_vars.end());
+  const auto duplicate_env_var = std::adjacent_find(
+    map.env_vars.begin(), map.env_vars.end(),
+    [](const std::pair<std::string, const definition*>& a,
+       const std::pair<std::string, const definition*>& b) {
+      return a.first == b.first;
+    });
+  if (duplicate_env_var != map.env_vars.end()) {
+    std::ostringstream msg;
+    msg << "duplicate environment variable \"" << duplicate_env_var->first
+        << "\" found, specified by both option \""
+        << duplicate_env_var->second->name << "\" and option \""
+        << (duplicate_env_var + 1)->second->name << "\"";
+    throw invalid_flag(msg.str());
+  }
+
+  return map;
+}
+
+
+inline
+const char* const* environment()
+{
+#if defined(_WIN32)
+  return _environ;
+#elif defined(__APPLE__)
+  return *_NSGetEnviron();
+#else
+  return environ;
+#endif
+}
+
+
+inline
+void merge_environment(
+  const parser_map& map,
+  const char* const* env,
+  parser_results& results)
+{
+  merge_environment_with(
+    map, env, [&results](const definition& defn) -> option_results& {
+      return results.options[defn.name];
+    });
+}
+
+
+template <typename ResultsFor>
+void merge_environment_with(
+  const parser_map& map,
+  const char* const* env,
+  ResultsFor&& results_for)
+{
+  if (map.env_vars.empty() || env == nullptr) {
+    return;
+  }
+  for (; *env != nullptr; ++env) {
+    const char* const entry = *env;
+    const char* const equal = std::strchr(entry, '=');
+    if (equal == nullptr) {
+      continue;
+    }
+    const auto defn = map.get_definition_for_env_var(
+      entry, static_cast<std::size_t>(equal - entry));
+    if (defn == nullptr) {
+      continue;
+    }
+
+    // Anything from the command line wins. This also means that the first
+    // of any duplicate variables wins, like with std::getenv().
+    option_results& opt_results = results_for(*defn);
+    if (opt_results.count() > 0) {
+      continue;
+    }
+
+    const char* value = equal + 1;
+    if (defn->wants_no_arguments()) {
+      if (value[0] == '\0' || std::strcmp(value, "0") == 0) {
+        continue;
+      }
+      value = nullptr;
+    }
+    option_result opt_result {value};
+    opt_results.all.push_back(std::move(opt_result));
+  }
+}
+
+
+template <typename T>
+atomic_shared_ptr<T>::atomic_shared_ptr()
+: ptr()
+{
+}
+
+
+template <typename T>
+atomic_shared_ptr<T>::atomic_shared_ptr(const atomic_shared_ptr& other)
+: ptr(other.load())
+{
+}
+
+
+template <typename T>
+atomic_shared_ptr<T>& atomic_shared_ptr<T>::operator = (
+  const atomic_shared_ptr& other)
+{
+  this->store(other.load());
+  return *this;
+}
+
+
+template <typename T>
+std::shared_ptr<T> atomic_shared_ptr<T>::load() const
+{
+#ifdef ARGAGG_HAS_ATOMIC_SHARED_PTR
+  return this->ptr.load();
+#else
+  return std::atomic_load(&this->ptr);
+#endif
+}
+
+
+template <typename T>
+void atomic_shared_ptr<T>::store(std::shared_ptr<T> ptr)
+{
+#ifdef ARGAGG_HAS_ATOMIC_SHARED_PTR
+  this->ptr.store(std::move(ptr));
+#else
+  std::atomic_store(&this->ptr, std::move(ptr));
+#endif
+}
+
+
+inline
+parser::parser()
+: definitions(), expand_response_files(false), allow_abbreviations(false),
+  cached_definitions(), cached_help(), cached_help_groups(),
+  cached_search_index(), cached_map()
+{
+}
+
+
+inline
+parser::parser(std::vector<definition> definitions)
+: definitions(std::move(definitions)), expand_response_files(false),
+  allow_abbreviations(false), cached_definitions(), cached_help(),
+  cached_help_groups(), cached_search_index(), cached_map()
+{
+}
+
+
+inline
+parse_state::parse_state(const parser_map& map)
+: map(&map), ignore_flags(false), pending_option(nullptr),
+  pending_flag(nullptr), num_option_args_to_consume(0)
+{
+}
+
+
+/**
+ * @brief
+ * Returns the flag of the definition that matches the given short flag
+ * character or long flag.
+ */
+inline
+const std::string* find_definition_flag(
+  const definition& defn,
+  const char* flag,
+  std::size_t len)
+{
+  for (const auto& defn_flag : defn.flags) {
+    if (defn_flag.compare(0, defn_flag.size(), flag, len) == 0) {
+      return &defn_flag;
+    }
+  }
+  return nullptr;
+}
+
+
+template <typename Handler>
+void parse_state::feed(
+  const char* arg,
+  std::size_t len,
+  Handler& handler)
+{
+  // Some behavior to note: if the previous option is expecting an argument
+  // then the next entry will be treated as a positional argument even if it
+  // looks like a flag.
+  bool treat_as_positional_argument = (
+      this->ignore_flags
+      || this->num_option_args_to_consume > 0
+      || !cmd_line_arg_is_option_flag(arg, len)
+    );
+  if (treat_as_positional_argument) {
+
+    // If last option is expecting some specific positive number of arguments
+    // then give this argument to that option, *regardless of whether or not
+    // the argument looks like a flag or is the special "--" argument*. The
+    // option is handed over with its last argument.
+    if (this->num_option_args_to_consume > 0) {
+      --this->num_option_args_to_consume;
+      if (this->num_option_args_to_consume == 0) {
+        const definition& defn = *this->pending_option;
+        this->pending_option = nullptr;
+        this->pending_flag = nullptr;
+        handler.option(defn, arg);
+      }
+      return;
+    }
+
+    // Now we check if this is just "--" which is a special argument that
+    // causes all following arguments to be treated as non-options and is
+    // itselve discarded.
+    if (len == 2 && std::strncmp(arg, "--", 2) == 0) {
+      this->ignore_flags = true;
+      return;
+    }
+
+    // If there are no expectations for option arguments then simply use this
+    // argument as a positional argument.
+    handler.positional(arg);
+    return;
+  }
+
+  // If we're at this point then we're definitely dealing with something that
+  // is flag-like and has hyphen as the first character and has a length of
+  // at least two characters. How we handle this potential flag depends on
+  // whether or not it is a long-option so we check that first.
+  bool is_long_flag = (arg[1] == '-');
+
+  if (is_long_flag) {
+
+    // Long flags have a complication: their arguments can be specified using
+    // an '=' character right inside the argument. That means an argument
+    // like "--output=foobar.txt" is actually an option with flag "--output"
+    // and argument "foobar.txt". So we look for the first instance of the
+    // '=' character and keep it in long_flag_arg. If long_flag_arg is
+    // nullptr then we didn't find '='. We need the flag_len to look up the
+    // flag below.
+    auto long_flag_arg = static_cast<const char*>(std::memchr(arg, '=', len));
+    std::size_t flag_len = len;
+    if (long_flag_arg != nullptr) {
+      flag_len = long_flag_arg - arg;
+    }
+
+    // The flag is looked up in place so that feeding arguments never
+    // allocates unless something goes wrong. Abbreviations are only looked
+    // for when there's no exact match so that the common case is a single
+    // lookup. From then on the flag is the full flag it abbreviates.
+    const char* flag = arg;
+    auto defn = this->map->get_definition_for_long_flag(flag, flag_len);
+    if (defn == nullptr && this->map->allow_abbreviations) {
+      const auto entry = this->map->find_long_flag_prefix(arg, flag_len);
+      if (entry != nullptr) {
+        defn = entry->second;
+        flag = entry->first.data();
+        flag_len = entry->first.size();
+      }
+    }
+    if (defn == nullptr) {
+      std::ostringstream msg;
+      msg << "found unexpected flag: " << std::string(arg, flag_len)
+          << did_you_mean(*this->map, arg, flag_len, false);
+      throw unexpected_option_error(msg.str());
+    }
+
+    if (long_flag_arg != nullptr && defn->num_args == 0) {
+      std::ostringstream msg;
+      msg << "found argument for option not expecting an argument: " << arg;
+      throw unexpected_argument_error(msg.str());
+    }
+
+    // We've got a legitimate, known long flag option. If it needs arguments
+    // and they weren't given using the '=' syntax then we wait for them.
+    if (defn->requires_arguments()) {
+      bool there_is_an_equal_delimited_arg = (long_flag_arg != nullptr);
+      if (there_is_an_equal_delimited_arg) {
+        // long_flag_arg would be "=foo" in the "--output=foo" case so we
+        // increment by 1 to get rid of the equal sign.
+        handler.option(*defn, long_flag_arg + 1);
+      } else {
+        this->pending_option = defn;
+        this->pending_flag = find_definition_flag(*defn, flag, flag_len);
+        this->num_option_args_to_consume = defn->num_args;
+      }
+      return;
+    }
+
+    handler.option(*defn, nullptr);
+    return;
+  }
+
+  // If we've made it here then we're looking at either a short flag or a
+  // group of short flags. Short flags can be grouped together so long as they
+  // don't require any arguments unless the option that does is the last in
+  // the group ("-o x -v" is okay, "-vo x" is okay, "-ov x" is not). So
+  // starting after the dash we're going to process each character as if it
+  // were a separate flag. Note "sf_idx" stands for "short flag index".
+  for (std::size_t sf_idx = 1; sf_idx < len; ++sf_idx) {
+    const auto short_flag = arg[sf_idx];
+
+    if (!std::isalnum(short_flag)) {
+      std::ostringstream msg;
+      msg << "found non-alphanumeric character '" << arg[sf_idx]
+          << "' in flag group '" << arg << "'";
+      throw std::domain_error(msg.str());
+    }
+
+    if (!this->map->known_short_flag(short_flag)) {
+      std::ostringstream msg;
+      msg << "found unexpected flag '" << arg[sf_idx]
+          << "' in flag group '" << arg << "'"
+          << did_you_mean(*this->map, arg, len, true);
+      throw unexpected_option_error(msg.str());
+    }
+
+    auto defn = this->map->get_definition_for_short_flag(short_flag);
+
+    if (defn->requires_arguments()) {
+
+      // If this short flag's option requires an argument and we're the last
+      // flag in the short flag group then just put the parser into "expecting
+      // argument for last option" state and move onto the next command line
+      // argument.
+      bool is_last_short_flag_in_group = (sf_idx == len - 1);
+      if (is_last_short_flag_in_group) {
+        const char flag[2] = {'-', short_flag};
+        this->pending_option = defn;
+        this->pending_flag = find_definition_flag(*defn, flag, 2);
+        this->num_option_args_to_consume = defn->num_args;
+        break;
+      }
+
+      // If this short flag's option requires an argument and we're NOT the
+      // last flag in the short flag group then we automatically consume the
+      // rest of the short flag group as the argument for this flag. This is
+      // how we get the POSIX behavior of being able to specify a flag's
+      // arguments without a white space delimiter (e.g.
+      // "-I/usr/local/include").
+      handler.option(*defn, arg + sf_idx + 1);
+      break;
+    }
+
+    handler.option(*defn, nullptr);
+  }
+}
+
+
+template <typename Handler>
+void parse_state::feed(
+  const char* arg,
+  Handler& handler)
+{
+  this->feed(arg, std::strlen(arg), handler);
+}
+
+
+inline
+bool parse_state::expects_option_argument() const
+{
+  return this->num_option_args_to_consume > 0;
+}
+
+
+inline
+void parse_state::finish() const
+{
+  // If we're done with all of the arguments but are still expecting
+  // arguments for a previous option then we haven't satisfied that option.
+  // This is an error.
+  if (this->num_option_args_to_consume > 0) {
+    std::ostringstream msg;
+    msg << "last option \"" << *this->pending_flag
+        << "\" expects an argument but the parser ran out of command line "
+        << "arguments to parse";
+    throw option_lacks_argument_error(msg.str());
+  }
+}
+
+
+inline
+completion complete_argument(const parse_state& state, const char* word)
+{
+  completion result {{}, nullptr};
+  if (state.expects_option_argument()) {
+    result.option = state.pending_option;
+    return result;
+  }
+  const std::size_t len = std::strlen(word);
+  if (state.ignore_flags || len == 0 || word[0] != '-') {
+    return result;
+  }
+
+  // Whatever follows the '=' of a long flag is its argument.
+  const auto equals = static_cast<const char*>(std::memchr(word, '=', len));
+  if (equals != nullptr) {
+    if (word[1] == '-') {
+      const std::size_t flag_len = static_cast<std::size_t>(equals - word);
+      result.option = state.map->get_definition_for_long_flag(word, flag_len);
+      if (result.option == nullptr && state.map->allow_abbreviations) {
+        try {
+          const auto entry = state.map->find_long_flag_prefix(word, flag_len);
+          result.option = (entry != nullptr) ? entry->second : nullptr;
+        } catch (const ambiguous_option_error&) {
+        }
+      }
+    }
+    return result;
+  }
+
+  if (len == 1 || (len == 2 && word[1] != '-')) {
+    for (int c = 0; c < 256; ++c) {
+      if (state.map->short_map[c] != nullptr
+          && (len == 1 || static_cast<unsigned char>(word[1]) == c)) {
+        result.candidates.push_back({'-', static_cast<char>(c)});
+      }
+    }
+  }
+  if (len == 1 || word[1] == '-') {
+    const auto& long_flags = state.map->long_flags;
+    for (auto entry = lower_bound_sorted_definition(long_flags, word, len);
+         entry != long_flags.end()
+         && entry->first.compare(0, len, word, len) == 0;
+         ++entry) {
+      result.candidates.push_back(entry->first);
+    }
+  }
+  std::sort(result.candidates.begin(), result.candidates.end());
+  return result;
+}
+
+
+inline
+void parser_results_handler::option(
+  const definition& defn,
+  const char* arg)
+{
+  option_result opt_result {arg};
+  this->results.options[defn.name].all.push_back(std::move(opt_result));
+}
+
+
+inline
+void parser_results_handler::positional(
+  const char* arg)
+{
+  this->results.pos.push_back(arg);
+}
+
+
+template <typename ArgIterator>
+parser_results parse_arguments(
+  const std::vector<definition>& definitions,
+  const parser_map& map,
+  ArgIterator arg_i,
+  ArgIterator arg_end,
+  std::vector<std::shared_ptr<void>> buffers)
+{
+  // Initialize the parser results that we'll be returning. Store the program
+  // name (assumed to be the first command line argument) and initialize
+  // everything else as empty.
+  const char* program = nullptr;
+  if (arg_i != arg_end) {
+    program = arg_data(*arg_i);
+    ++arg_i;
+  }
+  std::unordered_map<std::string, option_results> options {};
+  std::vector<const char*> pos;
+  parser_results results {
+    program, std::move(options), std::move(pos), std::move(buffers)};
+
+  // Add an empty option result for each definition.
+  for (const auto& defn : definitions) {
+    option_results opt_results {{}};
+    results.options.insert(
+      std::make_pair(defn.name, opt_results));
+  }
+
+  parse_state state(map);
+  parser_results_handler handler {results};
+  for (; arg_i != arg_end; ++arg_i) {
+    state.feed(arg_data(*arg_i), arg_length(*arg_i), handler);
+  }
+  state.finish();
+
+  return results;
+}
+
+
+template <typename Reader, typename Handler>
+void parse_nul_separated_stream(
+  const parser_map& map,
+  Reader&& read,
+  Handler& handler,
+  std::size_t chunk_size)
+{
+  parse_state state(map);
+
+  // The buffer holds the start of an argument carried over from the last
+  // chunk followed by the next chunk, plus a byte to terminate the last
+  // argument. It only grows if a single argument doesn't fit.
+  chunk_size = std::max<std::size_t>(chunk_size, 1);
+  std::vector<char> buffer(chunk_size + 1);
+  std::size_t carried = 0;
+  for (;;) {
+    if (buffer.size() - 1 - carried < chunk_size) {
+      buffer.resize(carried + chunk_size + 1);
+    }
+    const std::size_t num_read = read(buffer.data() + carried, chunk_size);
+    if (num_read == 0) {
+      break;
+    }
+
+    // Only the new bytes need to be searched for terminators since the
+    // carried bytes don't have any.
+    const char* arg = buffer.data();
+    const char* const end = buffer.data() + carried + num_read;
+    const char* search = buffer.data() + carried;
+    for (;;) {
+      const auto nul = static_cast<const char*>(
+        std::memchr(search, '\0', static_cast<std::size_t>(end - search)));
+      if (nul == nullptr) {
+        break;
+      }
+      state.feed(arg, static_cast<std::size_t>(nul - arg), handler);
+      arg = nul + 1;
+      search = arg;
+    }
+    carried = static_cast<std::size_t>(end - arg);
+    if (carried > 0 && arg != buffer.data()) {
+      std::memmove(buffer.data(), arg, carried);
+    }
+  }
+
+  if (carried > 0) {
+    buffer[carried] = '\0';
+    state.feed(buffer.data(), carried, handler);
+  }
+  state.finish();
+}
+
+
+template <typename Iterator>
+parser_results parser::parse(Iterator first, Iterator last) const
+{
+  using value_type = typename std::decay<
+    typename std::iterator_traits<Iterator>::value_type>::type;
+  return this->parse(first, last, arg_is_nul_terminated<value_type>());
+}
+
+
+template <typename Iterator>
+parser_results parser::parse(
+  Iterator first,
+  Iterator last,
+  std::false_type) const
+{
+  // Copy the arguments back to back into a single buffer, terminating each
+  // one, and parse the copies in place.
+  std::size_t size = 0;
+  for (auto arg = first; arg != last; ++arg) {
+    size += arg_length(*arg) + 1;
+  }
+  std::shared_ptr<char> packed(
+    new char[size + 1], std::default_delete<char[]>());
+  char* out = packed.get();
+  for (auto arg = first; arg != last; ++arg) {
+    const std::size_t len = arg_length(*arg);
+    std::memcpy(out, arg_data(*arg), len);
+    out[len] = '\0';
+    out += len + 1;
+  }
+  auto results = this->parse(
+    packed_arg_iterator<Iterator> {first, packed.get()},
+    packed_arg_iterator<Iterator> {last, out},
+    std::true_type());
+  results.buffers.push_back(packed);
+  return results;
+}
+
+
+template <typename Iterator>
+parser_results parser::parse(
+  Iterator first,
+  Iterator last,
+  std::true_type) const
+{
+  // Inspect each definition to see if its valid. You may wonder "why don't
+  // you do this validation on construction?" I had thought about it but
+  // realized that since the parser exposes the definitions vector directly
+  // (it started out as an aggregate of just that vector) I would need to
+  // track any changes to the definitions vector and re-run the validity
+  // check in order to maintain this expected "validity invariant" on the
+  // object. That would then require hiding the definitions vector as a
+  // private entry and then turning the parser into a thin interface (by
+  // re-exposing setters and getters) to the vector methods just so that I
+  // can catch when the definition has been modified. It seems much simpler
+  // to just enforce the validity when you actually want to parse because
+  // it's at the moment of parsing that you know the definitions are
+  // complete. compile() only validates them again once they differ from the
+  // copy it validated last time.
+  const auto map = this->compile();
+
+  // If response files are enabled then we simply parse the expanded
+  // arguments instead. They point into the response files which the results
+  // keep alive.
+  std::vector<std::shared_ptr<void>> buffers;
+  if (this->expand_response_files) {
+    std::vector<const char*> args;
+    for (auto arg = first; arg != last; ++arg) {
+      args.push_back(arg_data(*arg));
+    }
+    const auto expanded_args = argagg::expand_response_files(
+      static_cast<int>(args.size()), args.data(), buffers);
+    auto results = parse_arguments(
+      this->definitions, *map, expanded_args.begin(), expanded_args.end(),
+      std::move(buffers));
+    merge_environment(*map, environment(), results);
+    return results;
+  }
+
+  auto results = parse_arguments(
+    this->definitions, *map, first, last, std::move(buffers));
+  merge_environment(*map, environment(), results);
+  return results;
+}
+
+
+inline
+parser_results parser::parse(int argc, const char** argv) const
+{
+  return parse(argv, argv + argc);
+}
+
+
+inline
+parser_results parser::parse(int argc, char** argv) const
+{
+  return parse(argc, const_cast<const char**>(argv));
+}
+
+
+inline
+parser_results parser::parse(const command_line& command) const
+{
+  auto results = parse(command.begin(), command.end());
+  results.buffers.push_back(command.data);
+  return results;
+}
+
+
+inline
+parser_results parser::parse(const char* buffer, std::size_t len) const
+{
+  if (len == 0 || buffer[len - 1] == '\0') {
+    return parse(
+      nul_separated_iterator(buffer, buffer + len),
+      nul_separated_iterator(buffer + len, buffer + len));
+  }
+  std::shared_ptr<char> copy(new char[len + 1], std::default_delete<char[]>());
+  std::memcpy(copy.get(), buffer, len);
+  copy.get()[len] = '\0';
+  auto results = parse(copy.get(), len + 1);
+  results.buffers.push_back(copy);
+  return results;
+}
+
+
+template <typename Handler>
+void parser::parse_stream(
+  std::istream& in,
+  Handler& handler,
+  std::size_t chunk_size) const
+{
+  const auto map = this->compile();
+  parse_nul_separated_stream(
+    *map,
+    [&in](char* buffer, std::size_t size) {
+      in.read(buffer, static_cast<std::streamsize>(size));
+      if (in.bad()) {
+        throw std::system_error(
+          std::make_error_code(std::io_errc::stream),
+          "unable to read arguments");
+      }
+      return static_cast<std::size_t>(in.gcount());
+    },
+    handler, chunk_size);
+}
+
+
+#ifdef ARGAGG_HAS_POSIX_IO
+template <typename Handler>
+void parser::parse_stream(
+  int fd,
+  Handler& handler,
+  std::size_t chunk_size) const
+{
+  const auto map = this->compile();
+  parse_nul_separated_stream(
+    *map,
+    [fd](char* buffer, std::size_t size) {
+      for (;;) {
+        const ::ssize_t num_read = ::read(fd, buffer, size);
+        if (num_read >= 0) {
+          return static_cast<std::size_t>(num_read);
+        }
+        if (errno != EINTR) {
+          throw std::system_error(
+            errno, std::generic_category(), "unable to read arguments");
+        }
+      }
+    },
+    handler, chunk_size);
+}
+#endif
+
+
+inline
+std::shared_ptr<config_file> parser::merge_config_file(
+  const char* path,
+  parser_results& results) const
+{
+  return argagg::merge_config_file(*this->compile(), path, results);
+}
+
+
+inline
+completion parser::complete(int argc, const char** argv) const
+{
+  const auto map = this->compile();
+  parse_state state(*map);
+  discarding_handler handler;
+  for (int i = 1; i < argc - 1; ++i) {
+    try {
+      state.feed(argv[i], handler);
+    } catch (const std::exception&) {
+    }
+  }
+  return complete_argument(state, (argc > 1) ? argv[argc - 1] : "");
+}
+
+
+inline
+completion parser::complete(int argc, char** argv) const
+{
+  return complete(argc, const_cast<const char**>(argv));
+}
+
+
+inline
+response_file::response_file()
+: data(nullptr), size(0)
+{
+}
+
+
+inline
+response_file::~response_file()
+{
+  delete[] this->data;
+}
+
+
+inline
+std::shared_ptr<response_file> open_response_file(
+  const char* path,
+  std::string& identity)
+{
+  auto file = std::make_shared<response_file>();
+
+#ifdef ARGAGG_HAS_POSIX_IO
+  const int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return nullptr;
+  }
+  std::ostringstream id;
+  id << st.st_dev << ':' << st.st_ino;
+  identity = id.str();
+  file->size = static_cast<std::size_t>(st.st_size);
+
+  file->data = new char[file->size + 1];
+  std::size_t total = 0;
+  while (total < file->size) {
+    const auto n = ::read(fd, file->data + total, file->size - total);
+    if (n <= 0) {
+      break;
+    }
+    total += static_cast<std::size_t>(n);
+  }
+  ::close(fd);
+  file->size = total;
+  file->data[total] = '\0';
+  return file;
+#else
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    return nullptr;
+  }
+  // Without POSIX file identities the absolute path stands in for one so
+  // that "a" and "./a" are the same file.
+#ifdef _WIN32
+  char full_path[_MAX_PATH];
+  identity = ::_fullpath(full_path, path, _MAX_PATH) != nullptr
+    ? full_path : path;
+#else
+  identity = path;
+#endif
+  file->size = static_cast<std::size_t>(in.tellg());
+  in.seekg(0);
+  file->data = new char[file->size + 1];
+  in.read(file->data, file->size);
+  file->size = static_cast<std::size_t>(in.gcount());
+  file->data[file->size] = '\0';
+  return file;
+#endif
+}
+
+
+inline
+void tokenize_response_file(
+  char* data,
+  std::size_t size,
+  std::vector<const char*>& args)
+{
+  // Arguments only ever shrink when quotes and backslashes are removed so
+  // they are unescaped in place by writing behind where we're reading.
+  const char* in = data;
+  const char* const end = data + size;
+  char* out = data;
+  while (in != end) {
+    if (std::isspace(static_cast<unsigned char>(*in))) {
+      ++in;
+      continue;
+    }
+
+    char* const arg = out;
+    char quote = '\0';
+    while (in != end) {
+      const char c = *in;
+      if (c == '\\' && in + 1 != end) {
+        *out++ = in[1];
+        in += 2;
+      } else if (quote != '\0') {
+        if (c == quote) {
+          quote = '\0';
+        } else {
+          *out++ = c;
+        }
+        ++in;
+      } else if (c == '\'' || c == '"') {
+        quote = c;
+        ++in;
+      } else if (std::isspace(static_cast<unsigned char>(c))) {
+        break;
+      } else {
+        *out++ = c;
+        ++in;
+      }
+    }
+
+    // Step past the white space that ended the argument before the
+    // terminator is written since it might overwrite it. At the end of the
+    // data the terminator might go into the extra byte past the end.
+    if (in != end) {
+      ++in;
+    }
+    *out++ = '\0';
+    args.push_back(arg);
+  }
+}
+
+
+/**
+ * @brief
+ * Appends the arguments in the response file at path to args, expanding any
+ * nested response files. Returns false if the file can't be read. The
+ * identities of the response files currently being expanded are kept in
+ * stack in order to detect cycles.
+ */
+inline
+bool expand_response_file(
+  const char* path,
+  std::vector<const char*>& args,
+  std::vector<std::shared_ptr<void>>& buffers,
+  std::vector<std::string>& stack)
+{
+  std::string identity;
+  const auto file = open_response_file(path, identity);
+  if (file == nullptr) {
+    return false;
+  }
+  if (std::find(stack.begin(), stack.end(), identity) != stack.end()) {
+    std::ostringstream msg;
+    msg << "response file \"" << path << "\" includes itself";
+    throw response_file_error(msg.str());
+  }
+  if (stack.size() >= max_response_file_depth) {
+    std::ostringstream msg;
+    msg << "response file \"" << path << "\" is nested more than "
+        << max_response_file_depth << " deep";
+    throw response_file_error(msg.str());
+  }
+  buffers.push_back(file);
+
+  std::vector<const char*> file_args;
+  tokenize_response_file(file->data, file->size, file_args);
+
+  stack.push_back(identity);
+  for (const auto arg : file_args) {
+    if (arg[0] != '@' || !expand_response_file(arg + 1, args, buffers, stack)) {
+      args.push_back(arg);
+    }
+  }
+  stack.pop_back();
+  return true;
+}
+
+
+inline
+std::vector<const char*> expand_response_files(
+  int argc,
+  const char** argv,
+  std::vector<std::shared_ptr<void>>& buffers)
+{
+  std::vector<const char*> args;
+  args.reserve(argc);
+  std::vector<std::string> stack;
+  for (int i = 0; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (i == 0 || arg[0] != '@' ||
+        !expand_response_file(arg + 1, args, buffers, stack)) {
+      args.push_back(arg);
+    }
+  }
+  return args;
+}
+
+
+inline
+nul_separated_iterator::nul_separated_iterator(
+  const char* pos,
+  const char* end)
+: arg {pos, 0}, end(end)
+{
+  if (pos != end) {
+    const auto nul = static_cast<const char*>(
+      std::memchr(pos, '\0', static_cast<std::size_t>(end - pos)));
+    this->arg.size = static_cast<std::size_t>(
+      ((nul == nullptr) ? end : nul) - pos);
+  }
+}
+
+
+inline
+const arg_view& nul_separated_iterator::operator * () const
+{
+  return this->arg;
+}
+
+
+inline
+const arg_view* nul_separated_iterator::operator -> () const
+{
+  return &this->arg;
+}
+
+
+inline
+nul_separated_iterator& nul_separated_iterator::operator ++ ()
+{
+  *this = nul_separated_iterator(
+    this->arg.data + this->arg.size + 1, this->end);
+  return *this;
+}
+
+
+inline
+nul_separated_iterator nul_separated_iterator::operator ++ (int)
+{
+  nul_separated_iterator copy = *this;
+  ++*this;
+  return copy;
+}
+
+
+inline
+bool nul_separated_iterator::operator == (
+  const nul_separated_iterator& other) const
+{
+  return this->arg.data == other.arg.data;
+}
+
+
+inline
+bool nul_separated_iterator::operator != (
+  const nul_separated_iterator& other) const
+{
+  return !(*this == other);
+}
+
+
+inline
+nul_separated_iterator command_line::begin() const
+{
+  return nul_separated_iterator(
+    this->data.get(), this->data.get() + this->size);
+}
+
+
+inline
+nul_separated_iterator command_line::end() const
+{
+  return nul_separated_iterator(
+    this->data.get() + this->size, this->data.get() + this->size);
+}
+
+
+inline
+bool is_command_line_blank(
+  const char c)
+{
+  return c == ' ' || c == '\t' || c == '\n';
+}
+
+
+/**
+ * @brief
+ * Returns a pointer to the first character in [s, end) that needs special
+ * treatment when splitting a command line or end if there isn't one. Inside
+ * double quotes (quoted is true) these are double quotes and backslashes.
+ * Otherwise they are blanks, quotes and backslashes. Plain runs of
+ * characters are skipped sixteen at a time with SSE2 when it's available.
+ */
+inline
+const char* find_command_line_special(
+  const char* s,
+  const char* end,
+  const bool quoted)
+{
+#ifdef ARGAGG_HAS_SSE2
+  const __m128i double_quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i single_quote = _mm_set1_epi8('\'');
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i newline = _mm_set1_epi8('\n');
+  for (; end - s >= 16; s += 16) {
+    const __m128i chunk =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    __m128i hits = _mm_or_si128(
+      _mm_cmpeq_epi8(chunk, double_quote),
+      _mm_cmpeq_epi8(chunk, backslash));
+    if (!quoted) {
+      hits = _mm_or_si128(hits, _mm_or_si128(
+        _mm_or_si128(
+          _mm_cmpeq_epi8(chunk, single_quote),
+          _mm_cmpeq_epi8(chunk, space)),
+        _mm_or_si128(
+          _mm_cmpeq_epi8(chunk, tab),
+          _mm_cmpeq_epi8(chunk, newline))));
+    }
+    const unsigned int mask =
+      static_cast<unsigned int>(_mm_movemask_epi8(hits));
+    if (mask != 0) {
+#ifdef __GNUC__
+      return s + __builtin_ctz(mask);
+#else
+      // The scalar loop below finds it within this chunk.
+      break;
+#endif
+    }
+  }
+#endif
+  for (; s != end; ++s) {
+    const char c = *s;
+    if (c == '"' || c == '\\') {
+      break;
+    }
+    if (!quoted && (c == '\'' || is_command_line_blank(c))) {
+      break;
+    }
+  }
+  return s;
+}
+
+
+/**
+ * @brief
+ * Moves the run of characters [in, end) to out, which is never ahead of in,
+ * and returns the position after the run in out.
+ */
+inline
+char* move_command_line_run(
+  const char* in,
+  const char* end,
+  char* out)
+{
+  const std::size_t len = static_cast<std::size_t>(end - in);
+  if (out != in) {
+    std::memmove(out, in, len);
+  }
+  return out + len;
+}
+
+
+inline
+std::size_t tokenize_command_line(
+  char* data,
+  std::size_t size,
+  std::size_t& count)
+{
+  // Like response files, arguments only ever shrink when quotes and
+  // backslashes are removed so they are unescaped in place by writing behind
+  // where we're reading.
+  const char* in = data;
+  const char* const end = data + size;
+  char* out = data;
+  count = 0;
+  while (in != end) {
+    if (is_command_line_blank(*in)) {
+      ++in;
+      continue;
+    }
+
+    // An argument only starts once something is written to it or a quote
+    // shows up (so '' is an empty argument), which keeps a backslash-newline
+    // between blanks from making an empty argument.
+    bool started = false;
+    while (in != end) {
+      const char* special = find_command_line_special(in, end, false);
+      started = started || special != in;
+      out = move_command_line_run(in, special, out);
+      in = special;
+      if (in == end || is_command_line_blank(*in)) {
+        break;
+      }
+
+      const char* const quote = in++;
+      if (*quote == '\\') {
+        // A trailing backslash has nothing to escape so it's kept. A
+        // backslash followed by a newline continues the line.
+        if (in == end) {
+          *out++ = '\\';
+          started = true;
+        } else if (*in++ != '\n') {
+          *out++ = in[-1];
+          started = true;
+        }
+        continue;
+      }
+      started = true;
+
+      if (*quote == '\'') {
+        const auto close = static_cast<const char*>(
+          std::memchr(in, '\'', static_cast<std::size_t>(end - in)));
+        if (close == nullptr) {
+          std::ostringstream msg;
+          msg << "unterminated single quote at offset " << (quote - data);
+          throw invalid_command_line(msg.str());
+        }
+        out = move_command_line_run(in, close, out);
+        in = close + 1;
+        continue;
+      }
+
+      // Double quotes.
+      for (;;) {
+        special = find_command_line_special(in, end, true);
+        out = move_command_line_run(in, special, out);
+        in = special;
+        if (in != end && *in == '"') {
+          ++in;
+          break;
+        }
+        if (end - in < 2) {
+          std::ostringstream msg;
+          msg << "unterminated double quote at offset " << (quote - data);
+          throw invalid_command_line(msg.str());
+        }
+        const char c = in[1];
+        in += 2;
+        if (c == '$' || c == '`' || c == '"' || c == '\\') {
+          *out++ = c;
+        } else if (c != '\n') {
+          *out++ = '\\';
+          *out++ = c;
+        }
+      }
+    }
+
+    // Step past the blank that ended the argument before the terminator is
+    // written since it might overwrite it. At the end of the data the
+    // terminator might go into the extra byte past the end.
+    if (in != end) {
+      ++in;
+    }
+    if (started) {
+      *out++ = '\0';
+      ++count;
+    }
+  }
+  return static_cast<std::size_t>(out - data);
+}
+
+
+inline
+command_line split_command_line(
+  const char* command,
+  std::size_t len)
+{
+  command_line result {
+    std::shared_ptr<char>(new char[len + 1], std::default_delete<char[]>()),
+    0, 0};
+  std::memcpy(result.data.get(), command, len);
+  result.size = tokenize_command_line(result.data.get(), len, result.count);
+  return result;
+}
+
+
+inline
+command_line split_command_line(
+  const std::string& command)
+{
+  return split_command_line(command.data(), command.size());
+}
+
+
+inline
+const char* arg_data(
+  const char* arg)
+{
+  return arg;
+}
+
+
+inline
+const char* arg_data(
+  const arg_view& arg)
+{
+  return arg.data;
+}
+
+
+inline
+const char* arg_data(
+  const std::string& arg)
+{
+  return arg.c_str();
+}
+
+
+template <typename Pointer, typename Size>
+const char* arg_data(
+  const std::pair<Pointer, Size>& arg)
+{
+  return arg.first;
+}
+
+
+template <typename T>
+typename std::enable_if<is_string_view_like<T>::value, const char*>::type
+arg_data(
+  const T& arg)
+{
+  return arg.data();
+}
+
+
+inline
+std::size_t arg_length(
+  const char* arg)
+{
+  return std::strlen(arg);
+}
+
+
+inline
+std::size_t arg_length(
+  const arg_view& arg)
+{
+  return arg.size;
+}
+
+
+inline
+std::size_t arg_length(
+  const std::string& arg)
+{
+  return arg.size();
+}
+
+
+template <typename Pointer, typename Size>
+std::size_t arg_length(
+  const std::pair<Pointer, Size>& arg)
+{
+  return static_cast<std::size_t>(arg.second);
+}
+
+
+template <typename T>
+typename std::enable_if<is_string_view_like<T>::value, std::size_t>::type
+arg_length(
+  const T& arg)
+{
+  return static_cast<std::size_t>(arg.size());
+}
+
+
+template <typename Iterator>
+arg_view packed_arg_iterator<Iterator>::operator * () const
+{
+  return arg_view {this->pos, arg_length(*this->source)};
+}
+
+
+template <typename Iterator>
+packed_arg_iterator<Iterator>& packed_arg_iterator<Iterator>::operator ++ ()
+{
+  this->pos += arg_length(*this->source) + 1;
+  ++this->source;
+  return *this;
+}
+
+
+template <typename Iterator>
+bool packed_arg_iterator<Iterator>::operator == (
+  const packed_arg_iterator& other) const
+{
+  return this->source == other.source;
+}
+
+
+template <typename Iterator>
+bool packed_arg_iterator<Iterator>::operator != (
+  const packed_arg_iterator& other) const
+{
+  return !(*this == other);
+}
+
+
+inline
+std::size_t config_file::line_of(
+  const char* arg) const
+{
+  // Values are recorded in the order they appear in the contents so their
+  // pointers are sorted.
+  const auto value = std::lower_bound(
+    this->lines.begin(), this->lines.end(), arg,
+    [](const std::pair<const char*, std::size_t>& entry, const char* arg) {
+      return std::less<const char*>()(entry.first, arg);
+    });
+  if (value == this->lines.end() || value->first != arg) {
+    return 0;
+  }
+  return value->second;
+}
+
+
+/**
+ * @brief
+ * Returns true if c is white space within a config file line.
+ */
+inline
+bool is_config_space(
+  const char c)
+{
+  return std::isspace(static_cast<unsigned char>(c)) && c != '\n';
+}
+
+
+inline
+std::shared_ptr<config_file> merge_config_file(
+  const parser_map& map,
+  const char* path,
+  parser_results& results)
+{
+  auto config = std::make_shared<config_file>();
+  config->path = path;
+  std::string identity;
+  config->contents = open_response_file(path, identity);
+  if (config->contents == nullptr) {
+    std::ostringstream msg;
+    msg << path << ": unable to read config file";
+    throw config_file_error(msg.str());
+  }
+
+  // Whether or not each option found in the file already had results from
+  // the command line or environment when it was first seen. Those that did
+  // ignore the file.
+  std::unordered_map<const definition*, bool> overridden;
+
+  char* pos = config->contents->data;
+  char* const end = pos + config->contents->size;
+  std::size_t line = 0;
+  while (pos != end) {
+    ++line;
+    char* line_end = static_cast<char*>(
+      std::memchr(pos, '\n', static_cast<std::size_t>(end - pos)));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    char* const next = (line_end == end) ? end : line_end + 1;
+
+    char* begin = pos;
+    char* stop = line_end;
+    pos = next;
+    while (begin != stop && is_config_space(*begin)) {
+      ++begin;
+    }
+    while (stop != begin && is_config_space(stop[-1])) {
+      --stop;
+    }
+    if (begin == stop || *begin == '#' || *begin == ';') {
+      continue;
+    }
 
+    auto fail = [&](const std::string& problem) {
+      std::ostringstream msg;
+      msg << path << ':' << line << ": " << problem;
+      throw config_file_error(msg.str());
+    };
 
-namespace argagg {
+    if (*begin == '[') {
+      if (stop[-1] != ']') {
+        fail("unterminated section header");
+      }
+      continue;
+    }
+
+    char* const equal = static_cast<char*>(
+      std::memchr(begin, '=', static_cast<std::size_t>(stop - begin)));
+    char* key_end = (equal == nullptr) ? stop : equal;
+    while (key_end != begin && is_config_space(key_end[-1])) {
+      --key_end;
+    }
+    if (key_end == begin) {
+      fail("missing option name");
+    }
+    const auto key_len = static_cast<std::size_t>(key_end - begin);
+    const auto defn = map.get_definition_for_config_key(begin, key_len);
+    if (defn == nullptr) {
+      fail("unknown option \"" + std::string(begin, key_len) + "\"");
+    }
 
+    // Find the value and strip any quotes around it.
+    char* value = nullptr;
+    if (equal != nullptr) {
+      value = equal + 1;
+      while (value != stop && is_config_space(*value)) {
+        ++value;
+      }
+      if (stop - value >= 2 && (*value == '"' || *value == '\'')
+          && stop[-1] == *value) {
+        ++value;
+        --stop;
+      }
+    }
 
-template <typename T>
-T option_result::as() const
-{
-  if (this->arg) {
-    return convert::arg<T>(this->arg);
-  } else {
-    throw option_lacks_argument_error("option has no argument");
+    const auto existing = overridden.find(defn);
+    const bool skip = (existing != overridden.end())
+      ? existing->second
+      : overridden.emplace(
+          defn, results.options[defn->name].count() > 0).first->second;
+    if (skip) {
+      continue;
+    }
+
+    if (defn->wants_no_arguments()) {
+      if (value != nullptr) {
+        const std::string flag(value, static_cast<std::size_t>(stop - value));
+        if (flag == "false" || flag == "no" || flag == "off" || flag == "0") {
+          continue;
+        }
+        if (flag != "true" && flag != "yes" && flag != "on" && flag != "1") {
+          fail("invalid value \"" + flag + "\" for option \"" + defn->name
+               + "\", expected a boolean");
+        }
+      }
+      option_result opt_result {nullptr};
+      results.options[defn->name].all.push_back(std::move(opt_result));
+      continue;
+    }
+
+    if (value == nullptr) {
+      fail("option \"" + defn->name + "\" expects a value");
+    }
+
+    // The end of the value is at most the end of the line, which is either
+    // the new line we already stepped past or the extra byte past the end of
+    // the contents.
+    *stop = '\0';
+    option_result opt_result {value};
+    results.options[defn->name].all.push_back(std::move(opt_result));
+    config->lines.push_back(std::make_pair(value, line));
   }
+
+  results.buffers.push_back(config);
+  return config;
 }
 
 
-template <typename T>
-T option_result::as(const T& t) const
-{
-  if (this->arg) {
-    try {
-      return convert::arg<T>(this->arg);
-    } catch (...) {
-      return t;
+namespace convert {
+
+
+  /**
+   * @brief
+   * Templated function for conversion to T using the @ref std::strtol()
+   * function.  This is used for anything long length or shorter (long, int,
+   * short, char).
+   */
+  template <typename T> inline
+  T long_(const char* arg)
+  {
+    char* endptr = nullptr;
+    errno = 0;
+    T ret = static_cast<T>(std::strtol(arg, &endptr, 0));
+    if (endptr == arg) {
+      std::ostringstream msg;
+      msg << "unable to convert argument to integer: \"" << arg << "\"";
+      throw std::invalid_argument(msg.str());
+    }
+    if (errno == ERANGE) {
+      throw std::out_of_range("argument numeric value out of range");
+    }
+    return ret;
+  }
+
+
+  /**
+   * @brief
+   * Templated function for conversion to T using the @ref std::strtoll()
+   * function.  This is used for anything long long length or shorter (long
+   * long).
+   */
+  template <typename T> inline
+  T long_long_(const char* arg)
+  {
+    char* endptr = nullptr;
+    errno = 0;
+    T ret = static_cast<T>(std::strtoll(arg, &endptr, 0));
+    if (endptr == arg) {
+      std::ostringstream msg;
+      msg << "unable to convert argument to integer: \"" << arg << "\"";
+      throw std::invalid_argument(msg.str());
+    }
+    if (errno == ERANGE) {
+      throw std::out_of_range("argument numeric value out of range");
+    }
+    return ret;
+  }
+
+
+#define DEFINE_CONVERSION_FROM_LONG_(TYPE) \
+  template <> inline \
+  TYPE arg(const char* arg) \
+  { \
+    return long_<TYPE>(arg); \
+  }
+
+  DEFINE_CONVERSION_FROM_LONG_(char)
+  DEFINE_CONVERSION_FROM_LONG_(unsigned char)
+  DEFINE_CONVERSION_FROM_LONG_(signed char)
+  DEFINE_CONVERSION_FROM_LONG_(short)
+  DEFINE_CONVERSION_FROM_LONG_(unsigned short)
+  DEFINE_CONVERSION_FROM_LONG_(int)
+  DEFINE_CONVERSION_FROM_LONG_(unsigned int)
+  DEFINE_CONVERSION_FROM_LONG_(long)
+  DEFINE_CONVERSION_FROM_LONG_(unsigned long)
+
+#undef DEFINE_CONVERSION_FROM_LONG_
+
+
+#define DEFINE_CONVERSION_FROM_LONG_LONG_(TYPE) \
+  template <> inline \
+  TYPE arg(const char* arg) \
+  { \
+    return long_long_<TYPE>(arg); \
+  }
+
+  DEFINE_CONVERSION_FROM_LONG_LONG_(long long)
+  DEFINE_CONVERSION_FROM_LONG_LONG_(unsigned long long)
+
+#undef DEFINE_CONVERSION_FROM_LONG_LONG_
+
+
+  template <typename T>
+  T arg(const char* arg)
+  {
+    return converter<T>::convert(arg);
+  }
+
+
+  template <> inline
+  bool arg(const char* arg)
+  {
+    return argagg::convert::arg<int>(arg) != 0;
+  }
+
+
+  template <> inline
+  float arg(const char* arg)
+  {
+    char* endptr = nullptr;
+    errno = 0;
+    float ret = std::strtof(arg, &endptr);
+    if (endptr == arg) {
+      std::ostringstream msg;
+      msg << "unable to convert argument to integer: \"" << arg << "\"";
+      throw std::invalid_argument(msg.str());
+    }
+    if (errno == ERANGE) {
+      throw std::out_of_range("argument numeric value out of range");
+    }
+    return ret;
+  }
+
+
+  template <> inline
+  double arg(const char* arg)
+  {
+    char* endptr = nullptr;
+    errno = 0;
+    double ret = std::strtod(arg, &endptr);
+    if (endptr == arg) {
+      std::ostringstream msg;
+      msg << "unable to convert argument to integer: \"" << arg << "\"";
+      throw std::invalid_argument(msg.str());
+    }
+    if (errno == ERANGE) {
+      throw std::out_of_range("argument numeric value out of range");
+    }
+    return ret;
+  }
+
+
+  template <> inline
+  const char* arg(const char* arg)
+  {
+    return arg;
+  }
+
+
+  template <> inline
+  std::string arg(const char* arg)
+  {
+    return std::string(arg);
+  }
+
+
+  template <typename T>
+  bool parse_next_component(
+    const char*& s,
+    T& out_arg,
+    const char delim)
+  {
+    const char* begin = s;
+    s = std::strchr(s, delim);
+    if (s == nullptr) {
+      std::string arg_str(begin);
+      out_arg = argagg::convert::arg<T>(arg_str.c_str());
+      return false;
+    } else {
+      std::string arg_str(begin, s - begin);
+      out_arg = argagg::convert::arg<T>(arg_str.c_str());
+      s += 1;
+      return true;
     }
-  } else {
-    // I actually think this will never happen. To call this method you have
-    // to access a specific option_result for an option. If there's a
-    // specific option_result then the option was found. If the option
-    // requires an argument then it will definitely have an argument
-    // otherwise the parser would have complained.
-    return t;
   }
+
+
+} // namespace convert
+
+
+inline
+command::command()
+: definitions(), subcommands(), parent(nullptr), compiled()
+{
 }
 
 
-template <typename T>
-option_result::operator T () const
+inline
+command::command(std::vector<definition> definitions)
+: definitions(std::move(definitions)), subcommands(), parent(nullptr),
+  compiled()
 {
-  return this->as<T>();
 }
 
 
-template <> inline
-option_result::operator bool () const
+inline
+command& command::add(
+  std::string name,
+  std::vector<definition> definitions)
 {
-  return this->arg != nullptr;
+  auto child = std::make_shared<command>(std::move(definitions));
+  child->parent = this;
+  command& result = *child;
+  this->subcommands[std::move(name)] = std::move(child);
+  return result;
 }
 
 
 inline
-bool option_result::operator ! () const
+const command& command::subcommand(
+  const std::string& name) const
 {
-  return !static_cast<bool>(*this);
+  const auto existing = this->subcommands.find(name);
+  if (existing == this->subcommands.end()) {
+    std::ostringstream msg;
+    msg << "no subcommand named \"" << name << "\"";
+    throw unknown_subcommand(msg.str());
+  }
+  return *existing->second;
+}
+
+
+inline
+const compiled_command& command::compile() const
+{
+  if (this->compiled == nullptr) {
+    // Definitions can't be assigned (their names are const) so they're
+    // copied in one at a time.
+    auto result = std::make_shared<compiled_command>();
+    std::size_t depth = 0;
+    for (const command* ancestor = this->parent; ancestor != nullptr;
+         ancestor = ancestor->parent) {
+      ++depth;
+    }
+    std::vector<std::string> own_flags;
+    std::vector<std::string> own_env_vars;
+    for (const auto& defn : this->definitions) {
+      result->definitions.push_back(defn);
+      result->depths.push_back(depth);
+      own_flags.insert(own_flags.end(), defn.flags.begin(), defn.flags.end());
+      if (!defn.env.empty()) {
+        own_env_vars.push_back(defn.env);
+      }
+    }
+    std::sort(own_flags.begin(), own_flags.end());
+    std::sort(own_env_vars.begin(), own_env_vars.end());
+    auto shadowed = [](const std::vector<std::string>& own,
+                       const std::string& name) {
+        return std::binary_search(own.begin(), own.end(), name);
+      };
+
+    if (this->parent != nullptr) {
+      const auto& inherited = this->parent->compile();
+      for (std::size_t i = 0; i < inherited.definitions.size(); ++i) {
+        const auto& defn = inherited.definitions[i];
+        std::vector<std::string> flags;
+        for (const auto& flag : defn.flags) {
+          if (!shadowed(own_flags, flag)) {
+            flags.push_back(flag);
+          }
+        }
+        if (flags.empty()) {
+          continue;
+        }
+        result->definitions.push_back(defn);
+        result->definitions.back().flags = std::move(flags);
+        if (shadowed(own_env_vars, defn.env)) {
+          result->definitions.back().env.clear();
+        }
+        result->depths.push_back(inherited.depths[i]);
+      }
+    }
+    result->map = validate_definitions(result->definitions);
+    this->compiled = std::move(result);
+  }
+  return *this->compiled;
 }
 
 
-inline
-std::size_t option_results::count() const
-{
-  return this->all.size();
-}
+/**
+ * @brief
+ * The argagg::parse_state handler for argagg::command::parse(). It collects
+ * into the results like argagg::parser_results_handler except that the first
+ * positional argument of a command with subcommands selects the subcommand.
+ */
+struct command_handler {
 
+  /**
+   * @brief
+   * The results being collected into. Options go into the scope of the
+   * command that defines them and positional arguments into the scope of
+   * the current command.
+   */
+  command_results& results;
 
-inline
-option_result& option_results::operator [] (std::size_t index)
-{
-  return this->all[index];
-}
+  /**
+   * @brief
+   * The compiled definitions of the current command.
+   */
+  const compiled_command* compiled;
 
+  /**
+   * @brief
+   * The command currently being parsed.
+   */
+  const command* current;
 
-inline
-const option_result& option_results::operator [] (std::size_t index) const
-{
-  return this->all[index];
-}
+  /**
+   * @brief
+   * The subcommand selected by the last argument, if any.
+   */
+  const command* selected;
 
+  /**
+   * @brief
+   * Whether or not a positional argument should select a subcommand. It
+   * shouldn't after the special "--" argument.
+   */
+  bool dispatch;
 
-template <typename T>
-T option_results::as() const
-{
-  if (this->all.size() == 0) {
-    throw std::out_of_range("no option arguments to convert");
+  void option(const definition& defn, const char* arg)
+  {
+    const std::size_t depth = this->compiled->depths[
+      static_cast<std::size_t>(&defn - this->compiled->definitions.data())];
+    option_result opt_result {arg};
+    this->results.scopes[depth].options[defn.name].all.push_back(
+      std::move(opt_result));
   }
-  return this->all.back().as<T>();
-}
 
-
-template <typename T>
-T option_results::as(const T& t) const
-{
-  if (this->all.size() == 0) {
-    return t;
+  void positional(const char* arg)
+  {
+    if (this->dispatch && !this->current->subcommands.empty()) {
+      const auto existing = this->current->subcommands.find(arg);
+      if (existing == this->current->subcommands.end()) {
+        std::ostringstream msg;
+        msg << "found unexpected subcommand: " << arg;
+        throw unknown_subcommand(msg.str());
+      }
+      this->selected = existing->second.get();
+      return;
+    }
+    this->results.scopes.back().pos.push_back(arg);
   }
-  return this->all.back().as<T>(t);
-}
 
+};
 
-template <typename T>
-option_results::operator T () const
+
+inline
+command_results command::parse(int argc, const char** argv) const
 {
-  return this->as<T>();
-}
+  const char* program = (argc > 0) ? argv[0] : nullptr;
+  command_results out {{this}, {}, this, {program, {}, {}, {}}, {}};
+
+  // Add a scope with an empty option result for each definition of a
+  // command as we reach it.
+  auto add_scope = [&out, program](const command& cmd) {
+    parser_results scope {program, {}, {}, {}};
+    for (const auto& defn : cmd.definitions) {
+      option_results opt_results {{}};
+      scope.options.insert(std::make_pair(defn.name, opt_results));
+    }
+    out.scopes.push_back(std::move(scope));
+  };
+  add_scope(*this);
+
+  const compiled_command* compiled = &this->compile();
+  parse_state state(compiled->map);
+  command_handler handler {out, compiled, this, nullptr, true};
+  for (int i = 1; i < argc; ++i) {
+    handler.dispatch = !state.ignore_flags;
+    state.feed(argv[i], handler);
+    if (handler.selected == nullptr) {
+      continue;
+    }
 
+    // A positional argument can't leave an option waiting for arguments so
+    // the subcommand simply starts with a fresh state on its own map.
+    const command* selected = handler.selected;
+    handler.selected = nullptr;
+    handler.current = selected;
+    out.path.push_back(selected);
+    out.names.push_back(argv[i]);
+    out.selected = selected;
+    add_scope(*selected);
+    compiled = &selected->compile();
+    handler.compiled = compiled;
+    state = parse_state(compiled->map);
+  }
+  state.finish();
+
+  merge_environment_with(
+    compiled->map, environment(),
+    [&out, compiled](const definition& defn) -> option_results& {
+      const std::size_t depth = compiled->depths[
+        static_cast<std::size_t>(&defn - compiled->definitions.data())];
+      return out.scopes[depth].options[defn.name];
+    });
 
-template <> inline
-option_results::operator bool () const
-{
-  return this->all.size() > 0;
+  // Inner scopes go first so that their options hide their ancestors'.
+  for (auto scope = out.scopes.rbegin(); scope != out.scopes.rend();
+       ++scope) {
+    out.results.options.insert(scope->options.begin(), scope->options.end());
+  }
+  for (const auto& scope : out.scopes) {
+    out.results.pos.insert(
+      out.results.pos.end(), scope.pos.begin(), scope.pos.end());
+  }
+  return out;
 }
 
 
 inline
-bool option_results::operator ! () const
+command_results command::parse(int argc, char** argv) const
 {
-  return !static_cast<bool>(*this);
+  return parse(argc, const_cast<const char**>(argv));
 }
 
 
 inline
-bool parser_results::has_option(const std::string& name) const
+completion command::complete(int argc, const char** argv) const
 {
-  const auto it = this->options.find(name);
-  return ( it != this->options.end()) && it->second.all.size() > 0;
+  const command* current = this;
+  parse_state state(this->compile().map);
+  discarding_handler handler;
+  for (int i = 1; i < argc - 1; ++i) {
+    const bool may_dispatch = (
+        !state.ignore_flags
+        && !state.expects_option_argument()
+        && !current->subcommands.empty()
+        && !cmd_line_arg_is_option_flag(argv[i])
+      );
+    if (may_dispatch) {
+      const auto existing = current->subcommands.find(argv[i]);
+      if (existing != current->subcommands.end()) {
+        current = existing->second.get();
+        state = parse_state(current->compile().map);
+        continue;
+      }
+    }
+    try {
+      state.feed(argv[i], handler);
+    } catch (const std::exception&) {
+    }
+  }
+
+  const char* word = (argc > 1) ? argv[argc - 1] : "";
+  completion result = complete_argument(state, word);
+  const bool may_dispatch = (
+      result.option == nullptr
+      && !state.ignore_flags
+      && word[0] != '-'
+    );
+  if (may_dispatch) {
+    const std::size_t len = std::strlen(word);
+    for (const auto& subcommand : current->subcommands) {
+      if (subcommand.first.compare(0, len, word, len) == 0) {
+        result.candidates.push_back(subcommand.first);
+      }
+    }
+  }
+  return result;
 }
 
 
 inline
-option_results& parser_results::operator [] (const std::string& name)
-try {
-  return this->options.at(name);
-} catch (const std::out_of_range& e) {
-  std::ostringstream msg;
-  msg << "no option named \"" << name << "\" in parser_results";
-  throw unknown_option(msg.str());
+completion command::complete(int argc, char** argv) const
+{
+  return complete(argc, const_cast<const char**>(argv));
 }
 
 
+/**
+ * @brief
+ * Returns the name of the shell function that completes the program.
+ */
 inline
-const option_results&
-parser_results::operator [] (const std::string& name) const
-try {
-  return this->options.at(name);
-} catch (const std::out_of_range& e) {
-  std::ostringstream msg;
-  msg << "no option named \"" << name << "\" in parser_results";
-  throw unknown_option(msg.str());
+std::string completion_function_name(const std::string& program)
+{
+  std::string name = "_argagg_";
+  for (const char c : program) {
+    name += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+  }
+  return name;
 }
 
 
+/**
+ * @brief
+ * Writes the shell case branch holding the flags of the command at path,
+ * which has the definitions of all of the scopes, and recurses into its
+ * subcommands. Like with argagg::command::compile() flags of inner scopes
+ * shadow those of outer ones. The flags that take arguments are followed by
+ * how many they take so the scripts can skip over the arguments.
+ */
 inline
-std::size_t parser_results::count() const
+void write_completion_tables(
+  std::ostream& out,
+  const std::string& path,
+  std::vector<const std::vector<definition>*>& scopes,
+  const std::map<std::string, std::shared_ptr<command>>& subcommands)
 {
-  return this->pos.size();
+  auto shadowed = [&scopes](std::size_t scope, const std::string& flag) {
+      for (std::size_t inner = scope + 1; inner < scopes.size(); ++inner) {
+        for (const auto& defn : *scopes[inner]) {
+          if (std::find(defn.flags.begin(), defn.flags.end(), flag)
+              != defn.flags.end()) {
+            return true;
+          }
+        }
+      }
+      return false;
+    };
+  std::string flags;
+  std::string argflags = " ";
+  for (std::size_t scope = 0; scope < scopes.size(); ++scope) {
+    for (const auto& defn : *scopes[scope]) {
+      for (const auto& flag : defn.flags) {
+        if (shadowed(scope, flag)) {
+          continue;
+        }
+        flags += (flags.empty() ? "" : " ") + flag;
+        if (defn.requires_arguments()) {
+          argflags += flag + ' ' + std::to_string(defn.num_args) + ' ';
+        }
+      }
+    }
+  }
+  std::string commands;
+  for (const auto& subcommand : subcommands) {
+    commands += (commands.empty() ? "" : " ") + subcommand.first;
+  }
+  out << "    \"" << path << "\")\n"
+      << "      flags=\"" << flags << "\"\n"
+      << "      argflags=\"" << argflags << "\"\n"
+      << "      commands=\"" << commands << "\"\n"
+      << "      ;;\n";
+  for (const auto& subcommand : subcommands) {
+    scopes.push_back(&subcommand.second->definitions);
+    write_completion_tables(
+      out, path + '/' + subcommand.first, scopes,
+      subcommand.second->subcommands);
+    scopes.pop_back();
+  }
 }
 
 
+/**
+ * @brief
+ * Writes a bash or zsh completion script. Both shells walk the words before
+ * the one being completed the same way: arguments of options are skipped,
+ * subcommand names select the next table and "--" ends the flags. Like
+ * argagg::parse_state::feed() a group of short flags only waits for
+ * arguments if its last flag takes them since a flag before that takes the
+ * rest of the group as its argument.
+ */
 inline
-const char* parser_results::operator [] (std::size_t index) const
+void write_completion_script(
+  std::ostream& out,
+  const std::string& program,
+  const std::vector<definition>& definitions,
+  const std::map<std::string, std::shared_ptr<command>>& subcommands,
+  bool zsh)
 {
-  return this->pos[index];
+  const std::string name = completion_function_name(program);
+  if (zsh) {
+    out << "#compdef " << program << "\n\n";
+  }
+  out << "# " << (zsh ? "zsh" : "bash") << " completion for " << program
+      << ", generated by argagg\n\n"
+      << name << "_tables() {\n"
+      << "  case \"$1\" in\n";
+  std::vector<const std::vector<definition>*> scopes {&definitions};
+  write_completion_tables(out, "", scopes, subcommands);
+  out << "  esac\n"
+      << "}\n\n"
+      << name << "() {\n"
+      << "  local flags argflags commands cmdpath=\"\" word rest skip=0 i j\n"
+      << "  " << name << "_tables \"\"\n";
+  if (zsh) {
+    out << "  for ((i = 2; i < CURRENT; i++)); do\n"
+        << "    word=\"${words[i]}\"\n"
+        << "    if ((skip > 0)); then\n";
+  } else {
+    // bash splits "--flag=value" into three words.
+    out << "  for ((i = 1; i < COMP_CWORD; i++)); do\n"
+        << "    word=\"${COMP_WORDS[i]}\"\n"
+        << "    if [[ $word == = ]]; then\n"
+        << "      skip=1\n"
+        << "    elif ((skip > 0)); then\n";
+  }
+  out << "      skip=$((skip - 1))\n"
+      << "    elif [[ $word == -- ]]; then\n"
+      << "      flags=\"\"\n"
+      << "      commands=\"\"\n"
+      << "      break\n"
+      << "    elif [[ $word == -[!-]?* ]]; then\n"
+      << "      for ((j = 1; j < ${#word}; j++)); do\n"
+      << "        rest=\"${argflags#* \"-${word:j:1}\" }\"\n"
+      << "        if [[ $rest != \"$argflags\" ]]; then\n"
+      << "          ((j == ${#word} - 1)) && skip=\"${rest%% *}\"\n"
+      << "          break\n"
+      << "        fi\n"
+      << "      done\n"
+      << "    elif [[ $word == -* ]]; then\n"
+      << "      rest=\"${argflags#* \"$word\" }\"\n"
+      << "      if [[ $rest != \"$argflags\" ]]; then\n"
+      << "        skip=\"${rest%% *}\"\n"
+      << "      fi\n"
+      << "    elif [[ \" $commands \" == *\" $word \"* ]]; then\n"
+      << "      cmdpath=\"$cmdpath/$word\"\n"
+      << "      " << name << "_tables \"$cmdpath\"\n"
+      << "    fi\n"
+      << "  done\n";
+  if (zsh) {
+    out << "  if ((skip > 0)); then\n"
+        << "    _files\n"
+        << "  elif [[ $PREFIX == -* && -n $flags ]]; then\n"
+        << "    compadd -- ${=flags}\n"
+        << "  elif [[ -n $commands ]]; then\n"
+        << "    compadd -- ${=commands}\n"
+        << "  else\n"
+        << "    _files\n"
+        << "  fi\n"
+        << "}\n\n"
+        << "if [[ $zsh_eval_context[-1] == loadautofunc ]]; then\n"
+        << "  " << name << " \"$@\"\n"
+        << "else\n"
+        << "  compdef " << name << " " << program << "\n"
+        << "fi\n";
+  } else {
+    out << "  local cur=\"${COMP_WORDS[COMP_CWORD]}\"\n"
+        << "  if ((skip > 0)); then\n"
+        << "    [[ $cur == = ]] && cur=\"\"\n"
+        << "    COMPREPLY=($(compgen -f -- \"$cur\"))\n"
+        << "  elif [[ $cur == -* && -n $flags ]]; then\n"
+        << "    COMPREPLY=($(compgen -W \"$flags\" -- \"$cur\"))\n"
+        << "  elif [[ -n $commands ]]; then\n"
+        << "    COMPREPLY=($(compgen -W \"$commands\" -- \"$cur\"))\n"
+        << "  else\n"
+        << "    COMPREPLY=($(compgen -f -- \"$cur\"))\n"
+        << "  fi\n"
+        << "}\n\n"
+        << "complete -o filenames -F " << name << " " << program << "\n";
+  }
 }
 
 
-template <typename T>
-T parser_results::as(std::size_t i) const
+inline
+void write_bash_completion(
+  std::ostream& out,
+  const std::string& program,
+  const parser& argparser)
 {
-  return convert::arg<T>(this->pos[i]);
+  write_completion_script(out, program, argparser.definitions, {}, false);
 }
 
 
-template <typename T>
-std::vector<T> parser_results::all_as() const
+inline
+void write_bash_completion(
+  std::ostream& out,
+  const std::string& program,
+  const command& cmd)
 {
-  std::vector<T> v(this->pos.size());
-  std::transform(
-    this->pos.begin(), this->pos.end(), v.begin(),
-    [](const char* arg) {
-      return convert::arg<T>(arg);
-    });
-  return v;
+  write_completion_script(
+    out, program, cmd.definitions, cmd.subcommands, false);
 }
 
 
 inline
-bool definition::wants_no_arguments() const
+void write_zsh_completion(
+  std::ostream& out,
+  const std::string& program,
+  const parser& argparser)
 {
-  return this->num_args == 0;
+  write_completion_script(out, program, argparser.definitions, {}, true);
 }
 
 
 inline
-bool definition::requires_arguments() const
+void write_zsh_completion(
+  std::ostream& out,
+  const std::string& program,
+  const command& cmd)
 {
-  return this->num_args > 0;
+  write_completion_script(
+    out, program, cmd.definitions, cmd.subcommands, true);
 }
 
 
 inline
-bool cmd_line_arg_is_option_flag(
-  const char* s)
+bool is_ascii(const char* text, std::size_t len)
 {
-  auto len = std::strlen(s);
-
-  // The shortest possible flag has two characters: a hyphen and an
-  // alpha-numeric character.
-  if (len < 2) {
-    return false;
+  const char* const end = text + len;
+#ifdef ARGAGG_HAS_SSE2
+  __m128i high_bits = _mm_setzero_si128();
+  for (; end - text >= 16; text += 16) {
+    high_bits = _mm_or_si128(
+      high_bits, _mm_loadu_si128(reinterpret_cast<const __m128i*>(text)));
   }
-
-  // All flags must start with a hyphen.
-  if (s[0] != '-') {
+  if (_mm_movemask_epi8(high_bits) != 0) {
     return false;
   }
+#endif
+  unsigned char high_bit = 0;
+  for (; text != end; ++text) {
+    high_bit |= static_cast<unsigned char>(*text);
+  }
+  return (high_bit & 0x80) == 0;
+}
 
-  // Shift the name forward by a character to account for the initial hyphen.
-  // This means if s was originally "-v" then name will be "v".
-  const char* name = s + 1;
-
-  // Check if we're dealing with a long flag.
-  bool is_long = false;
-  if (s[1] == '-') {
-    is_long = true;
-
-    // Just -- is not a valid flag.
-    if (len == 2) {
-      return false;
-    }
 
-    // Shift the name forward to account for the extra hyphen. This means if s
-    // was originally "--output" then name will be "output".
-    name = s + 2;
+inline
+unsigned int codepoint_width(char32_t codepoint)
+{
+  // Sorted, non-overlapping ranges of code points, searched by binary search.
+  static const char32_t zero_width[][2] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF},
+    {0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A},
+    {0x064B, 0x065F}, {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4},
+    {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0900, 0x0902}, {0x093A, 0x093A},
+    {0x093C, 0x093C}, {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957},
+    {0x0962, 0x0963}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E},
+    {0x1160, 0x11FF}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF}, {0x200B, 0x200F},
+    {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F},
+    {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0xE0100, 0xE01EF},
+  };
+  static const char32_t double_width[][2] = {
+    {0x1100, 0x115F}, {0x2329, 0x232A}, {0x2E80, 0x303E}, {0x3040, 0xA4CF},
+    {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x1F300, 0x1F64F},
+    {0x1F900, 0x1F9FF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+  };
+  auto in = [codepoint](const char32_t (*first)[2], const char32_t (*last)[2]) {
+      const auto range = std::lower_bound(
+        first, last, codepoint,
+        [](const char32_t (&range)[2], char32_t c) { return range[1] < c; });
+      return range != last && (*range)[0] <= codepoint;
+    };
+  if (codepoint < 0x300) {
+    return 1;
   }
-
-  // The first character of the flag name must be alpha-numeric. This is to
-  // prevent things like "---a" from being valid flags.
-  len = std::strlen(name);
-  if (!std::isalnum(name[0])) {
-    return false;
+  if (in(std::begin(zero_width), std::end(zero_width))) {
+    return 0;
   }
-
-  // At this point in is_valid_flag_definition() we would check if the short
-  // flag has only one character. At command line specification you can group
-  // short flags together or even add an argument to a short flag without a
-  // space delimiter. Thus we don't check if this has only one character
-  // because it might not.
-
-  // If this is a long flag then we expect all characters *up to* an equal sign
-  // to be alpha-numeric or a hyphen. After the equal sign you are specify the
-  // argument to a long flag which can be basically anything.
-  if (is_long) {
-    bool encountered_equal = false;
-    return std::all_of(name, name + len, [&](const char& c) {
-        if (encountered_equal) {
-          return true;
-        } else {
-          if (c == '=') {
-            encountered_equal = true;
-            return true;
-          }
-          return std::isalnum(c) || c == '-';
-        }
-      });
+  if (in(std::begin(double_width), std::end(double_width))) {
+    return 2;
   }
-
-  // At this point we are not dealing with a long flag. We already checked that
-  // the first character is alpha-numeric so we've got the case of a single
-  // short flag covered. This might be a short flag group though and we might
-  // be tempted to check that each character of the short flag group is
-  // alpha-numeric. However, you can specify the argument for a short flag
-  // without a space delimiter (e.g. "-I/usr/local/include") so you can't tell
-  // if the rest of a short flag group is part of the argument or not unless
-  // you know what is a defined flag or not. We leave that kind of processing
-  // to the parser.
-  return true;
+  return 1;
 }
 
 
 inline
-bool is_valid_flag_definition(
-  const char* s)
+std::size_t display_width(const char* text, std::size_t len)
 {
-  auto len = std::strlen(s);
-
-  // The shortest possible flag has two characters: a hyphen and an
-  // alpha-numeric character.
-  if (len < 2) {
-    return false;
-  }
-
-  // All flags must start with a hyphen.
-  if (s[0] != '-') {
-    return false;
+  if (is_ascii(text, len)) {
+    return len;
   }
-
-  // Shift the name forward by a character to account for the initial hyphen.
-  // This means if s was originally "-v" then name will be "v".
-  const char* name = s + 1;
-
-  // Check if we're dealing with a long flag.
-  bool is_long = false;
-  if (s[1] == '-') {
-    is_long = true;
-
-    // Just -- is not a valid flag.
-    if (len == 2) {
-      return false;
+  const auto* s = reinterpret_cast<const unsigned char*>(text);
+  const auto* const end = s + len;
+  std::size_t width = 0;
+  while (s != end) {
+    const unsigned char lead = *s;
+    std::size_t num_continuation = 0;
+    char32_t codepoint = lead;
+    if (lead >= 0xF0 && lead < 0xF5) {
+      num_continuation = 3;
+      codepoint = lead & 0x07;
+    } else if (lead >= 0xE0 && lead < 0xF0) {
+      num_continuation = 2;
+      codepoint = lead & 0x0F;
+    } else if (lead >= 0xC2 && lead < 0xE0) {
+      num_continuation = 1;
+      codepoint = lead & 0x1F;
+    }
+    bool valid = (lead < 0x80 || num_continuation > 0)
+      && static_cast<std::size_t>(end - s) > num_continuation;
+    for (std::size_t i = 1; valid && i <= num_continuation; ++i) {
+      valid = (s[i] & 0xC0) == 0x80;
+      codepoint = (codepoint << 6) | (s[i] & 0x3F);
+    }
+    if (!valid) {
+      width += 1;
+      ++s;
+      continue;
     }
+    width += codepoint_width(codepoint);
+    s += num_continuation + 1;
+  }
+  return width;
+}
 
-    // Shift the name forward to account for the extra hyphen. This means if s
-    // was originally "--output" then name will be "output".
-    name = s + 2;
+
+/**
+ * @brief
+ * Appends the indentation, the contents without trailing whitespace and a
+ * newline to out.
+ */
+inline
+void append_wrapped_line(
+  std::size_t indentation_spaces,
+  const char* contents,
+  std::size_t len,
+  std::string& out)
+{
+  while (len > 0
+         && std::isspace(static_cast<unsigned char>(contents[len - 1]))) {
+    --len;
   }
+  out.append(indentation_spaces, ' ');
+  out.append(contents, len);
+  out += '\n';
+}
 
-  // The first character of the flag name must be alpha-numeric. This is to
-  // prevent things like "---a" from being valid flags.
-  len = std::strlen(name);
-  if (!std::isalnum(name[0])) {
-    return false;
+
+/**
+ * @brief
+ * Appends a wrapped version of a single line of text, [line, line_end), to
+ * out. The line keeps the indentation of its leading spaces and breaks at
+ * the last space before a word that would go past the wrap width. A word
+ * wider than that gets a line of its own.
+ */
+inline
+void wrap_single_line(
+  const char* line,
+  const char* line_end,
+  std::size_t wrap_width,
+  std::string& out)
+{
+  std::size_t indentation_spaces = 0;
+  while (line + indentation_spaces != line_end
+         && line[indentation_spaces] == ' ') {
+    ++indentation_spaces;
+  }
+  if (line + indentation_spaces == line_end) {
+    indentation_spaces = 0;
+  }
+  while (line != line_end && std::isspace(static_cast<unsigned char>(*line))) {
+    ++line;
   }
 
-  // If this is a short flag then it must only have one character.
-  if (!is_long && len > 1) {
-    return false;
+  // Positions are relative to the start of the text after the indentation.
+  // position is the start of the next word and line_start the start of the
+  // first word on the output line, which is width columns before position.
+  const std::size_t len = static_cast<std::size_t>(line_end - line);
+  const bool ascii = is_ascii(line, len);
+  std::size_t position = 0;
+  std::size_t line_start = 0;
+  std::size_t width = 0;
+  for (;;) {
+    const auto space = static_cast<const char*>(
+      std::memchr(line + position, ' ', len - position));
+    if (space == nullptr) {
+      break;
+    }
+    const std::size_t new_position = static_cast<std::size_t>(space - line);
+    const std::size_t word_width = ascii
+      ? new_position - position
+      : display_width(line + position, new_position - position);
+    if (width + word_width + indentation_spaces > wrap_width
+        && position > line_start) {
+      append_wrapped_line(
+        indentation_spaces, line + line_start, position - line_start - 1,
+        out);
+      line_start = position;
+      width = 0;
+    }
+    width += word_width + 1;
+    position = new_position + 1;
   }
+  append_wrapped_line(
+    indentation_spaces, line + line_start, len - line_start, out);
+}
 
-  // The rest of the characters must be alpha-numeric, but long flags are
-  // allowed to have hyphens too.
-  return std::all_of(name + 1, name + len, [&](const char& c) {
-      return std::isalnum(c) || (c == '-' && is_long);
-    });
+
+/**
+ * @brief
+ * Return a wrapped version of a single line of text.
+ */
+inline
+std::string wrap_line(const std::string& single_line,
+                      const std::size_t wrap_width)
+{
+  std::string result;
+  wrap_single_line(
+    single_line.data(), single_line.data() + single_line.size(), wrap_width,
+    result);
+  return result;
 }
 
 
 inline
-bool flag_is_short(
-  const char* s)
+void wrap_text(
+  const char* text,
+  std::size_t len,
+  std::size_t wrap_width,
+  std::string& out)
 {
-  return s[0] == '-' && std::isalnum(s[1]);
+  // Lines are split like std::getline() would, so a trailing newline
+  // doesn't make an extra empty line.
+  const char* const end = text + len;
+  while (text != end) {
+    auto line_end = static_cast<const char*>(
+      std::memchr(text, '\n', static_cast<std::size_t>(end - text)));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    wrap_single_line(text, line_end, wrap_width, out);
+    text = (line_end == end) ? end : line_end + 1;
+  }
 }
 
 
 inline
-bool parser_map::known_short_flag(
-  const char flag) const
+std::string fmt_string(const std::string& s, std::size_t wrap_width)
 {
-  return this->short_map[flag] != nullptr;
+  // Wrapping mostly replaces spaces with newlines, only adding the
+  // indentation of the wrapped lines, so this is usually enough.
+  std::string result;
+  result.reserve(s.size() + s.size() / 8 + 1);
+  wrap_text(s.data(), s.size(), wrap_width, result);
+  return result;
 }
 
 
 inline
-const definition* parser_map::get_definition_for_short_flag(
-  const char flag) const
+fmt_streambuf::fmt_streambuf(std::ostream& output, std::size_t wrap_width)
+: std::streambuf(), output(output), wrap_width(wrap_width)
 {
-  return this->short_map[flag];
 }
 
 
 inline
-bool parser_map::known_long_flag(
-  const std::string& flag) const
+fmt_streambuf::~fmt_streambuf()
 {
-  const auto existing_long_flag = this->long_map.find(flag);
-  return existing_long_flag != long_map.end();
+  this->finish();
 }
 
 
 inline
-const definition* parser_map::get_definition_for_long_flag(
-  const std::string& flag) const
+bool fmt_streambuf::finish()
 {
-  const auto existing_long_flag = this->long_map.find(flag);
-  if (existing_long_flag == long_map.end()) {
-    return nullptr;
+  if (!this->partial_line.empty()) {
+    wrap_text(
+      this->partial_line.data(), this->partial_line.size(), this->wrap_width,
+      this->wrapped);
+    this->partial_line.clear();
   }
-  return existing_long_flag->second;
+  return this->write_wrapped();
 }
 
 
 inline
-parser_map validate_definitions(
-  const std::vector<definition>& definitions)
+fmt_streambuf::int_type fmt_streambuf::overflow(int_type c)
 {
-  std::unordered_map<std::string, const definition*> long_map;
-  parser_map map {{{nullptr}}, std::move(long_map)};
+  if (traits_type::eq_int_type(c, traits_type::eof())) {
+    return traits_type::not_eof(c);
+  }
+  const char ch = traits_type::to_char_type(c);
+  return this->xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+}
 
-  for (auto& defn : definitions) {
 
-    if (defn.flags.size() == 0) {
-      std::ostringstream msg;
-      msg << "option \"" << defn.name << "\" has no flag definitions";
-      throw invalid_flag(msg.str());
+inline
+std::streamsize fmt_streambuf::xsputn(const char* s, std::streamsize n)
+{
+  // Lines that arrive whole are wrapped straight out of s. Only the start
+  // of a line that's still missing its end is copied. The wrapped lines are
+  // written out every so often so that one large write isn't held in full.
+  const std::size_t write_threshold = 64 * 1024;
+  const char* const end = s + n;
+  while (s != end) {
+    const auto newline = static_cast<const char*>(
+      std::memchr(s, '\n', static_cast<std::size_t>(end - s)));
+    if (newline == nullptr) {
+      this->partial_line.append(s, end);
+      break;
     }
+    if (this->partial_line.empty()) {
+      wrap_single_line(s, newline, this->wrap_width, this->wrapped);
+    } else {
+      this->partial_line.append(s, newline);
+      wrap_single_line(
+        this->partial_line.data(),
+        this->partial_line.data() + this->partial_line.size(),
+        this->wrap_width, this->wrapped);
+      this->partial_line.clear();
+    }
+    s = newline + 1;
+    if (this->wrapped.size() >= write_threshold && !this->write_wrapped()) {
+      return 0;
+    }
+  }
+  return this->write_wrapped() ? n : 0;
+}
 
-    for (auto& flag : defn.flags) {
 
-      if (!is_valid_flag_definition(flag.data())) {
-        std::ostringstream msg;
-        msg << "flag \"" << flag << "\" specified for option \"" << defn.name
-            << "\" is invalid";
-        throw invalid_flag(msg.str());
-      }
+inline
+int fmt_streambuf::sync()
+{
+  return (this->write_wrapped() && this->output.flush()) ? 0 : -1;
+}
 
-      if (flag_is_short(flag.data())) {
-        const int short_flag_letter = flag[1];
-        const auto existing_short_flag = map.short_map[short_flag_letter];
-        bool short_flag_already_exists = (existing_short_flag != nullptr);
-        if (short_flag_already_exists) {
-          std::ostringstream msg;
-          msg << "duplicate short flag \"" << flag
-              << "\" found, specified by both option  \"" << defn.name
-              << "\" and option \"" << existing_short_flag->name;
-          throw invalid_flag(msg.str());
-        }
-        map.short_map[short_flag_letter] = &defn;
-        continue;
-      }
 
-      // If we're here then this is a valid, long-style flag.
-      if (map.known_long_flag(flag)) {
-        const auto existing_long_flag = map.get_definition_for_long_flag(flag);
-        std::ostringstream msg;
-        msg << "duplicate long flag \"" << flag
-            << "\" found, specified by both option  \"" << defn.name
-            << "\" and option \"" << existing_long_flag->name;
-        throw invalid_flag(msg.str());
-      }
-      map.long_map.insert(std::make_pair(flag, &defn));
-    }
+inline
+bool fmt_streambuf::write_wrapped()
+{
+  if (!this->wrapped.empty()) {
+    this->output.write(
+      this->wrapped.data(),
+      static_cast<std::streamsize>(this->wrapped.size()));
+    this->wrapped.clear();
   }
+  return static_cast<bool>(this->output);
+}
 
-  return map;
+
+inline
+fmt_ostream::fmt_ostream(std::ostream& output)
+: fmt_ostream(output, 75)
+{
 }
 
 
 inline
-parser_results parser::parse(int argc, const char** argv) const
+fmt_ostream::fmt_ostream(std::ostream& output, std::size_t wrap_width)
+: std::ostream(nullptr), output(output), buffer(output, wrap_width)
 {
-  // Inspect each definition to see if its valid. You may wonder "why don't
-  // you do this validation on construction?" I had thought about it but
-  // realized that since I've made the parser an aggregate type (granted it
-  // just "aggregates" a single vector) I would need to track any changes to
-  // the definitions vector and re-run the validity check in order to
-  // maintain this expected "validity invariant" on the object. That would
-  // then require hiding the definitions vector as a private entry and then
-  // turning the parser into a thin interface (by re-exposing setters and
-  // getters) to the vector methods just so that I can catch when the
-  // definition has been modified. It seems much simpler to just enforce the
-  // validity when you actually want to parse because it's at the moment of
-  // parsing that you know the definitions are complete.
-  parser_map map = validate_definitions(this->definitions);
+  this->rdbuf(&this->buffer);
+}
 
-  // Initialize the parser results that we'll be returning. Store the program
-  // name (assumed to be the first command line argument) and initialize
-  // everything else as empty.
-  std::unordered_map<std::string, option_results> options {};
-  std::vector<const char*> pos;
-  parser_results results {argv[0], std::move(options), std::move(pos)};
 
-  // Add an empty option result for each definition.
-  for (const auto& defn : this->definitions) {
-    option_results opt_results {{}};
-    results.options.insert(
-      std::make_pair(defn.name, opt_results));
+inline
+std::uint64_t definitions_fingerprint(
+  const std::vector<definition>& definitions)
+{
+  // Like 64 bit FNV-1a but eight bytes at a time, with the high half folded
+  // back in after each multiplication since eight byte words otherwise
+  // can't affect the low bits. Hashing a byte at a time would cost about as
+  // much as rendering small help. Each string is
+  // followed by its length so that moving characters between neighbouring
+  // strings changes the hash.
+  std::uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash](std::uint64_t word) {
+      hash = (hash ^ word) * 1099511628211ull;
+      hash ^= hash >> 32;
+    };
+  auto add = [&mix](const char* data, std::size_t len) {
+      std::size_t i = 0;
+      for (; i + 8 <= len; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        mix(word);
+      }
+      std::uint64_t tail = 0;
+      std::memcpy(&tail, data + i, len - i);
+      mix(tail);
+      mix(len);
+    };
+  for (const auto& defn : definitions) {
+    add(defn.name.data(), defn.name.size());
+    for (const auto& flag : defn.flags) {
+      add(flag.data(), flag.size());
+    }
+    add(defn.help.data(), defn.help.size());
+    add(defn.group.data(), defn.group.size());
+    mix(defn.flags.size());
   }
+  mix(definitions.size());
+  return hash;
+}
 
-  // Don't start off ignoring flags. We only ignore flags after a -- shows up
-  // in the command line arguments.
-  bool ignore_flags = false;
-
-  // Keep track of any options that are expecting arguments.
-  const char* last_flag_expecting_args = nullptr;
-  option_result* last_option_expecting_args = nullptr;
-  unsigned int num_option_args_to_consume = 0;
-
-  // Get pointers to pointers so we can treat the raw pointer array as an
-  // iterator for standard library algorithms. This isn't used yet but can be
-  // used to template this function to work on iterators over strings or
-  // C-strings.
-  const char** arg_i = argv + 1;
-  const char** arg_end = argv + argc;
-
-  while (arg_i != arg_end) {
-    auto arg_i_cstr = *arg_i;
-    auto arg_i_len = std::strlen(arg_i_cstr);
-
-    // Some behavior to note: if the previous option is expecting an argument
-    // then the next entry will be treated as a positional argument even if
-    // it looks like a flag.
-    bool treat_as_positional_argument = (
-        ignore_flags
-        || num_option_args_to_consume > 0
-        || !cmd_line_arg_is_option_flag(arg_i_cstr)
-      );
-    if (treat_as_positional_argument) {
-
-      // If last option is expecting some specific positive number of
-      // arguments then give this argument to that option, *regardless of
-      // whether or not the argument looks like a flag or is the special "--"
-      // argument*.
-      if (num_option_args_to_consume > 0) {
-        last_option_expecting_args->arg = arg_i_cstr;
-        --num_option_args_to_consume;
-        ++arg_i;
-        continue;
-      }
 
-      // Now we check if this is just "--" which is a special argument that
-      // causes all following arguments to be treated as non-options and is
-      // itselve discarded.
-      if (std::strncmp(arg_i_cstr, "--", 2) == 0 && arg_i_len == 2) {
-        ignore_flags = true;
-        ++arg_i;
-        continue;
+/**
+ * @brief
+ * Appends the help of the definitions to out (see argagg::render_help()).
+ */
+inline
+void render_help_block(
+  const std::vector<const definition*>& definitions,
+  std::string& out)
+{
+  const std::size_t indent = 4;
+  const std::size_t gap = 2;
+  const std::size_t max_help_column = 30;
+  const std::size_t width = 76;
+
+  // Measure the flags of every definition first to find the help column.
+  std::vector<std::size_t> flags_widths;
+  flags_widths.reserve(definitions.size());
+  std::size_t help_column = 0;
+  std::size_t total_size = 0;
+  for (const auto defn_ptr : definitions) {
+    const auto& defn = *defn_ptr;
+    std::size_t flags_width = 0;
+    for (const auto& flag : defn.flags) {
+      flags_width += (flags_width == 0 ? 0 : 2) + flag.size();
+    }
+    flags_widths.push_back(flags_width);
+    help_column = std::max(help_column, indent + flags_width + gap);
+    total_size += indent + flags_width + defn.help.size() + 2;
+  }
+  help_column = std::min(help_column, max_help_column);
+  const std::size_t help_width = std::max<std::size_t>(
+    width > help_column ? width - help_column : 0, 20);
+
+  out.reserve(out.size() + total_size + total_size / 2);
+  for (std::size_t i = 0; i < definitions.size(); ++i) {
+    const auto& defn = *definitions[i];
+    out.append(indent, ' ');
+    for (std::size_t f = 0; f < defn.flags.size(); ++f) {
+      if (f > 0) {
+        out += ", ";
       }
+      out += defn.flags[f];
+    }
 
-      // If there are no expectations for option arguments then simply use
-      // this argument as a positional argument.
-      results.pos.push_back(arg_i_cstr);
-      ++arg_i;
+    std::size_t column = indent + flags_widths[i];
+    if (defn.help.empty()) {
+      out += '\n';
       continue;
     }
-
-    // Reset the "expecting argument" state.
-    last_flag_expecting_args = nullptr;
-    last_option_expecting_args = nullptr;
-    num_option_args_to_consume = 0;
-
-    // If we're at this point then we're definitely dealing with something
-    // that is flag-like and has hyphen as the first character and has a
-    // length of at least two characters. How we handle this potential flag
-    // depends on whether or not it is a long-option so we check that first.
-    bool is_long_flag = (arg_i_cstr[1] == '-');
-
-    if (is_long_flag) {
-
-      // Long flags have a complication: their arguments can be specified
-      // using an '=' character right inside the argument. That means an
-      // argument like "--output=foobar.txt" is actually an option with flag
-      // "--output" and argument "foobar.txt". So we look for the first
-      // instance of the '=' character and keep it in long_flag_arg. If
-      // long_flag_arg is nullptr then we didn't find '='. We need the
-      // flag_len to construct long_flag_str below.
-      auto long_flag_arg = std::strchr(arg_i_cstr, '=');
-      std::size_t flag_len = arg_i_len;
-      if (long_flag_arg != nullptr) {
-        flag_len = long_flag_arg - arg_i_cstr;
+    if (column + gap > help_column) {
+      out += '\n';
+      column = 0;
+    }
+    out.append(help_column - column, ' ');
+
+    // Greedily fill lines with the words of the help, starting a new line
+    // under the help column for every newline in the help.
+    const char* text = defn.help.data();
+    const char* const end = text + defn.help.size();
+    std::size_t line_width = 0;
+    while (text != end) {
+      if (*text == '\n') {
+        out += '\n';
+        out.append(help_column, ' ');
+        line_width = 0;
+        ++text;
+        continue;
       }
-      std::string long_flag_str(arg_i_cstr, flag_len);
-
-      if (!map.known_long_flag(long_flag_str)) {
-        std::ostringstream msg;
-        msg << "found unexpected flag: " << long_flag_str;
-        throw unexpected_option_error(msg.str());
+      if (*text == ' ') {
+        ++text;
+        continue;
       }
-
-      const auto defn = map.get_definition_for_long_flag(long_flag_str);
-
-      if (long_flag_arg != nullptr && defn->num_args == 0) {
-        std::ostringstream msg;
-        msg << "found argument for option not expecting an argument: "
-            << arg_i_cstr;
-        throw unexpected_argument_error(msg.str());
+      const char* word_end = text;
+      while (word_end != end && *word_end != ' ' && *word_end != '\n') {
+        ++word_end;
       }
-
-      // We've got a legitimate, known long flag option so we add an option
-      // result. This option result initially has an arg of nullptr, but that
-      // might change in the following block.
-      auto& opt_results = results.options[defn->name];
-      option_result opt_result {nullptr};
-      opt_results.all.push_back(std::move(opt_result));
-
-      if (defn->requires_arguments()) {
-        bool there_is_an_equal_delimited_arg = (long_flag_arg != nullptr);
-        if (there_is_an_equal_delimited_arg) {
-          // long_flag_arg would be "=foo" in the "--output=foo" case so we
-          // increment by 1 to get rid of the equal sign.
-          opt_results.all.back().arg = long_flag_arg + 1;
-        } else {
-          last_flag_expecting_args = arg_i_cstr;
-          last_option_expecting_args = &(opt_results.all.back());
-          num_option_args_to_consume = defn->num_args;
-        }
+      const std::size_t word_len = static_cast<std::size_t>(word_end - text);
+      const std::size_t word_width = display_width(text, word_len);
+      if (line_width > 0 && line_width + 1 + word_width > help_width) {
+        out += '\n';
+        out.append(help_column, ' ');
+        line_width = 0;
+      } else if (line_width > 0) {
+        out += ' ';
+        ++line_width;
       }
-
-      ++arg_i;
-      continue;
+      out.append(text, word_len);
+      line_width += word_width;
+      text = word_end;
     }
+    out += '\n';
+  }
+}
 
-    // If we've made it here then we're looking at either a short flag or a
-    // group of short flags. Short flags can be grouped together so long as
-    // they don't require any arguments unless the option that does is the
-    // last in the group ("-o x -v" is okay, "-vo x" is okay, "-ov x" is
-    // not). So starting after the dash we're going to process each character
-    // as if it were a separate flag. Note "sf_idx" stands for "short flag
-    // index".
-    for (std::size_t sf_idx = 1; sf_idx < arg_i_len; ++sf_idx) {
-      const auto short_flag = arg_i_cstr[sf_idx];
-
-      if (!std::isalnum(short_flag)) {
-        std::ostringstream msg;
-        msg << "found non-alphanumeric character '" << arg_i_cstr[sf_idx]
-            << "' in flag group '" << arg_i_cstr << "'";
-        throw std::domain_error(msg.str());
-      }
-
-      if (!map.known_short_flag(short_flag)) {
-        std::ostringstream msg;
-        msg << "found unexpected flag '" << arg_i_cstr[sf_idx]
-            << "' in flag group '" << arg_i_cstr << "'";
-        throw unexpected_option_error(msg.str());
-      }
-
-      auto defn = map.get_definition_for_short_flag(short_flag);
-      auto& opt_results = results.options[defn->name];
-
-      // Create an option result with an empty argument (for now) and add it
-      // to this option's results.
-      option_result opt_result {nullptr};
-      opt_results.all.push_back(std::move(opt_result));
-
-      if (defn->requires_arguments()) {
-
-        // If this short flag's option requires an argument and we're the
-        // last flag in the short flag group then just put the parser into
-        // "expecting argument for last option" state and move onto the next
-        // command line argument.
-        bool is_last_short_flag_in_group = (sf_idx == arg_i_len - 1);
-        if (is_last_short_flag_in_group) {
-          last_flag_expecting_args = arg_i_cstr;
-          last_option_expecting_args = &(opt_results.all.back());
-          num_option_args_to_consume = defn->num_args;
-          break;
-        }
 
-        // If this short flag's option requires an argument and we're NOT the
-        // last flag in the short flag group then we automatically consume
-        // the rest of the short flag group as the argument for this flag.
-        // This is how we get the POSIX behavior of being able to specify a
-        // flag's arguments without a white space delimiter (e.g.
-        // "-I/usr/local/include").
-        opt_results.all.back().arg = arg_i_cstr + sf_idx + 1;
-        break;
-      }
+/**
+ * @brief
+ * Splits the definitions by their help group, keeping the groups in the
+ * order of argagg::definition_groups().
+ */
+inline
+std::vector<std::pair<std::string, std::vector<const definition*>>>
+group_definitions(const std::vector<definition>& definitions)
+{
+  std::vector<std::pair<std::string, std::vector<const definition*>>> groups;
+  std::unordered_map<std::string, std::size_t> positions;
+  for (const auto& defn : definitions) {
+    const auto inserted = positions.insert(
+      std::make_pair(defn.group, groups.size()));
+    if (inserted.second) {
+      groups.push_back(std::make_pair(
+        defn.group, std::vector<const definition*>()));
     }
-
-    ++arg_i;
-    continue;
+    groups[inserted.first->second].second.push_back(&defn);
   }
-
-  // If we're done with all of the arguments but are still expecting
-  // arguments for a previous option then we haven't satisfied that option.
-  // This is an error.
-  if (num_option_args_to_consume > 0) {
-    std::ostringstream msg;
-    msg << "last option \"" << last_flag_expecting_args
-        << "\" expects an argument but the parser ran out of command line "
-        << "arguments to parse";
-    throw option_lacks_argument_error(msg.str());
+  // Definitions that aren't in a group are listed before all of the groups.
+  const auto ungrouped = positions.find(std::string());
+  if (ungrouped != positions.end() && ungrouped->second > 0) {
+    std::rotate(
+      groups.begin(), groups.begin() + ungrouped->second,
+      groups.begin() + ungrouped->second + 1);
   }
-
-  return results;
+  return groups;
 }
 
 
+/**
+ * @brief
+ * Appends the help of a group of definitions to out, under a heading unless
+ * the group is empty.
+ */
 inline
-parser_results parser::parse(int argc, char** argv) const
+void render_help_group(
+  const std::string& group,
+  const std::vector<const definition*>& definitions,
+  std::string& out)
 {
-  return parse(argc, const_cast<const char**>(argv));
+  if (!group.empty()) {
+    out += group;
+    out += ":\n";
+  }
+  render_help_block(definitions, out);
 }
 
 
-namespace convert {
-
-
-  /**
-   * @brief
-   * Templated function for conversion to T using the @ref std::strtol()
-   * function.  This is used for anything long length or shorter (long, int,
-   * short, char).
-   */
-  template <typename T> inline
-  T long_(const char* arg)
-  {
-    char* endptr = nullptr;
-    errno = 0;
-    T ret = static_cast<T>(std::strtol(arg, &endptr, 0));
-    if (endptr == arg) {
-      std::ostringstream msg;
-      msg << "unable to convert argument to integer: \"" << arg << "\"";
-      throw std::invalid_argument(msg.str());
-    }
-    if (errno == ERANGE) {
-      throw std::out_of_range("argument numeric value out of range");
+inline
+std::string render_help(const std::vector<definition>& definitions)
+{
+  std::string out;
+  for (const auto& group : group_definitions(definitions)) {
+    if (!out.empty()) {
+      out += '\n';
     }
-    return ret;
+    render_help_group(group.first, group.second, out);
   }
+  return out;
+}
 
 
-  /**
-   * @brief
-   * Templated function for conversion to T using the @ref std::strtoll()
-   * function.  This is used for anything long long length or shorter (long
-   * long).
-   */
-  template <typename T> inline
-  T long_long_(const char* arg)
-  {
-    char* endptr = nullptr;
-    errno = 0;
-    T ret = static_cast<T>(std::strtoll(arg, &endptr, 0));
-    if (endptr == arg) {
-      std::ostringstream msg;
-      msg << "unable to convert argument to integer: \"" << arg << "\"";
-      throw std::invalid_argument(msg.str());
-    }
-    if (errno == ERANGE) {
-      throw std::out_of_range("argument numeric value out of range");
+inline
+std::vector<std::string> definition_groups(
+  const std::vector<definition>& definitions)
+{
+  std::vector<std::string> names;
+  for (auto& group : group_definitions(definitions)) {
+    names.push_back(std::move(group.first));
+  }
+  return names;
+}
+
+
+inline
+std::string render_help(
+  const std::vector<definition>& definitions,
+  const std::string& group)
+{
+  std::vector<const definition*> members;
+  for (const auto& defn : definitions) {
+    if (defn.group == group) {
+      members.push_back(&defn);
     }
-    return ret;
   }
+  std::string out;
+  render_help_group(group, members, out);
+  return out;
+}
 
 
-#define DEFINE_CONVERSION_FROM_LONG_(TYPE) \
-  template <> inline \
-  TYPE arg(const char* arg) \
-  { \
-    return long_<TYPE>(arg); \
+inline
+std::string render_help_index(const std::vector<definition>& definitions)
+{
+  const auto groups = group_definitions(definitions);
+  std::size_t name_width = 0;
+  for (const auto& group : groups) {
+    name_width = std::max(name_width, display_width(
+      group.first.data(), group.first.size()));
   }
+  std::string out;
+  for (const auto& group : groups) {
+    if (group.first.empty()) {
+      continue;
+    }
+    out.append(4, ' ');
+    out += group.first;
+    out.append(
+      name_width - display_width(group.first.data(), group.first.size()) + 2,
+      ' ');
+    out += std::to_string(group.second.size());
+    out += group.second.size() == 1 ? " option\n" : " options\n";
+  }
+  return out;
+}
 
-  DEFINE_CONVERSION_FROM_LONG_(char)
-  DEFINE_CONVERSION_FROM_LONG_(unsigned char)
-  DEFINE_CONVERSION_FROM_LONG_(signed char)
-  DEFINE_CONVERSION_FROM_LONG_(short)
-  DEFINE_CONVERSION_FROM_LONG_(unsigned short)
-  DEFINE_CONVERSION_FROM_LONG_(int)
-  DEFINE_CONVERSION_FROM_LONG_(unsigned int)
-  DEFINE_CONVERSION_FROM_LONG_(long)
-  DEFINE_CONVERSION_FROM_LONG_(unsigned long)
 
-#undef DEFINE_CONVERSION_FROM_LONG_
+inline
+std::shared_ptr<const std::vector<definition>>
+parser::definitions_snapshot() const
+{
+  // Two threads may both make a copy, in which case the caches of the one
+  // whose copy is replaced are just made again.
+  auto snapshot = this->cached_definitions.load();
+  if (snapshot == nullptr || *snapshot != this->definitions) {
+    snapshot = std::make_shared<const std::vector<definition>>(
+      this->definitions);
+    this->cached_definitions.store(snapshot);
+  }
+  return snapshot;
+}
 
 
-#define DEFINE_CONVERSION_FROM_LONG_LONG_(TYPE) \
-  template <> inline \
-  TYPE arg(const char* arg) \
-  { \
-    return long_long_<TYPE>(arg); \
+inline
+std::shared_ptr<const parser_map> parser::compile() const
+{
+  const auto definitions = this->definitions_snapshot();
+  auto cached = this->cached_map.load();
+  if (cached == nullptr || cached->definitions != definitions
+      || cached->value->allow_abbreviations != this->allow_abbreviations) {
+    auto map = std::make_shared<parser_map>(validate_definitions(*definitions));
+    map->allow_abbreviations = this->allow_abbreviations;
+    cached = std::make_shared<const parser_cache_entry<parser_map>>(
+      parser_cache_entry<parser_map> {definitions, std::move(map)});
+    this->cached_map.store(cached);
   }
+  return std::shared_ptr<const parser_map>(cached, cached->value.get());
+}
 
-  DEFINE_CONVERSION_FROM_LONG_LONG_(long long)
-  DEFINE_CONVERSION_FROM_LONG_LONG_(unsigned long long)
 
-#undef DEFINE_CONVERSION_FROM_LONG_LONG_
+inline
+std::shared_ptr<const parser_help> parser::help() const
+{
+  // The cache is replaced as a whole so that other threads printing the
+  // help at the same time keep using the help they loaded.
+  const auto definitions = this->definitions_snapshot();
+  auto cached = this->cached_help.load();
+  if (cached == nullptr || cached->definitions != definitions) {
+    cached = std::make_shared<const parser_cache_entry<parser_help>>(
+      parser_cache_entry<parser_help> {
+        definitions, std::make_shared<parser_help>(parser_help {
+          definitions_fingerprint(*definitions),
+          render_help(*definitions)})});
+    this->cached_help.store(cached);
+  }
+  return cached->value;
+}
 
 
-  template <typename T>
-  T arg(const char* arg)
-  {
-    return converter<T>::convert(arg);
+/**
+ * @brief
+ * Returns the help groups cached for the definitions, finding them and
+ * rendering their index first if the cache was made from other
+ * definitions.
+ */
+inline
+std::shared_ptr<const parser_cache_entry<parser_help_groups>>
+load_help_groups(
+  atomic_shared_ptr<const parser_cache_entry<parser_help_groups>>& cache,
+  const std::shared_ptr<const std::vector<definition>>& definitions)
+{
+  auto cached = cache.load();
+  if (cached == nullptr || cached->definitions != definitions) {
+    const std::uint64_t fingerprint = definitions_fingerprint(*definitions);
+    auto groups = std::make_shared<parser_help_groups>();
+    groups->fingerprint = fingerprint;
+    groups->names = definition_groups(*definitions);
+    groups->index = std::make_shared<const parser_help>(
+      parser_help {fingerprint, render_help_index(*definitions)});
+    cached = std::make_shared<const parser_cache_entry<parser_help_groups>>(
+      parser_cache_entry<parser_help_groups> {definitions, std::move(groups)});
+    cache.store(cached);
   }
+  return cached;
+}
 
 
-  template <> inline
-  bool arg(const char* arg)
-  {
-    return argagg::convert::arg<int>(arg) != 0;
+inline
+std::shared_ptr<const parser_help> parser::help(const std::string& group) const
+{
+  const auto definitions = this->definitions_snapshot();
+  const auto groups =
+    load_help_groups(this->cached_help_groups, definitions)->value;
+  const auto rendered = groups->rendered.find(group);
+  if (rendered != groups->rendered.end()) {
+    return rendered->second;
+  }
+  if (std::find(groups->names.begin(), groups->names.end(), group)
+      == groups->names.end()) {
+    return nullptr;
   }
 
+  // The groups are copied to add the new one so that other threads keep
+  // using the ones they loaded. If two threads render groups at the same
+  // time one of them may be lost, which just means it's rendered again.
+  auto help = std::make_shared<const parser_help>(
+    parser_help {groups->fingerprint, render_help(*definitions, group)});
+  auto updated = std::make_shared<parser_help_groups>(*groups);
+  updated->rendered[group] = help;
+  this->cached_help_groups.store(
+    std::make_shared<const parser_cache_entry<parser_help_groups>>(
+      parser_cache_entry<parser_help_groups> {
+        definitions, std::move(updated)}));
+  return help;
+}
 
-  template <> inline
-  float arg(const char* arg)
-  {
-    char* endptr = nullptr;
-    errno = 0;
-    float ret = std::strtof(arg, &endptr);
-    if (endptr == arg) {
-      std::ostringstream msg;
-      msg << "unable to convert argument to integer: \"" << arg << "\"";
-      throw std::invalid_argument(msg.str());
+
+inline
+std::shared_ptr<const parser_help> parser::help_index() const
+{
+  return this->help_groups()->index;
+}
+
+
+inline
+std::shared_ptr<const parser_help_groups> parser::help_groups() const
+{
+  return load_help_groups(
+    this->cached_help_groups, this->definitions_snapshot())->value;
+}
+
+
+/**
+ * @brief
+ * Escapes text for roff. Backslashes are written as \e and lines that start
+ * with a control character are guarded with \&. Hyphens are escaped when
+ * escape_hyphens is set so that flags render as minus signs that can be
+ * copied from the page.
+ */
+inline
+std::string roff_escape(const std::string& text, bool escape_hyphens)
+{
+  std::string out;
+  out.reserve(text.size() + text.size() / 8);
+  bool line_start = true;
+  for (const char c : text) {
+    if (line_start && (c == '.' || c == '\'')) {
+      out += "\\&";
     }
-    if (errno == ERANGE) {
-      throw std::out_of_range("argument numeric value out of range");
+    if (c == '\\') {
+      out += "\\e";
+    } else if (c == '-' && escape_hyphens) {
+      out += "\\-";
+    } else {
+      out += c;
     }
-    return ret;
+    line_start = (c == '\n');
   }
+  return out;
+}
 
 
-  template <> inline
-  double arg(const char* arg)
-  {
-    char* endptr = nullptr;
-    errno = 0;
-    double ret = std::strtod(arg, &endptr);
-    if (endptr == arg) {
-      std::ostringstream msg;
-      msg << "unable to convert argument to integer: \"" << arg << "\"";
-      throw std::invalid_argument(msg.str());
-    }
-    if (errno == ERANGE) {
-      throw std::out_of_range("argument numeric value out of range");
+/**
+ * @brief
+ * Escapes the characters of text that markdown would treat as formatting.
+ */
+inline
+std::string markdown_escape(const std::string& text)
+{
+  std::string out;
+  out.reserve(text.size() + text.size() / 8);
+  for (const char c : text) {
+    if (c != '\0' && std::strchr("\\`*_[]<", c) != nullptr) {
+      out += '\\';
     }
-    return ret;
+    out += c;
   }
+  return out;
+}
 
 
-  template <> inline
-  const char* arg(const char* arg)
-  {
-    return arg;
+/**
+ * @brief
+ * Splits text into its lines like std::getline() would.
+ */
+inline
+std::vector<std::string> split_lines(const std::string& text)
+{
+  std::vector<std::string> lines;
+  std::istringstream in(text);
+  std::string line;
+  while (std::getline(in, line)) {
+    lines.push_back(line);
   }
+  return lines;
+}
 
 
-  template <> inline
-  std::string arg(const char* arg)
-  {
-    return std::string(arg);
+inline
+void write_man_page(
+  std::ostream& out,
+  const documentation& doc,
+  const parser& argparser)
+{
+  std::string title = doc.name;
+  for (auto& c : title) {
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  }
+  out << ".\\\" Generated by argagg, do not edit.\n"
+      << ".TH \"" << roff_escape(title, false) << "\" \""
+      << roff_escape(doc.section, false) << "\"\n"
+      << ".SH NAME\n"
+      << roff_escape(doc.name, true);
+  if (!doc.summary.empty()) {
+    out << " \\- " << roff_escape(doc.summary, false);
+  }
+  out << "\n.SH SYNOPSIS\n"
+      << ".B " << roff_escape(doc.name, true) << '\n';
+  if (!doc.synopsis.empty()) {
+    out << roff_escape(doc.synopsis, true) << '\n';
   }
 
-
-  template <typename T>
-  bool parse_next_component(
-    const char*& s,
-    T& out_arg,
-    const char delim)
-  {
-    const char* begin = s;
-    s = std::strchr(s, delim);
-    if (s == nullptr) {
-      std::string arg_str(begin);
-      out_arg = argagg::convert::arg<T>(arg_str.c_str());
-      return false;
-    } else {
-      std::string arg_str(begin, s - begin);
-      out_arg = argagg::convert::arg<T>(arg_str.c_str());
-      s += 1;
-      return true;
+  // Blank lines separate the paragraphs of the description. The other
+  // newlines are left for roff to fill.
+  if (!doc.description.empty()) {
+    out << ".SH DESCRIPTION\n";
+    bool paragraph = false;
+    for (const auto& line : split_lines(doc.description)) {
+      if (line.empty()) {
+        paragraph = true;
+        continue;
+      }
+      if (paragraph) {
+        out << ".PP\n";
+        paragraph = false;
+      }
+      out << roff_escape(line, false) << '\n';
     }
   }
 
-
-} // namespace convert
+  // Help groups become subsections. Newlines in the help of an option are
+  // kept as line breaks like argagg::render_help() does.
+  if (!argparser.definitions.empty()) {
+    out << ".SH OPTIONS\n";
+  }
+  for (const auto& group : group_definitions(argparser.definitions)) {
+    if (!group.first.empty()) {
+      out << ".SS " << roff_escape(group.first, false) << '\n';
+    }
+    for (const auto defn : group.second) {
+      out << ".TP\n";
+      for (std::size_t f = 0; f < defn->flags.size(); ++f) {
+        out << (f > 0 ? ", " : "") << "\\fB"
+            << roff_escape(defn->flags[f], true) << "\\fR";
+      }
+      out << '\n';
+      bool first = true;
+      for (const auto& line : split_lines(defn->help)) {
+        out << (first ? "" : ".br\n") << roff_escape(line, false) << '\n';
+        first = false;
+      }
+    }
+  }
+}
 
 
 inline
-fmt_ostream::fmt_ostream(std::ostream& output)
-: std::ostringstream(), output(output)
+void write_markdown(
+  std::ostream& out,
+  const documentation& doc,
+  const parser& argparser)
 {
+  out << "# " << markdown_escape(doc.name) << '(' << doc.section << ")\n\n";
+  if (!doc.summary.empty()) {
+    out << markdown_escape(doc.summary) << "\n\n";
+  }
+  out << "## Synopsis\n\n"
+      << "```\n"
+      << doc.name << (doc.synopsis.empty() ? "" : " ") << doc.synopsis
+      << "\n```\n";
+  if (!doc.description.empty()) {
+    out << "\n## Description\n\n" << markdown_escape(doc.description);
+    if (doc.description.back() != '\n') {
+      out << '\n';
+    }
+  }
+  if (!argparser.definitions.empty()) {
+    out << "\n## Options\n";
+  }
+  for (const auto& group : group_definitions(argparser.definitions)) {
+    if (!group.first.empty()) {
+      out << "\n### " << markdown_escape(group.first) << '\n';
+    }
+    out << '\n';
+    for (const auto defn : group.second) {
+      out << "- ";
+      for (std::size_t f = 0; f < defn->flags.size(); ++f) {
+        out << (f > 0 ? ", " : "") << '`' << defn->flags[f] << '`';
+      }
+      // Continuation lines are indented to stay inside the list item.
+      const char* separator = ": ";
+      for (const auto& line : split_lines(defn->help)) {
+        out << separator << markdown_escape(line);
+        separator = "  \n  ";
+      }
+      out << '\n';
+    }
+  }
 }
 
 
 inline
-fmt_ostream::~fmt_ostream()
+std::string render_usage_and_help(
+  const documentation& doc,
+  const parser& argparser)
 {
-  output << fmt_string(this->str());
+  std::string usage = "Usage: " + doc.name;
+  if (!doc.synopsis.empty()) {
+    usage += ' ' + doc.synopsis;
+  }
+  return fmt_string(usage) + argparser.help()->text;
 }
 
 
 inline
-std::string lstrip(const std::string& text)
+void write_help_source(
+  std::ostream& out,
+  const std::string& symbol,
+  const std::string& text)
 {
-  auto result = text;
-
-  result.erase(
-    result.begin(),
-    std::find_if(
-      result.begin(),
-      result.end(),
-      [](int ch) { return !std::isspace(ch); }));
+  if (symbol.empty()
+      || std::isdigit(static_cast<unsigned char>(symbol.front()))
+      || std::find_if(symbol.begin(), symbol.end(), [](char c) {
+             return !std::isalnum(static_cast<unsigned char>(c)) && c != '_';
+           }) != symbol.end()) {
+    throw std::invalid_argument(
+      "help symbol \"" + symbol + "\" is not a C++ identifier");
+  }
 
-  return result;
+  out << "// Generated by argagg, do not edit.\n"
+      << "#include <cstddef>\n\n"
+      << "extern const char " << symbol << "[];\n"
+      << "extern const std::size_t " << symbol << "_size;\n\n"
+      << "const char " << symbol << "[] =\n";
+
+  // Each line of the text gets a string literal of its own. Bytes that
+  // aren't printable ASCII are written as octal escapes, which unlike hex
+  // escapes can't run into the characters after them, and question marks
+  // are escaped so they can't form trigraphs.
+  static const char digits[] = "01234567";
+  out << "  \"";
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    const auto c = static_cast<unsigned char>(text[i]);
+    if (c == '\n') {
+      out << "\\n\"";
+      if (i + 1 < text.size()) {
+        out << "\n  \"";
+      }
+      continue;
+    }
+    if (c == '"' || c == '\\' || c == '?') {
+      out << '\\' << static_cast<char>(c);
+    } else if (c < 0x20 || c >= 0x7f) {
+      out << '\\' << digits[c >> 6] << digits[(c >> 3) & 7] << digits[c & 7];
+    } else {
+      out << static_cast<char>(c);
+    }
+  }
+  if (text.empty() || text.back() != '\n') {
+    out << '"';
+  }
+  out << ";\n\n"
+      << "const std::size_t " << symbol << "_size = sizeof(" << symbol
+      << ") - 1;\n";
 }
 
 
 inline
-std::string rstrip(const std::string& text)
+int generate_documentation(
+  int argc,
+  const char** argv,
+  const documentation& doc,
+  const parser& argparser,
+  std::ostream& err)
 {
-  auto result = text;
+  parser generator {{
+      {"help", {"-h", "--help"}, "shows this help message", 0},
+      {"man", {"--man"}, "writes a roff man page to the file", 1},
+      {"markdown", {"--markdown"}, "writes a markdown page to the file", 1},
+      {"help_source", {"--help-source"},
+        "writes a C++ source file defining the rendered help to the file", 1},
+      {"symbol", {"--symbol"},
+        "name of the rendered help array (default: <program>_help)", 1},
+      {"man_section", {"--man-section"},
+        "overrides the manual section of the documentation", 1},
+    }};
+
+  parser_results args;
+  try {
+    args = generator.parse(argc, argv);
+  } catch (const std::exception& e) {
+    err << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+  if (args["help"]) {
+    err << "Usage: " << (argc > 0 ? argv[0] : "generator")
+        << " [options]\n" << generator;
+    return EXIT_SUCCESS;
+  }
 
-  result.erase(
-    std::find_if(
-      result.rbegin(),
-      result.rend(),
-      [](int ch) { return !std::isspace(ch); }).base(),
-    result.end());
+  documentation page = doc;
+  if (args["man_section"]) {
+    page.section = args["man_section"].as<std::string>();
+  }
+  std::string symbol;
+  for (const char c : page.name) {
+    symbol += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+  }
+  symbol = args["symbol"].as<std::string>(symbol + "_help");
 
-  return result;
+  auto write_file = [&err](
+      const option_results& option,
+      const std::function<void(std::ostream&)>& writer) {
+      if (!option) {
+        return true;
+      }
+      const std::string path = option.as<std::string>();
+      std::ofstream out(path, std::ios::binary);
+      if (out) {
+        writer(out);
+        out.flush();
+      }
+      if (!out) {
+        err << "unable to write " << path << '\n';
+        return false;
+      }
+      return true;
+    };
+  try {
+    const bool written =
+      write_file(args["man"], [&](std::ostream& out) {
+          write_man_page(out, page, argparser);
+        })
+      && write_file(args["markdown"], [&](std::ostream& out) {
+          write_markdown(out, page, argparser);
+        })
+      && write_file(args["help_source"], [&](std::ostream& out) {
+          write_help_source(
+            out, symbol, render_usage_and_help(page, argparser));
+        });
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+  } catch (const std::exception& e) {
+    err << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
 }
 
 
-inline
-std::string construct_line(const std::string& indent,
-                           const std::string& contents)
+/**
+ * @brief
+ * Calls f with the offset and length of each word of the text.
+ */
+template <typename F>
+void for_each_help_word(const std::string& text, F f)
 {
-  return indent + rstrip(contents) + "\n";
+  auto is_word_char = [](char c) {
+      const auto u = static_cast<unsigned char>(c);
+      return u >= 0x80 || std::isalnum(u);
+    };
+  std::size_t i = 0;
+  while (i < text.size()) {
+    if (!is_word_char(text[i])) {
+      ++i;
+      continue;
+    }
+    const std::size_t start = i;
+    while (i < text.size() && is_word_char(text[i])) {
+      ++i;
+    }
+    f(start, i - start);
+  }
 }
 
 
 /**
  * @brief
- * Return a wrapped version of a single line of text.
+ * Compares a lower case term to a lower case word like
+ * std::string::compare() does, but only up to the length of the word when
+ * prefix is set so that all of the terms starting with it compare equal.
  */
 inline
-std::string wrap_line(const std::string& single_line,
-                      const std::size_t wrap_width)
+int compare_help_word(
+  const char* text,
+  std::size_t len,
+  const std::string& word,
+  bool prefix)
 {
-  auto indentation_spaces = single_line.find_first_not_of(" ");
-  if (indentation_spaces == std::string::npos) {
-    indentation_spaces = 0;
+  const std::size_t n = std::min(len, word.size());
+  const int c = (n == 0) ? 0 : std::memcmp(text, word.data(), n);
+  if (c != 0) {
+    return c < 0 ? -1 : 1;
   }
+  if (len == word.size() || (prefix && len > word.size())) {
+    return 0;
+  }
+  return len < word.size() ? -1 : 1;
+}
 
-  const auto line = lstrip(single_line);
-  const auto indent = std::string(indentation_spaces, ' ');
-
-  std::string result;
 
-  std::size_t position = 0;
-  std::size_t line_start = 0;
-  while (true) {
-    const auto new_position = line.find_first_of(" ", position);
-    if (new_position == std::string::npos) {
-      break;
+inline
+help_search_index build_help_search_index(
+  const std::vector<definition>& definitions)
+{
+  // Every occurrence of a word is collected with a lower case copy of it so
+  // that they can be sorted. Each distinct word is then copied once into
+  // the text of the index.
+  struct occurrence {
+    std::string word;
+    std::uint32_t definition;
+    std::uint32_t weight;
+  };
+  std::vector<occurrence> occurrences;
+  for (std::size_t d = 0; d < definitions.size(); ++d) {
+    const auto& defn = definitions[d];
+    auto add = [&](const std::string& text, std::uint32_t weight) {
+        for_each_help_word(text, [&](std::size_t offset, std::size_t len) {
+            occurrence o {
+              text.substr(offset, len), static_cast<std::uint32_t>(d),
+              weight};
+            for (auto& c : o.word) {
+              c = static_cast<char>(
+                std::tolower(static_cast<unsigned char>(c)));
+            }
+            occurrences.push_back(std::move(o));
+          });
+      };
+    add(defn.name, 4);
+    add(defn.help, 1);
+    for (const auto& flag : defn.flags) {
+      add(flag, 4);
+    }
+  }
+  std::sort(occurrences.begin(), occurrences.end(),
+            [](const occurrence& a, const occurrence& b) {
+              const int c = a.word.compare(b.word);
+              return c < 0 || (c == 0 && a.definition < b.definition);
+            });
+
+  help_search_index index;
+  for (std::size_t i = 0; i < occurrences.size(); ++i) {
+    const auto& o = occurrences[i];
+    const bool new_term = (i == 0 || o.word != occurrences[i - 1].word);
+    if (new_term) {
+      index.terms.push_back({
+        static_cast<std::uint32_t>(index.text.size()),
+        static_cast<std::uint32_t>(o.word.size()),
+        static_cast<std::uint32_t>(index.postings.size())});
+      index.text += o.word;
     }
+    if (new_term || index.postings.back().definition != o.definition) {
+      index.postings.push_back({o.definition, o.weight});
+    } else {
+      index.postings.back().weight += o.weight;
+    }
+  }
+  index.text.shrink_to_fit();
+  index.terms.shrink_to_fit();
+  index.postings.shrink_to_fit();
+  return index;
+}
 
-    if (new_position + indentation_spaces > line_start + wrap_width) {
-      result += construct_line(
-        indent, line.substr(line_start, position - line_start - 1));
 
-      line_start = position;
-    }
+inline
+std::vector<help_match> search_help(
+  const help_search_index& index,
+  const std::vector<definition>& definitions,
+  const std::string& query)
+{
+  std::vector<std::string> words;
+  for_each_help_word(query, [&](std::size_t offset, std::size_t len) {
+      std::string word = query.substr(offset, len);
+      for (auto& c : word) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+      }
+      if (std::find(words.begin(), words.end(), word) == words.end()) {
+        words.push_back(std::move(word));
+      }
+    });
 
-    position = new_position + 1;
+  // Matches are accumulated by definition index and last_word makes sure a
+  // query word that's a prefix of several terms of a definition only counts
+  // once towards matched_words.
+  std::vector<help_match> matches(definitions.size(), help_match {
+    nullptr, 0, 0});
+  std::vector<std::size_t> last_word(definitions.size(), 0);
+  for (std::size_t w = 0; w < words.size(); ++w) {
+    const auto& word = words[w];
+    auto compare = [&](const help_search_term& term, bool prefix) {
+        return compare_help_word(
+          index.text.data() + term.offset, term.length, word, prefix);
+      };
+    auto term = std::lower_bound(
+      index.terms.begin(), index.terms.end(), word,
+      [&](const help_search_term& t, const std::string&) {
+        return compare(t, false) < 0;
+      });
+    for (; term != index.terms.end() && compare(*term, true) == 0; ++term) {
+      const bool exact = (term->length == word.size());
+      const auto first = index.postings.begin() + term->first_posting;
+      const auto last = (term + 1 == index.terms.end())
+        ? index.postings.end()
+        : index.postings.begin() + (term + 1)->first_posting;
+      for (auto posting = first; posting != last; ++posting) {
+        if (posting->definition >= definitions.size()) {
+          continue;
+        }
+        auto& match = matches[posting->definition];
+        match.option = &definitions[posting->definition];
+        match.score += posting->weight * (exact ? 2 : 1);
+        if (last_word[posting->definition] != w + 1) {
+          last_word[posting->definition] = w + 1;
+          ++match.matched_words;
+        }
+      }
+    }
   }
 
-  return result + construct_line(indent, line.substr(line_start));
+  matches.erase(
+    std::remove_if(matches.begin(), matches.end(), [](const help_match& m) {
+        return m.option == nullptr;
+      }),
+    matches.end());
+  std::stable_sort(matches.begin(), matches.end(),
+                   [](const help_match& a, const help_match& b) {
+                     return a.matched_words != b.matched_words
+                       ? a.matched_words > b.matched_words
+                       : a.score > b.score;
+                   });
+  return matches;
 }
 
 
 inline
-std::string fmt_string(const std::string& s)
+std::string render_help_matches(const std::vector<help_match>& matches)
 {
-  std::stringstream ss(s);
-  std::string line;
+  std::vector<const definition*> definitions;
+  definitions.reserve(matches.size());
+  for (const auto& match : matches) {
+    definitions.push_back(match.option);
+  }
+  std::string out;
+  render_help_block(definitions, out);
+  return out;
+}
 
-  std::string result;
 
-  // Use default width of `fmt`.
-  const auto column_width = 75;
+inline
+std::vector<help_match> parser::search_help(const std::string& query) const
+{
+  return argagg::search_help(
+    *this->help_search_index(), this->definitions, query);
+}
+
 
-  while (std::getline(ss, line, '\n')) {
-    result += wrap_line(line, column_width);
+inline
+std::shared_ptr<const argagg::help_search_index>
+parser::help_search_index() const
+{
+  const auto definitions = this->definitions_snapshot();
+  auto cached = this->cached_search_index.load();
+  if (cached == nullptr || cached->definitions != definitions) {
+    cached = std::make_shared<
+      const parser_cache_entry<argagg::help_search_index>>(
+        parser_cache_entry<argagg::help_search_index> {
+          definitions, std::make_shared<const argagg::help_search_index>(
+            build_help_search_index(*definitions))});
+    this->cached_search_index.store(cached);
   }
-
-  return result;
+  return cached->value;
 }
 
 
@@ -1690,17 +7269,9 @@ std::string fmt_string(const std::string& s)
 inline
 std::ostream& operator << (std::ostream& os, const argagg::parser& x)
 {
-  for (auto& definition : x.definitions) {
-    os << "    ";
-    for (auto& flag : definition.flags) {
-      os << flag;
-      if (flag != definition.flags.back()) {
-        os << ", ";
-      }
-    }
-    os << "\n        " << definition.help << '\n';
-  }
-  return os;
+  const auto help = x.help();
+  return os.write(
+    help->text.data(), static_cast<std::streamsize>(help->text.size()));
 }
 
 
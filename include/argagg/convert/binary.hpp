@@ -0,0 +1,420 @@
+/*
+ * @file
+ * @brief
+ * Defines the argagg::hex and argagg::base64 types and argument conversion
+ * specializations that decode hexadecimal and base64 arguments into bytes.
+ *
+ * @copyright
+ * Copyright (c) 2018 Viet The Nguyen
+ *
+ * @copyright
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * @copyright
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * @copyright
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#pragma once
+#ifndef ARGAGG_ARGAGG_CONVERT_BINARY_HPP
+#define ARGAGG_ARGAGG_CONVERT_BINARY_HPP
+
+#include "../argagg.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ARGAGG_CONVERT_BINARY_SSE2 1
+#endif
+
+
+namespace argagg {
+
+/**
+ * @brief
+ * Represents a byte string given on the command line as hexadecimal digits
+ * (e.g. "deadBEEF"). Upper and lower case digits are accepted. The Container
+ * is either an std::vector<std::uint8_t>, which is sized to fit the argument,
+ * or an std::array<std::uint8_t, N>, which requires the argument to decode to
+ * exactly N bytes.
+ */
+template <typename Container = std::vector<std::uint8_t>>
+struct hex {
+  Container bytes;
+};
+
+/**
+ * @brief
+ * Represents a byte string given on the command line as base64 using the
+ * standard alphabet of RFC 4648 (e.g. "3q2+7w=="). Trailing padding is
+ * optional. The Container is either an std::vector<std::uint8_t>, which is
+ * sized to fit the argument, or an std::array<std::uint8_t, N>, which
+ * requires the argument to decode to exactly N bytes.
+ */
+template <typename Container = std::vector<std::uint8_t>>
+struct base64 {
+  Container bytes;
+};
+
+namespace convert {
+
+  /**
+   * @brief
+   * Returns the number of bytes the given hexadecimal string decodes to.
+   * Throws an std::invalid_argument if there's an odd number of digits.
+   */
+  std::size_t hex_decoded_size(const char* s, std::size_t len);
+
+  /**
+   * @brief
+   * Decodes len hexadecimal digits from s into out, which must have room for
+   * hex_decoded_size() bytes. Sixteen digits are validated and decoded at a
+   * time with SSE2 when it's available. Throws an std::invalid_argument
+   * naming the first character that isn't a hexadecimal digit.
+   */
+  void hex_decode(const char* s, std::size_t len, std::uint8_t* out);
+
+  /**
+   * @brief
+   * Returns the number of bytes the given base64 string decodes to. Throws an
+   * std::invalid_argument if the length or padding is invalid.
+   */
+  std::size_t base64_decoded_size(const char* s, std::size_t len);
+
+  /**
+   * @brief
+   * Decodes the base64 string s of length len (including any padding) into
+   * out, which must have room for base64_decoded_size() bytes. Throws an
+   * std::invalid_argument naming the first character that isn't part of the
+   * base64 alphabet.
+   */
+  void base64_decode(const char* s, std::size_t len, std::uint8_t* out);
+
+  /**
+   * @brief
+   * Specializes @ref argagg::convert::converter for @ref argagg::hex of
+   * an std::vector.
+   */
+  template <>
+  struct converter<hex<std::vector<std::uint8_t>>> {
+    static hex<std::vector<std::uint8_t>> convert(const char* s);
+  };
+
+  /**
+   * @brief
+   * Partially specializes @ref argagg::convert::converter for @ref
+   * argagg::hex of an std::array.
+   */
+  template <std::size_t N>
+  struct converter<hex<std::array<std::uint8_t, N>>> {
+    static hex<std::array<std::uint8_t, N>> convert(const char* s);
+  };
+
+  /**
+   * @brief
+   * Specializes @ref argagg::convert::converter for @ref argagg::base64 of
+   * an std::vector.
+   */
+  template <>
+  struct converter<base64<std::vector<std::uint8_t>>> {
+    static base64<std::vector<std::uint8_t>> convert(const char* s);
+  };
+
+  /**
+   * @brief
+   * Partially specializes @ref argagg::convert::converter for @ref
+   * argagg::base64 of an std::array.
+   */
+  template <std::size_t N>
+  struct converter<base64<std::array<std::uint8_t, N>>> {
+    static base64<std::array<std::uint8_t, N>> convert(const char* s);
+  };
+
+} // namespace convert
+
+} // namespace argagg
+
+
+// ---- end of declarations, header-only implementations follow ----
+
+
+namespace argagg {
+namespace convert {
+
+
+/**
+ * @brief
+ * Returns the value of a single hexadecimal digit or -1 if c isn't one.
+ */
+inline
+int hex_digit_value(const char c)
+{
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+
+/**
+ * @brief
+ * Returns the value of a single base64 character or -1 if c isn't part of
+ * the alphabet.
+ */
+inline
+int base64_digit_value(const char c)
+{
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  }
+  if (c == '+') {
+    return 62;
+  }
+  if (c == '/') {
+    return 63;
+  }
+  return -1;
+}
+
+
+/**
+ * @brief
+ * Throws the std::invalid_argument for an invalid character in an encoded
+ * byte string.
+ */
+inline
+void throw_invalid_encoded_character(
+  const char* encoding,
+  const char* s,
+  std::size_t offset)
+{
+  std::ostringstream msg;
+  msg << "invalid " << encoding << " character '" << s[offset]
+      << "' at offset " << offset;
+  throw std::invalid_argument(msg.str());
+}
+
+
+inline
+std::size_t hex_decoded_size(const char* /* s */, std::size_t len)
+{
+  if (len % 2 != 0) {
+    std::ostringstream msg;
+    msg << "hex argument has an odd number of digits (" << len << ")";
+    throw std::invalid_argument(msg.str());
+  }
+  return len / 2;
+}
+
+
+inline
+void hex_decode(const char* s, std::size_t len, std::uint8_t* out)
+{
+  std::size_t i = 0;
+
+#ifdef ARGAGG_CONVERT_BINARY_SSE2
+  // SSE2 only has signed byte comparisons so ranges are checked by shifting
+  // the start of the range to -128 and comparing against -128 plus the size
+  // of the range.
+  const __m128i digit_offset = _mm_set1_epi8(static_cast<char>('0' + 128));
+  const __m128i digit_limit = _mm_set1_epi8(static_cast<char>(-128 + 10));
+  const __m128i alpha_offset = _mm_set1_epi8(static_cast<char>('a' + 128));
+  const __m128i alpha_limit = _mm_set1_epi8(static_cast<char>(-128 + 6));
+  const __m128i lower_case = _mm_set1_epi8(0x20);
+  const __m128i ascii_zero = _mm_set1_epi8('0');
+  const __m128i alpha_base = _mm_set1_epi8('a' - 10);
+  const __m128i low_byte = _mm_set1_epi16(0x00ff);
+  for (; i + 16 <= len; i += 16) {
+    const __m128i chars =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    const __m128i folded = _mm_or_si128(chars, lower_case);
+    const __m128i is_digit = _mm_cmplt_epi8(
+      _mm_sub_epi8(chars, digit_offset), digit_limit);
+    const __m128i is_alpha = _mm_cmplt_epi8(
+      _mm_sub_epi8(folded, alpha_offset), alpha_limit);
+    if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xffff) {
+      // Let the scalar loop find and report the invalid character.
+      break;
+    }
+    const __m128i nibbles = _mm_or_si128(
+      _mm_and_si128(is_digit, _mm_sub_epi8(chars, ascii_zero)),
+      _mm_andnot_si128(is_digit, _mm_sub_epi8(folded, alpha_base)));
+    // Each 16-bit lane holds a high nibble in its low byte and a low nibble
+    // in its high byte.
+    const __m128i bytes = _mm_or_si128(
+      _mm_slli_epi16(_mm_and_si128(nibbles, low_byte), 4),
+      _mm_srli_epi16(nibbles, 8));
+    _mm_storel_epi64(
+      reinterpret_cast<__m128i*>(out + i / 2), _mm_packus_epi16(bytes, bytes));
+  }
+#endif
+
+  for (; i + 1 < len; i += 2) {
+    const int high = hex_digit_value(s[i]);
+    if (high < 0) {
+      throw_invalid_encoded_character("hex", s, i);
+    }
+    const int low = hex_digit_value(s[i + 1]);
+    if (low < 0) {
+      throw_invalid_encoded_character("hex", s, i + 1);
+    }
+    out[i / 2] = static_cast<std::uint8_t>((high << 4) | low);
+  }
+}
+
+
+inline
+std::size_t base64_decoded_size(const char* s, std::size_t len)
+{
+  std::size_t padding = 0;
+  while (padding < len && padding < 2 && s[len - 1 - padding] == '=') {
+    ++padding;
+  }
+  if ((padding > 0 && len % 4 != 0) || (len - padding) % 4 == 1) {
+    std::ostringstream msg;
+    msg << "base64 argument has an invalid length (" << len << ")";
+    throw std::invalid_argument(msg.str());
+  }
+  const std::size_t data_len = len - padding;
+  const std::size_t tail = data_len % 4;
+  return (data_len / 4) * 3 + (tail > 0 ? tail - 1 : 0);
+}
+
+
+inline
+void base64_decode(const char* s, std::size_t len, std::uint8_t* out)
+{
+  std::size_t padding = 0;
+  while (padding < len && padding < 2 && s[len - 1 - padding] == '=') {
+    ++padding;
+  }
+  len -= padding;
+
+  // Every four characters make three bytes. A trailing group of two or three
+  // characters makes one or two bytes.
+  std::uint32_t bits = 0;
+  int num_bits = 0;
+  for (std::size_t i = 0; i < len; ++i) {
+    const int value = base64_digit_value(s[i]);
+    if (value < 0) {
+      throw_invalid_encoded_character("base64", s, i);
+    }
+    bits = (bits << 6) | static_cast<std::uint32_t>(value);
+    num_bits += 6;
+    if (num_bits >= 8) {
+      num_bits -= 8;
+      *out++ = static_cast<std::uint8_t>(bits >> num_bits);
+    }
+  }
+}
+
+
+/**
+ * @brief
+ * Throws the std::invalid_argument for an encoded argument that doesn't
+ * decode to the size of a fixed size std::array.
+ */
+inline
+void throw_decoded_size_mismatch(
+  const char* encoding,
+  std::size_t expected,
+  std::size_t actual)
+{
+  std::ostringstream msg;
+  msg << "expected " << expected << " bytes but " << encoding
+      << " argument decodes to " << actual << " bytes";
+  throw std::invalid_argument(msg.str());
+}
+
+
+inline
+hex<std::vector<std::uint8_t>>
+converter<hex<std::vector<std::uint8_t>>>::convert(const char* s)
+{
+  const std::size_t len = std::strlen(s);
+  hex<std::vector<std::uint8_t>> result {
+    std::vector<std::uint8_t>(hex_decoded_size(s, len))};
+  hex_decode(s, len, result.bytes.data());
+  return result;
+}
+
+
+template <std::size_t N>
+hex<std::array<std::uint8_t, N>>
+converter<hex<std::array<std::uint8_t, N>>>::convert(const char* s)
+{
+  const std::size_t len = std::strlen(s);
+  const std::size_t size = hex_decoded_size(s, len);
+  if (size != N) {
+    throw_decoded_size_mismatch("hex", N, size);
+  }
+  hex<std::array<std::uint8_t, N>> result;
+  hex_decode(s, len, result.bytes.data());
+  return result;
+}
+
+
+inline
+base64<std::vector<std::uint8_t>>
+converter<base64<std::vector<std::uint8_t>>>::convert(const char* s)
+{
+  const std::size_t len = std::strlen(s);
+  base64<std::vector<std::uint8_t>> result {
+    std::vector<std::uint8_t>(base64_decoded_size(s, len))};
+  base64_decode(s, len, result.bytes.data());
+  return result;
+}
+
+
+template <std::size_t N>
+base64<std::array<std::uint8_t, N>>
+converter<base64<std::array<std::uint8_t, N>>>::convert(const char* s)
+{
+  const std::size_t len = std::strlen(s);
+  const std::size_t size = base64_decoded_size(s, len);
+  if (size != N) {
+    throw_decoded_size_mismatch("base64", N, size);
+  }
+  base64<std::array<std::uint8_t, N>> result;
+  base64_decode(s, len, result.bytes.data());
+  return result;
+}
+
+
+} // namespace convert
+} // namespace argagg
+
+
+#endif // ARGAGG_ARGAGG_CONVERT_BINARY_HPP
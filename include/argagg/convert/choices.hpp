@@ -0,0 +1,441 @@
+/*
+ * @file
+ * @brief
+ * Defines the argagg::choice and argagg::choices types and an argument
+ * conversion helper that parses an argument as one of a fixed set of named
+ * values (typically an enumeration).
+ *
+ * @copyright
+ * Copyright (c) 2018 Viet The Nguyen
+ *
+ * @copyright
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * @copyright
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * @copyright
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#pragma once
+#ifndef ARGAGG_ARGAGG_CONVERT_CHOICES_HPP
+#define ARGAGG_ARGAGG_CONVERT_CHOICES_HPP
+
+#include "../argagg.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+
+namespace argagg {
+
+
+/**
+ * @brief
+ * A single named value that an argument may be converted to.
+ */
+template <typename T>
+struct choice {
+
+  /**
+   * @brief
+   * The exact string that selects this choice on the command line.
+   */
+  const char* name;
+
+  /**
+   * @brief
+   * The value the argument is converted to when it matches @ref name.
+   */
+  T value;
+
+};
+
+
+/**
+ * @brief
+ * Declares the table of valid choices for the type T. This is the extension
+ * point for enumerated arguments: specialize it for your type and provide a
+ * static values() function that returns an std::array of argagg::choice<T>.
+ * Then specialize argagg::convert::converter<T> by deriving from
+ * argagg::convert::choice_converter<T>.
+ *
+ * @code
+   enum class color { red, green, blue };
+
+   namespace argagg {
+     template <>
+     struct choices<color> {
+       static std::array<choice<color>, 3> values()
+       {
+         return {{
+           {"red", color::red},
+           {"green", color::green},
+           {"blue", color::blue},
+         }};
+       }
+     };
+   namespace convert {
+     template <>
+     struct converter<color> : choice_converter<color> {};
+   } // namespace convert
+   } // namespace argagg
+
+   argagg::parser argparser {{
+       { "color", {"-c", "--color"},
+         "color to paint with (one of: " +
+         argagg::choices_list<color>() + ")", 1},
+     }};
+   @endcode
+ */
+template <typename T>
+struct choices;
+
+
+/**
+ * @brief
+ * Returns the names of all of the choices for the type T joined by the given
+ * separator. This is intended to be used when writing the help string for a
+ * definition so that the valid choices show up in the parser's help output.
+ */
+template <typename T>
+std::string choices_list(const char* separator = ", ");
+
+
+namespace convert {
+
+  /**
+   * @brief
+   * Hashes a NUL-terminated string. This is FNV-1a over the bytes of the
+   * string. The result is only used as the input to choice_hash_mix() so that
+   * a string only ever has to be scanned once per lookup.
+   */
+  std::uint32_t choice_hash(const char* s);
+
+  /**
+   * @brief
+   * Derives an independent hash from the result of choice_hash() for the
+   * given seed. This is a murmur3 style finalizer so that the low bits, which
+   * are the ones used for indexing, depend on every byte of the string.
+   */
+  std::uint32_t choice_hash_mix(std::uint32_t hash, std::uint32_t seed);
+
+  /**
+   * @brief
+   * Returns the smallest power of two that is greater than or equal to n.
+   */
+  constexpr std::size_t choice_table_size(
+    std::size_t n,
+    std::size_t size = 1);
+
+  /**
+   * @brief
+   * A perfect hash over the names in a table of N choices. It isn't minimal:
+   * there are twice as many slots as buckets so that displacements are quick
+   * to find. The table sizes are fixed by N at compile time so neither
+   * building the index nor looking up a name allocates. Names are first
+   * hashed into one of the buckets and then each bucket is assigned a
+   * displacement (a seed for choice_hash_mix()) that moves all of its names
+   * into free slots. A lookup is then a single scan of the string, two table
+   * reads, and a single std::strcmp() to confirm the match.
+   *
+   * Two names with the same choice_hash() can never be told apart by a
+   * displacement. If that happens, or no displacement is found within
+   * max_displacement tries, the index falls back to comparing the name
+   * against every choice.
+   *
+   * The displacements can't be searched for by a C++11 constexpr function so
+   * they are searched for once, when the index is constructed. The intended
+   * use is as a function local static (see choice_converter<T>::convert()).
+   */
+  template <typename T, std::size_t N>
+  struct choice_index {
+
+    /**
+     * @brief
+     * Number of buckets that names are first hashed into.
+     */
+    static constexpr std::size_t num_buckets = choice_table_size(N);
+
+    /**
+     * @brief
+     * Number of slots that names are finally placed into. This is kept at
+     * twice the number of buckets to keep the displacement search short.
+     */
+    static constexpr std::size_t num_slots = 2 * num_buckets;
+
+    /**
+     * @brief
+     * The largest displacement tried for a bucket before giving up on the
+     * hash and falling back to a linear search.
+     */
+    static constexpr std::uint32_t max_displacement = 1u << 16;
+
+    /**
+     * @brief
+     * The choices being indexed.
+     */
+    std::array<choice<T>, N> table;
+
+    /**
+     * @brief
+     * Seed for choice_hash_mix() per bucket.
+     */
+    std::array<std::uint32_t, num_buckets> displacements;
+
+    /**
+     * @brief
+     * Index into @ref table plus one for each slot. Zero marks an empty slot.
+     */
+    std::array<std::uint32_t, num_slots> slots;
+
+    /**
+     * @brief
+     * True if no perfect hash was found and find() compares the name
+     * against every choice instead.
+     */
+    bool linear;
+
+    /**
+     * @brief
+     * Builds the perfect hash for the given table. Throws an
+     * std::invalid_argument if the same name shows up twice.
+     */
+    explicit choice_index(const std::array<choice<T>, N>& table);
+
+    /**
+     * @brief
+     * Returns the choice with the given name or nullptr if there is none.
+     */
+    const choice<T>* find(const char* name) const;
+
+  };
+
+  /**
+   * @brief
+   * Implements argagg::convert::converter<T> for any type T that has a
+   * specialization of argagg::choices. If the argument isn't the name of one
+   * of the choices then an std::invalid_argument is thrown which lists all of
+   * the valid choices.
+   */
+  template <typename T>
+  struct choice_converter {
+    static T convert(const char* s);
+  };
+
+} // namespace convert
+
+} // namespace argagg
+
+
+// ---- end of declarations, header-only implementations follow ----
+
+
+namespace argagg {
+
+
+template <typename T>
+std::string choices_list(const char* separator)
+{
+  std::string result;
+  for (const auto& c : choices<T>::values()) {
+    if (!result.empty()) {
+      result += separator;
+    }
+    result += c.name;
+  }
+  return result;
+}
+
+
+namespace convert {
+
+
+inline
+std::uint32_t choice_hash(const char* s)
+{
+  std::uint32_t hash = 2166136261u;
+  for (; *s != '\0'; ++s) {
+    hash ^= static_cast<unsigned char>(*s);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+
+inline
+std::uint32_t choice_hash_mix(std::uint32_t hash, std::uint32_t seed)
+{
+  hash ^= seed * 0x9e3779b9u;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+
+constexpr std::size_t choice_table_size(
+  std::size_t n,
+  std::size_t size)
+{
+  return size >= n ? size : choice_table_size(n, size * 2);
+}
+
+
+template <typename T, std::size_t N>
+constexpr std::size_t choice_index<T, N>::num_buckets;
+
+
+template <typename T, std::size_t N>
+constexpr std::size_t choice_index<T, N>::num_slots;
+
+
+template <typename T, std::size_t N>
+constexpr std::uint32_t choice_index<T, N>::max_displacement;
+
+
+template <typename T, std::size_t N>
+choice_index<T, N>::choice_index(const std::array<choice<T>, N>& table)
+: table(table), displacements(), slots(), linear(false)
+{
+  std::array<std::uint32_t, N> hashes;
+  std::array<std::size_t, num_buckets> bucket_sizes {};
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < i; ++j) {
+      if (std::strcmp(table[i].name, table[j].name) == 0) {
+        std::ostringstream msg;
+        msg << "duplicate choice name \"" << table[i].name << "\"";
+        throw std::invalid_argument(msg.str());
+      }
+    }
+    hashes[i] = choice_hash(table[i].name);
+    for (std::size_t j = 0; j < i; ++j) {
+      if (hashes[i] == hashes[j]) {
+        this->linear = true;
+      }
+    }
+    ++bucket_sizes[choice_hash_mix(hashes[i], 0) & (num_buckets - 1)];
+  }
+
+  // Place the largest buckets first while the slots are still mostly empty.
+  // Those are the hardest ones to find a displacement for.
+  std::array<std::size_t, num_buckets> bucket_order;
+  for (std::size_t b = 0; b < num_buckets; ++b) {
+    bucket_order[b] = b;
+  }
+  std::sort(
+    bucket_order.begin(), bucket_order.end(),
+    [&](std::size_t a, std::size_t b) {
+      return bucket_sizes[a] > bucket_sizes[b];
+    });
+
+  for (const auto bucket : bucket_order) {
+    if (this->linear || bucket_sizes[bucket] == 0) {
+      break;
+    }
+
+    std::uint32_t displacement = 1;
+    while (true) {
+      bool placed_all = true;
+      for (std::size_t i = 0; i < N; ++i) {
+        if ((choice_hash_mix(hashes[i], 0) & (num_buckets - 1)) != bucket) {
+          continue;
+        }
+        auto& slot =
+          this->slots[choice_hash_mix(hashes[i], displacement) &
+                      (num_slots - 1)];
+        if (slot != 0) {
+          placed_all = false;
+          break;
+        }
+        slot = static_cast<std::uint32_t>(i + 1);
+      }
+      if (placed_all) {
+        break;
+      }
+
+      // Undo the partial placement of this bucket and try the next
+      // displacement.
+      for (auto& slot : this->slots) {
+        if (slot != 0 &&
+            (choice_hash_mix(hashes[slot - 1], 0) & (num_buckets - 1)) ==
+              bucket) {
+          slot = 0;
+        }
+      }
+      if (++displacement > max_displacement) {
+        this->linear = true;
+        break;
+      }
+    }
+    this->displacements[bucket] = displacement;
+  }
+}
+
+
+template <typename T, std::size_t N>
+const choice<T>* choice_index<T, N>::find(const char* name) const
+{
+  if (this->linear) {
+    for (const auto& c : this->table) {
+      if (std::strcmp(c.name, name) == 0) {
+        return &c;
+      }
+    }
+    return nullptr;
+  }
+  const auto hash = choice_hash(name);
+  const auto bucket = choice_hash_mix(hash, 0) & (num_buckets - 1);
+  const auto slot = this->slots[
+    choice_hash_mix(hash, this->displacements[bucket]) & (num_slots - 1)];
+  if (slot == 0 || std::strcmp(this->table[slot - 1].name, name) != 0) {
+    return nullptr;
+  }
+  return &(this->table[slot - 1]);
+}
+
+
+template <typename T>
+T choice_converter<T>::convert(const char* s)
+{
+  using table_type =
+    typename std::decay<decltype(choices<T>::values())>::type;
+  static const choice_index<T, std::tuple_size<table_type>::value> index(
+    choices<T>::values());
+
+  const auto found = index.find(s);
+  if (found == nullptr) {
+    std::ostringstream msg;
+    msg << "invalid choice \"" << s << "\", expected one of: "
+        << choices_list<T>();
+    throw std::invalid_argument(msg.str());
+  }
+  return found->value;
+}
+
+
+} // namespace convert
+} // namespace argagg
+
+
+#endif // ARGAGG_ARGAGG_CONVERT_CHOICES_HPP
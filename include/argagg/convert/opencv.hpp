@@ -35,6 +35,14 @@
 
 #include <opencv2/opencv.hpp>
 
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 
@@ -82,6 +90,64 @@ namespace convert {
     static cv::Rect_<T> convert(const char* s);
   };
 
+  /**
+   * @brief
+   * Partially specializes @ref argagg::convert::converter for the @ref
+   * cv::Mat_ type. Parses as a semicolon separated list of rows where each
+   * row is a comma separated list of elements (e.g. "1,2,3;4,5,6" is a 2x3
+   * matrix). Every row must have the same number of elements.
+   */
+  template <typename T>
+  struct converter<cv::Mat_<T>> {
+    static cv::Mat_<T> convert(const char* s);
+  };
+
+  /**
+   * @brief
+   * Partially specializes @ref argagg::convert::converter for a @ref
+   * cv::Mat_ of @ref cv::Point_. Parses as a semicolon separated list of
+   * points where each point is a comma separated pair of components (e.g.
+   * "0,0;10,0;10,10" is a 3x1 matrix of points). Unlike the single
+   * cv::Point_ conversion every point must have exactly two components.
+   */
+  template <typename T>
+  struct converter<cv::Mat_<cv::Point_<T>>> {
+    static cv::Mat_<cv::Point_<T>> convert(const char* s);
+  };
+
+  /**
+   * @brief
+   * Partially specializes @ref argagg::convert::converter for a @ref
+   * cv::Mat_ of @ref cv::Point3_. Parses as a semicolon separated list of
+   * points where each point is a comma separated triple of components.
+   * Unlike the single cv::Point3_ conversion every point must have exactly
+   * three components.
+   */
+  template <typename T>
+  struct converter<cv::Mat_<cv::Point3_<T>>> {
+    static cv::Mat_<cv::Point3_<T>> convert(const char* s);
+  };
+
+  /**
+   * @brief
+   * Counts the rows (separated by ';') and columns (separated by ',') of a
+   * matrix argument without converting anything. Throws an
+   * std::invalid_argument if the rows don't all have the same number of
+   * columns.
+   */
+  void count_matrix_shape(const char* s, int& rows, int& cols);
+
+  /**
+   * @brief
+   * Converts the matrix element at the start of s and advances s past it and
+   * the delimiter that must follow it. The delimiter is '\0' for the last
+   * element. Unlike parse_next_component() this converts in place with
+   * std::strtoll() or std::strtod() rather than copying the element into a
+   * temporary std::string first.
+   */
+  template <typename T>
+  T parse_matrix_element(const char*& s, const char delim);
+
 } // namespace convert
 
 } // namespace argagg
@@ -163,6 +229,183 @@ converter<cv::Rect_<T>>::convert(const char* s)
 }
 
 
+inline
+void count_matrix_shape(const char* s, int& rows, int& cols)
+{
+  rows = 1;
+  cols = 1;
+  int row_cols = 1;
+  for (; *s != '\0'; ++s) {
+    if (*s == ',') {
+      ++row_cols;
+    } else if (*s == ';') {
+      if (rows == 1) {
+        cols = row_cols;
+      } else if (row_cols != cols) {
+        break;
+      }
+      ++rows;
+      row_cols = 1;
+    }
+  }
+  if (rows == 1) {
+    cols = row_cols;
+  }
+  if (row_cols != cols) {
+    std::ostringstream msg;
+    msg << "matrix row " << rows << " has " << row_cols
+        << " elements but the first row has " << cols;
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+
+/**
+ * @brief
+ * Parses a floating point matrix element into value. Returns false, leaving
+ * value alone, if it's a finite number too large for T.
+ */
+template <typename T>
+bool parse_matrix_number(
+  const char* s,
+  char** endptr,
+  T& value,
+  std::true_type)
+{
+  const double parsed = std::strtod(s, endptr);
+  const auto max = static_cast<double>(std::numeric_limits<T>::max());
+  if (std::isfinite(parsed) && std::fabs(parsed) > max) {
+    return false;
+  }
+  value = static_cast<T>(parsed);
+  return true;
+}
+
+
+/**
+ * @brief
+ * Parses an integer matrix element into value. Returns false, leaving value
+ * alone, if it's outside the range of T, which includes negative numbers
+ * for unsigned types.
+ */
+template <typename T>
+bool parse_matrix_number(
+  const char* s,
+  char** endptr,
+  T& value,
+  std::false_type)
+{
+  const long long parsed = std::strtoll(s, endptr, 0);
+  const bool in_range = std::is_signed<T>::value
+    ? (parsed >= static_cast<long long>(std::numeric_limits<T>::min())
+       && parsed <= static_cast<long long>(std::numeric_limits<T>::max()))
+    : (parsed >= 0
+       && static_cast<unsigned long long>(parsed)
+          <= static_cast<unsigned long long>(std::numeric_limits<T>::max()));
+  if (!in_range) {
+    return false;
+  }
+  value = static_cast<T>(parsed);
+  return true;
+}
+
+
+template <typename T>
+T parse_matrix_element(const char*& s, const char delim)
+{
+  const char* begin = s;
+  char* endptr = nullptr;
+  errno = 0;
+  T value = T();
+  const bool in_range = parse_matrix_number(
+    begin, &endptr, value, std::is_floating_point<T>());
+  if (endptr == begin || *endptr != delim) {
+    const char* end = std::strpbrk(begin, ",;");
+    std::ostringstream msg;
+    msg << "unable to convert matrix element: \"";
+    if (end == nullptr) {
+      msg << begin;
+    } else {
+      msg.write(begin, end - begin);
+    }
+    msg << "\"";
+    throw std::invalid_argument(msg.str());
+  }
+  if (errno == ERANGE || !in_range) {
+    throw std::out_of_range("matrix element numeric value out of range");
+  }
+  s = (delim == '\0') ? endptr : endptr + 1;
+  return value;
+}
+
+
+template <typename T>
+cv::Mat_<T>
+converter<cv::Mat_<T>>::convert(const char* s)
+{
+  int rows = 0;
+  int cols = 0;
+  count_matrix_shape(s, rows, cols);
+
+  cv::Mat_<T> result(rows, cols);
+  for (int r = 0; r < rows; ++r) {
+    const char row_delim = (r + 1 < rows) ? ';' : '\0';
+    for (int c = 0; c < cols; ++c) {
+      result(r, c) = parse_matrix_element<T>(
+        s, (c + 1 < cols) ? ',' : row_delim);
+    }
+  }
+  return result;
+}
+
+
+template <typename T>
+cv::Mat_<cv::Point_<T>>
+converter<cv::Mat_<cv::Point_<T>>>::convert(const char* s)
+{
+  int rows = 0;
+  int cols = 0;
+  count_matrix_shape(s, rows, cols);
+  if (cols != 2) {
+    std::ostringstream msg;
+    msg << "points must have 2 components but found " << cols;
+    throw std::invalid_argument(msg.str());
+  }
+
+  cv::Mat_<cv::Point_<T>> result(rows, 1);
+  for (int r = 0; r < rows; ++r) {
+    auto& point = result(r, 0);
+    point.x = parse_matrix_element<T>(s, ',');
+    point.y = parse_matrix_element<T>(s, (r + 1 < rows) ? ';' : '\0');
+  }
+  return result;
+}
+
+
+template <typename T>
+cv::Mat_<cv::Point3_<T>>
+converter<cv::Mat_<cv::Point3_<T>>>::convert(const char* s)
+{
+  int rows = 0;
+  int cols = 0;
+  count_matrix_shape(s, rows, cols);
+  if (cols != 3) {
+    std::ostringstream msg;
+    msg << "points must have 3 components but found " << cols;
+    throw std::invalid_argument(msg.str());
+  }
+
+  cv::Mat_<cv::Point3_<T>> result(rows, 1);
+  for (int r = 0; r < rows; ++r) {
+    auto& point = result(r, 0);
+    point.x = parse_matrix_element<T>(s, ',');
+    point.y = parse_matrix_element<T>(s, ',');
+    point.z = parse_matrix_element<T>(s, (r + 1 < rows) ? ';' : '\0');
+  }
+  return result;
+}
+
+
 } // namespace convert
 } // namespace argagg
 
@@ -55,6 +55,7 @@ ctest -V %{?_smp_mflags}
 
 %files devel
 %{_includedir}/*
+%{_datadir}/%{name}
 
 %files doc
 %doc %{_datadir}/doc/%{name}
@@ -3,8 +3,12 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 
@@ -240,6 +244,17 @@ TEST_CASE("invalid definitions")
       argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
     }, const argagg::invalid_flag&);
   }
+  SUBCASE("default constructed") {
+    const argagg::definition empty;
+    CHECK(empty.name.empty());
+    CHECK(empty.flags.empty());
+    CHECK(empty.num_args == 0);
+    argagg::parser parser;
+    parser.definitions.resize(1);
+    CHECK_THROWS_AS({
+      argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    }, const argagg::invalid_flag&);
+  }
   SUBCASE("too short") {
     argagg::parser parser {{
         {"bad", {"-"}, "bad", 0},
@@ -313,6 +328,14 @@ TEST_CASE("invalid definitions")
     CHECK_THROWS_AS({
       argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
     }, const argagg::invalid_flag&);
+    std::string message;
+    try {
+      argagg::validate_definitions(parser.definitions);
+    } catch (const argagg::invalid_flag& e) {
+      message = e.what();
+    }
+    CHECK(message.find("\"--bad\" found, specified by both option  \"bad2\" "
+                       "and option \"bad") != std::string::npos);
   }
 }
 
@@ -843,6 +866,30 @@ TEST_CASE("gcc example")
     CHECK(args.count() == 1);
     CHECK(args.as<std::string>(0) == "test.c");
   }
+  SUBCASE("all_as and all_views") {
+    std::vector<const char*> argv {
+      "gcc", "-I/usr/local/include", "-I.", "-I", "include", "-v", "-lz",
+      "test.c"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    const auto include_paths = args["include path"].all_as<std::string>();
+    CHECK(include_paths.size() == 3);
+    CHECK(include_paths[0] == "/usr/local/include");
+    CHECK(include_paths[1] == ".");
+    CHECK(include_paths[2] == "include");
+    const auto include_views = args["include path"].all_views();
+    CHECK(include_views.size() == 3);
+    CHECK(include_views[0] == argv[1] + 2);
+    CHECK(include_views[1] == argv[2] + 2);
+    CHECK(include_views[2] == argv[4]);
+    CHECK(args["library path"].all_as<std::string>().empty());
+    CHECK(args["library path"].all_views().empty());
+    const auto verbose_views = args["verbose"].all_views();
+    CHECK(verbose_views.size() == 1);
+    CHECK(verbose_views[0] == nullptr);
+    CHECK_THROWS_AS({
+      args["verbose"].all_as<std::string>();
+    }, const argagg::option_lacks_argument_error&);
+  }
 }
 
 
@@ -1008,6 +1055,1213 @@ namespace convert {
 } // namespace argagg
 
 
+static void write_file(const char* path, const std::string& contents)
+{
+  std::ofstream out(path, std::ios::binary);
+  out << contents;
+}
+
+
+TEST_CASE("response files")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"output", {"-o", "--output"}, "output", 1},
+    }};
+  parser.expand_response_files = true;
+  SUBCASE("quoting") {
+    write_file(
+      "argagg_test_quoting.rsp",
+      "-v -o 'out file.txt'\n\"a b\"  c\\ d\t'it'\\''s' \"\" e\"f\"g");
+    std::vector<const char*> argv {
+      "test", "@argagg_test_quoting.rsp", "h"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    std::remove("argagg_test_quoting.rsp");
+    CHECK(args.has_option("verbose") == true);
+    CHECK(args["output"].as<std::string>() == "out file.txt");
+    REQUIRE(args.count() == 6);
+    CHECK(args.as<std::string>(0) == "a b");
+    CHECK(args.as<std::string>(1) == "c d");
+    CHECK(args.as<std::string>(2) == "it's");
+    CHECK(args.as<std::string>(3) == "");
+    CHECK(args.as<std::string>(4) == "efg");
+    CHECK(args.as<std::string>(5) == "h");
+  }
+  SUBCASE("nested") {
+    write_file("argagg_test_outer.rsp", "a @argagg_test_inner.rsp\nd\n");
+    write_file("argagg_test_inner.rsp", "b -o c");
+    std::vector<const char*> argv {
+      "test", "@argagg_test_outer.rsp", "@argagg_test_inner.rsp", "-v"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    std::remove("argagg_test_outer.rsp");
+    std::remove("argagg_test_inner.rsp");
+    CHECK(args.has_option("verbose") == true);
+    CHECK(args["output"].count() == 2);
+    CHECK(args["output"].as<std::string>() == "c");
+    REQUIRE(args.count() == 4);
+    CHECK(args.as<std::string>(0) == "a");
+    CHECK(args.as<std::string>(1) == "b");
+    CHECK(args.as<std::string>(2) == "d");
+    CHECK(args.as<std::string>(3) == "b");
+  }
+  SUBCASE("cycle") {
+    write_file("argagg_test_cycle_a.rsp", "a @argagg_test_cycle_b.rsp");
+    write_file("argagg_test_cycle_b.rsp", "b @./argagg_test_cycle_a.rsp");
+    std::vector<const char*> argv {
+      "test", "@argagg_test_cycle_a.rsp"};
+    CHECK_THROWS_AS({
+      parser.parse(argv.size(), &(argv.front()));
+    }, const argagg::response_file_error&);
+    std::remove("argagg_test_cycle_a.rsp");
+    std::remove("argagg_test_cycle_b.rsp");
+  }
+  SUBCASE("depth limit") {
+    // A chain of distinct files that's deeper than the limit.
+    const std::size_t depth = argagg::max_response_file_depth + 1;
+    for (std::size_t i = 0; i < depth; ++i) {
+      const std::string path =
+        "argagg_test_depth" + std::to_string(i) + ".rsp";
+      write_file(
+        path.c_str(), "@argagg_test_depth" + std::to_string(i + 1) + ".rsp");
+    }
+    std::vector<const char*> argv {"test", "@argagg_test_depth0.rsp"};
+    CHECK_THROWS_AS({
+      parser.parse(argv.size(), &(argv.front()));
+    }, const argagg::response_file_error&);
+    for (std::size_t i = 0; i < depth; ++i) {
+      std::remove(("argagg_test_depth" + std::to_string(i) + ".rsp").c_str());
+    }
+  }
+  SUBCASE("unreadable files are arguments") {
+    std::vector<const char*> argv {
+      "test", "@argagg_test_does_not_exist.rsp", "@", "-o", "@."};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    CHECK(args["output"].as<std::string>() == "@.");
+    REQUIRE(args.count() == 2);
+    CHECK(args.as<std::string>(0) == "@argagg_test_does_not_exist.rsp");
+    CHECK(args.as<std::string>(1) == "@");
+  }
+  SUBCASE("disabled") {
+    write_file("argagg_test_disabled.rsp", "-v");
+    parser.expand_response_files = false;
+    std::vector<const char*> argv {
+      "test", "@argagg_test_disabled.rsp"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    std::remove("argagg_test_disabled.rsp");
+    CHECK(args.has_option("verbose") == false);
+    REQUIRE(args.count() == 1);
+    CHECK(args.as<std::string>(0) == "@argagg_test_disabled.rsp");
+  }
+  SUBCASE("large files") {
+    // Large files are memory mapped unless their size is a multiple of the
+    // page size. Check sizes on either side of that and make sure the last
+    // argument is terminated even without a trailing new line.
+    for (std::size_t size : {4095, 4096, 4097, 65536, 100001}) {
+      std::string contents;
+      std::size_t count = 0;
+      while (contents.size() + 10 <= size) {
+        contents += "'a b' -v ";
+        count += 1;
+      }
+      contents += std::string(size - contents.size(), 'z');
+      write_file("argagg_test_large.rsp", contents);
+      std::vector<const char*> argv {
+        "test", "@argagg_test_large.rsp"};
+      argagg::parser_results args =
+        parser.parse(argv.size(), &(argv.front()));
+      std::remove("argagg_test_large.rsp");
+      CHECK(args["verbose"].count() == count);
+      REQUIRE(args.count() == count + 1);
+      CHECK(args.as<std::string>(0) == "a b");
+      CHECK(args.as<std::string>(count) ==
+            std::string(size - 9 * count, 'z'));
+    }
+  }
+}
+
+
+TEST_CASE("long flag abbreviations")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"version", {"--version"}, "print the version", 0},
+      {"color", {"--color", "--colour"}, "colorize output", 0},
+      {"in", {"--in"}, "input", 1},
+      {"input_format", {"--input-format"}, "input format", 1},
+      {"output", {"-o", "--output"}, "output filename", 1},
+    }};
+  SUBCASE("disabled by default") {
+    std::vector<const char*> argv {"test", "--verb"};
+    CHECK_THROWS_AS({
+      parser.parse(argv.size(), &(argv.front()));
+    }, const argagg::unexpected_option_error&);
+  }
+  parser.allow_abbreviations = true;
+  SUBCASE("unique prefixes") {
+    std::vector<const char*> argv {
+      "test", "--verb", "--col", "--out", "a.txt", "--input-f=csv"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    CHECK(args.has_option("verbose") == true);
+    CHECK(args.has_option("version") == false);
+    CHECK(args.has_option("color") == true);
+    CHECK(args["output"].as<std::string>() == "a.txt");
+    CHECK(args["input_format"].as<std::string>() == "csv");
+    CHECK(args.has_option("in") == false);
+    CHECK(args.count() == 0);
+  }
+  SUBCASE("exact matches win") {
+    std::vector<const char*> argv {"test", "--in", "x"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    CHECK(args["in"].as<std::string>() == "x");
+    CHECK(args.has_option("input_format") == false);
+  }
+  SUBCASE("ambiguous prefixes") {
+    std::vector<const char*> argv {"test", "--ver"};
+    std::string message;
+    try {
+      parser.parse(argv.size(), &(argv.front()));
+    } catch (const argagg::ambiguous_option_error& e) {
+      message = e.what();
+    }
+    CHECK(message == "found ambiguous flag --ver which could be --verbose, "
+                     "--version");
+    std::vector<const char*> other {"test", "--i", "x"};
+    CHECK_THROWS_AS({
+      parser.parse(other.size(), &(other.front()));
+    }, const argagg::unexpected_option_error&);
+  }
+  SUBCASE("missing argument names the full flag") {
+    std::vector<const char*> argv {"test", "--outp"};
+    std::string message;
+    try {
+      parser.parse(argv.size(), &(argv.front()));
+    } catch (const argagg::option_lacks_argument_error& e) {
+      message = e.what();
+    }
+    CHECK(message.find("\"--output\"") != std::string::npos);
+  }
+  SUBCASE("unknown prefixes") {
+    std::vector<const char*> argv {"test", "--bogus"};
+    CHECK_THROWS_AS({
+      parser.parse(argv.size(), &(argv.front()));
+    }, const argagg::unexpected_option_error&);
+  }
+  SUBCASE("long flags are sorted once") {
+    const auto map = parser.compile();
+    CHECK(map->allow_abbreviations == true);
+    std::vector<const char*> argv {"test", "--verb"};
+    CHECK(parser.parse(argv.size(), &(argv.front())).has_option("verbose"));
+    CHECK(parser.compile() == map);
+    parser.definitions[0].flags[1] = "--loud";
+    const auto changed = parser.compile();
+    CHECK(changed != map);
+    CHECK(changed->find_long_flag_prefix("--lo", 4)->first == "--loud");
+    CHECK(parser.compile() == changed);
+    parser.allow_abbreviations = false;
+    CHECK(parser.compile()->allow_abbreviations == false);
+  }
+}
+
+TEST_CASE("flag suggestions")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"version", {"--version"}, "print the version", 0},
+      {"output", {"-o", "--output"}, "output filename", 1},
+      {"outdir", {"--outdir"}, "output directory", 1},
+      {"dry_run", {"--dry-run"}, "don't do anything", 0},
+    }};
+  auto message = [&parser](std::vector<const char*> argv) {
+      std::string what;
+      try {
+        parser.parse(argv.size(), &(argv.front()));
+      } catch (const argagg::unexpected_option_error& e) {
+        what = e.what();
+      }
+      return what;
+    };
+  CHECK(message({"test", "--verbos"}) ==
+        "found unexpected flag: --verbos (did you mean --verbose?)");
+  CHECK(message({"test", "--outpir"}) ==
+        "found unexpected flag: --outpir (did you mean --outdir or "
+        "--output?)");
+  CHECK(message({"test", "--ouptut=x"}) ==
+        "found unexpected flag: --ouptut (did you mean --output?)");
+  CHECK(message({"test", "--frobnicate"}) ==
+        "found unexpected flag: --frobnicate");
+  CHECK(message({"test", "-verbose"}) ==
+        "found unexpected flag 'e' in flag group '-verbose' (did you mean "
+        "--verbose?)");
+  CHECK(message({"test", "-x"}) ==
+        "found unexpected flag 'x' in flag group '-x'");
+  CHECK(message({"test", "--dryrun"}) ==
+        "found unexpected flag: --dryrun (did you mean --dry-run?)");
+
+  SUBCASE("bk_tree") {
+    argagg::bk_tree tree;
+    for (const char* word : {"book", "books", "cake", "boo", "cape", "cart",
+                             "boon", "cook", "book"}) {
+      tree.insert(word);
+    }
+    CHECK(tree.nodes.size() == 8);
+    const auto found = tree.find("bo", 2, 2);
+    std::vector<std::string> words;
+    for (const auto& match : found) {
+      words.push_back(std::to_string(match.first) + *match.second);
+    }
+    CHECK(words == std::vector<std::string>({"1boo", "2book", "2boon"}));
+    CHECK(tree.find("caqe", 4, 0).empty());
+    CHECK(argagg::edit_distance("kitten", 6, "sitting", 7) == 3);
+    CHECK(argagg::edit_distance("", 0, "abc", 3) == 3);
+  }
+
+  SUBCASE("many flags") {
+    // The first query builds the tree and the queries find the same flags
+    // as a brute force search.
+    std::vector<argagg::definition> definitions;
+    std::vector<std::string> names;
+    for (int i = 0; i < 2000; ++i) {
+      names.push_back("option-" + std::to_string(i * 7919 % 10007));
+    }
+    for (const auto& name : names) {
+      definitions.push_back({name.c_str(), {"--" + name}, "", 0});
+    }
+    const auto map = argagg::validate_definitions(definitions);
+    CHECK(map.flag_tree.load() == nullptr);
+    for (const char* query : {"--option-123", "--optoin-4242", "--opt"}) {
+      const std::size_t len = std::strlen(query);
+      std::vector<std::pair<unsigned int, std::string>> expected;
+      for (const auto& entry : map.long_flags) {
+        const unsigned int distance = argagg::edit_distance(
+          entry.first.data(), entry.first.size(), query, len);
+        if (distance <= 1 + (len - 2) / 4) {
+          expected.push_back(std::make_pair(distance, entry.first));
+        }
+      }
+      std::sort(expected.begin(), expected.end());
+      std::vector<std::string> expected_flags;
+      for (std::size_t i = 0; i < expected.size() && i < 3; ++i) {
+        expected_flags.push_back(expected[i].second);
+      }
+      CHECK(map.suggest_flags(query, len) == expected_flags);
+    }
+    CHECK(map.flag_tree.load() != nullptr);
+  }
+
+  SUBCASE("parser keeps the tree") {
+    // The parser keeps the map it validated so a single failed parse builds
+    // the tree and later ones reuse it.
+    argagg::parser parser;
+    for (int i = 0; i < 2000; ++i) {
+      const std::string name = "option-" + std::to_string(i * 7919 % 10007);
+      parser.definitions.push_back({name.c_str(), {"--" + name}, "", 0});
+    }
+    auto message = [&parser](const char* flag) {
+        std::string what;
+        std::vector<const char*> argv {"test", flag};
+        try {
+          parser.parse(argv.size(), &(argv.front()));
+        } catch (const argagg::unexpected_option_error& e) {
+          what = e.what();
+        }
+        return what;
+      };
+    CHECK(parser.compile()->flag_tree.load() == nullptr);
+    CHECK(message("--option-123").find("(did you mean ") !=
+          std::string::npos);
+    const auto tree = parser.compile()->flag_tree.load();
+    REQUIRE(tree != nullptr);
+    CHECK(message("--optoin-4242").find("--option-4242") !=
+          std::string::npos);
+    CHECK(parser.compile()->flag_tree.load() == tree);
+    parser.definitions.push_back({"frobnicate", {"--frobnicate"}, "", 0});
+    CHECK(message("--frobnicat") ==
+          "found unexpected flag: --frobnicat (did you mean --frobnicate?)");
+    CHECK(parser.compile()->flag_tree.load() != tree);
+  }
+
+  SUBCASE("flags modified in place") {
+    argagg::parser parser {{
+        {"help", {"-h", "--help"}, "", 0},
+        {"verbose", {"-v", "--verbose"}, "", 0},
+      }};
+    auto message = [&parser](const char* flag) {
+        std::string what;
+        std::vector<const char*> argv {"test", flag};
+        try {
+          parser.parse(argv.size(), &(argv.front()));
+        } catch (const argagg::unexpected_option_error& e) {
+          what = e.what();
+        }
+        return what;
+      };
+    CHECK(message("--verbos") ==
+          "found unexpected flag: --verbos (did you mean --verbose?)");
+    parser.definitions[1].flags = {"-q", "--quiet"};
+    CHECK(message("--verbos") == "found unexpected flag: --verbos");
+    CHECK(message("--quiett") ==
+          "found unexpected flag: --quiett (did you mean --quiet?)");
+  }
+}
+
+TEST_CASE("command line strings")
+{
+  argagg::parser parser {{
+      {"force", {"-f", "--force"}, "force", 0},
+      {"output", {"-o", "--output"}, "output", 1},
+    }};
+  SUBCASE("splitting") {
+    const auto command = argagg::split_command_line(
+      " deploy\t'it'\\''s here' \"a \\$b \\c \\\"\" x\\ y\\\nz '' e\"f\"g\n");
+    std::vector<std::string> args;
+    for (const auto& arg : command) {
+      CHECK(std::strlen(arg.data) == arg.size);
+      args.emplace_back(arg.data, arg.size);
+    }
+    REQUIRE(command.count == 6);
+    REQUIRE(args.size() == 6);
+    CHECK(args[0] == "deploy");
+    CHECK(args[1] == "it's here");
+    CHECK(args[2] == "a $b \\c \"");
+    CHECK(args[3] == "x yz");
+    CHECK(args[4] == "");
+    CHECK(args[5] == "efg");
+  }
+  SUBCASE("parsing") {
+    argagg::parser_results args = parser.parse(
+      argagg::split_command_line("deploy -f --output='my app' -- -o \"\""));
+    CHECK(std::string(args.program) == "deploy");
+    CHECK(args.has_option("force") == true);
+    CHECK(args["output"].as<std::string>() == "my app");
+    REQUIRE(args.count() == 2);
+    CHECK(args.as<std::string>(0) == "-o");
+    CHECK(args.as<std::string>(1) == "");
+  }
+  SUBCASE("empty") {
+    const auto command = argagg::split_command_line(" \t\n");
+    CHECK(command.count == 0);
+    CHECK(command.begin() == command.end());
+    argagg::parser_results args = parser.parse(command);
+    CHECK(args.program == nullptr);
+    CHECK(args.count() == 0);
+  }
+  SUBCASE("trailing backslash") {
+    const auto command = argagg::split_command_line("a\\");
+    REQUIRE(command.count == 1);
+    CHECK(std::string(command.begin()->data) == "a\\");
+  }
+  SUBCASE("line continuations between blanks") {
+    const auto command = argagg::split_command_line("a \\\n b");
+    std::vector<std::string> args;
+    for (const auto& arg : command) {
+      args.emplace_back(arg.data, arg.size);
+    }
+    REQUIRE(command.count == 2);
+    REQUIRE(args.size() == 2);
+    CHECK(args[0] == "a");
+    CHECK(args[1] == "b");
+    CHECK(argagg::split_command_line("\\\n").count == 0);
+    CHECK(argagg::split_command_line("'' \\\n").count == 1);
+  }
+  SUBCASE("unterminated quotes") {
+    for (const char* s : {"a 'b", "a \"b", "a \"b\\\"", "a \"\\"}) {
+      CHECK_THROWS_AS({
+        argagg::split_command_line(s);
+      }, const argagg::invalid_command_line&);
+    }
+  }
+  SUBCASE("long runs") {
+    // Put special characters at every offset within and across the sixteen
+    // byte chunks that are scanned at a time.
+    for (std::size_t pad = 0; pad < 40; ++pad) {
+      const std::string run(pad, 'x');
+      const auto command = argagg::split_command_line(
+        run + " " + run + "\\ " + run + " '" + run + "' \"" + run + "\\\"\"");
+      std::vector<std::string> args;
+      for (const auto& arg : command) {
+        args.emplace_back(arg.data, arg.size);
+      }
+      const std::size_t expected_count = (pad == 0) ? 3 : 4;
+      REQUIRE(args.size() == expected_count);
+      if (pad > 0) {
+        CHECK(args[0] == run);
+      }
+      CHECK(args[expected_count - 3] == run + " " + run);
+      CHECK(args[expected_count - 2] == run);
+      CHECK(args[expected_count - 1] == run + "\"");
+    }
+  }
+}
+
+TEST_CASE("environment variable fallback")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0, "ARGAGG_VERBOSE"},
+      {"quiet", {"-q", "--quiet"}, "be quiet", 0, "ARGAGG_QUIET"},
+      {"threads", {"-t", "--threads"}, "threads", 1, "ARGAGG_THREADS"},
+      {"output", {"-o", "--output"}, "output", 1, "ARGAGG_OUTPUT"},
+      {"input", {"-i", "--input"}, "input", 1},
+    }};
+  const char* env[] = {
+    "PATH=/bin",
+    "ARGAGG_THREADS=8",
+    "ARGAGG_OUTPUT=env.txt",
+    "ARGAGG_VERBOSE=1",
+    "ARGAGG_QUIET=0",
+    "ARGAGG_THREADS=16",
+    "ARGAGG_INPUT=ignored",
+    "ARGAGG_OUTPU=ignored",
+    "ARGAGG_OUTPUTS=ignored",
+    nullptr,
+  };
+  argagg::parser_map map = argagg::validate_definitions(parser.definitions);
+  SUBCASE("fills in missing options") {
+    std::vector<const char*> argv {"test", "-i", "in.txt"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    argagg::merge_environment(map, env, args);
+    CHECK(args["verbose"].count() == 1);
+    CHECK(args["verbose"][0].arg == nullptr);
+    CHECK(args.has_option("quiet") == false);
+    CHECK(args["threads"].count() == 1);
+    CHECK(args["threads"].as<int>() == 8);
+    CHECK(args["output"].as<std::string>() == "env.txt");
+    CHECK(args["input"].as<std::string>() == "in.txt");
+  }
+  SUBCASE("command line takes precedence") {
+    std::vector<const char*> argv {"test", "-t", "2", "-o", "a", "-o", "b"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    argagg::merge_environment(map, env, args);
+    CHECK(args["threads"].count() == 1);
+    CHECK(args["threads"].as<int>() == 2);
+    CHECK(args["output"].count() == 2);
+    CHECK(args["output"].as<std::string>() == "b");
+  }
+  SUBCASE("parse uses the process environment") {
+    const char* path = std::getenv("PATH");
+    REQUIRE(path != nullptr);
+    argagg::parser path_parser {{
+        {"path", {"--path"}, "search path", 1, "PATH"},
+      }};
+    std::vector<const char*> argv {"test"};
+    argagg::parser_results args =
+      path_parser.parse(argv.size(), &(argv.front()));
+    CHECK(args["path"].as<std::string>() == path);
+  }
+  SUBCASE("duplicate variables") {
+    parser.definitions.push_back({"x", {"-x"}, "x", 0, "ARGAGG_THREADS"});
+    CHECK_THROWS_AS({
+      argagg::validate_definitions(parser.definitions);
+    }, const argagg::invalid_flag&);
+  }
+  SUBCASE("invalid variable") {
+    parser.definitions.push_back({"x", {"-x"}, "x", 0, "A=B"});
+    CHECK_THROWS_AS({
+      argagg::validate_definitions(parser.definitions);
+    }, const argagg::invalid_flag&);
+  }
+  SUBCASE("variables are checked once") {
+    const auto compiled = parser.compile();
+    REQUIRE(compiled->env_vars.size() == 4);
+    CHECK(parser.compile() == compiled);
+    parser.definitions[4].env = "ARGAGG_VERBOSE";
+    std::vector<const char*> argv {"test"};
+    CHECK_THROWS_AS({
+      parser.parse(argv.size(), &(argv.front()));
+    }, const argagg::invalid_flag&);
+    parser.definitions[4].env = "ARGAGG_INPUT";
+    CHECK(parser.compile()->env_vars.size() == 5);
+  }
+}
+
+TEST_CASE("config files")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"quiet", {"-q", "--quiet"}, "be quiet", 0},
+      {"threads", {"-t", "--num-threads"}, "threads", 1},
+      {"output", {"-o", "--output"}, "output", 1},
+      {"include", {"-I"}, "include", 1},
+    }};
+  SUBCASE("values") {
+    write_file(
+      "argagg_test_config.ini",
+      "# comment\n"
+      "; another comment\n"
+      "[section]\n"
+      "  verbose\n"
+      "quiet = off\n"
+      "num-threads=4\r\n"
+      "output = 'out file.txt' \n"
+      "\n"
+      "include = a\n"
+      "include = \"\"\n"
+      "include=c");
+    std::vector<const char*> argv {"test", "-o", "cli.txt"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    // Parsing alone doesn't make the config keys.
+    CHECK(parser.compile()->config_keys.load() == nullptr);
+    const auto config = parser.merge_config_file(
+      "argagg_test_config.ini", args);
+    std::remove("argagg_test_config.ini");
+    CHECK(parser.compile()->config_keys.load() != nullptr);
+    CHECK(args.has_option("verbose") == true);
+    CHECK(args.has_option("quiet") == false);
+    CHECK(args["threads"].as<int>() == 4);
+    CHECK(args["output"].count() == 1);
+    CHECK(args["output"].as<std::string>() == "cli.txt");
+    REQUIRE(args["include"].count() == 3);
+    CHECK(args["include"][0].as<std::string>() == "a");
+    CHECK(args["include"][1].as<std::string>() == "");
+    CHECK(args["include"][2].as<std::string>() == "c");
+    CHECK(config->line_of(args["threads"][0].arg) == 6);
+    CHECK(config->line_of(args["include"][2].arg) == 11);
+    CHECK(config->line_of(args["output"][0].arg) == 0);
+  }
+  SUBCASE("errors") {
+    const std::vector<std::pair<const char*, const char*>> cases {
+      {"verbose\nbogus = 1\n", "argagg_test_config.ini:2: unknown option"},
+      {"\n\n = 1", "argagg_test_config.ini:3: missing option name"},
+      {"output", "argagg_test_config.ini:1: option \"output\" expects"},
+      {"verbose = maybe", "argagg_test_config.ini:1: invalid value"},
+      {"[section", "argagg_test_config.ini:1: unterminated section"},
+    };
+    for (const auto& c : cases) {
+      write_file("argagg_test_config.ini", c.first);
+      std::vector<const char*> argv {"test"};
+      argagg::parser_results args =
+        parser.parse(argv.size(), &(argv.front()));
+      std::string message;
+      try {
+        parser.merge_config_file("argagg_test_config.ini", args);
+      } catch (const argagg::config_file_error& e) {
+        message = e.what();
+      }
+      std::remove("argagg_test_config.ini");
+      CHECK(message.find(c.second) == 0);
+    }
+  }
+  SUBCASE("unreadable") {
+    std::vector<const char*> argv {"test"};
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      parser.merge_config_file("argagg_test_does_not_exist.ini", args);
+    }, const argagg::config_file_error&);
+  }
+}
+
+/**
+ * Collects what parser::parse_stream() hands over as strings since the
+ * C-strings it hands over only live until the next chunk is read.
+ */
+struct stream_collector {
+  std::vector<std::string> events;
+  void option(const argagg::definition& defn, const char* arg) {
+    events.push_back(defn.name + "=" + (arg ? arg : "<none>"));
+  }
+  void positional(const char* arg) {
+    events.push_back(arg);
+  }
+};
+
+
+/**
+ * Hands out its contents and then fails the next read the way a broken
+ * device would, which leaves the stream reading from it bad.
+ */
+struct failing_streambuf : std::streambuf {
+  std::string contents;
+  explicit failing_streambuf(const char* data, std::size_t size)
+  : contents(data, size)
+  {
+    setg(&contents[0], &contents[0], &contents[0] + contents.size());
+  }
+  template <std::size_t N>
+  explicit failing_streambuf(const char (&data)[N])
+  : failing_streambuf(data, N - 1)
+  {
+  }
+  int_type underflow() override {
+    throw std::runtime_error("device went away");
+  }
+};
+
+
+TEST_CASE("streaming NUL separated arguments")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"output", {"-o", "--output"}, "output", 1},
+    }};
+  const char raw_input[] =
+    "./a.txt\0-vo\0out one\0--output=two\0-oconcat\0./b c.txt\0--\0-v\0last";
+  const std::string input(raw_input, sizeof(raw_input) - 1);
+  const std::vector<std::string> expected {
+    "./a.txt", "verbose=<none>", "output=out one", "output=two",
+    "output=concat", "./b c.txt", "-v", "last",
+  };
+  SUBCASE("chunk sizes") {
+    for (std::size_t chunk_size : {1, 2, 3, 7, 16, 65536}) {
+      std::istringstream in(input);
+      stream_collector collector;
+      parser.parse_stream(in, collector, chunk_size);
+      CHECK(collector.events == expected);
+    }
+  }
+  SUBCASE("trailing terminator") {
+    std::istringstream in(input + std::string(1, '\0'));
+    stream_collector collector;
+    parser.parse_stream(in, collector, 4);
+    CHECK(collector.events == expected);
+  }
+  SUBCASE("errors") {
+    std::istringstream missing(std::string("-v\0-o", 5));
+    stream_collector collector;
+    CHECK_THROWS_AS({
+      parser.parse_stream(missing, collector, 2);
+    }, const argagg::option_lacks_argument_error&);
+    std::istringstream unknown(std::string("a\0--bogus\0", 10));
+    CHECK_THROWS_AS({
+      parser.parse_stream(unknown, collector, 2);
+    }, const argagg::unexpected_option_error&);
+  }
+  SUBCASE("bad stream") {
+    failing_streambuf buf("-v\0a\0");
+    std::istream in(&buf);
+    stream_collector collector;
+    CHECK_THROWS_AS({
+      parser.parse_stream(in, collector, 2);
+    }, const std::system_error&);
+    CHECK(in.bad());
+  }
+#ifdef ARGAGG_HAS_POSIX_IO
+  SUBCASE("file descriptor") {
+    write_file("argagg_test_stream.bin", input);
+    const int fd = ::open("argagg_test_stream.bin", O_RDONLY);
+    REQUIRE(fd >= 0);
+    stream_collector collector;
+    parser.parse_stream(fd, collector, 5);
+    ::close(fd);
+    std::remove("argagg_test_stream.bin");
+    CHECK(collector.events == expected);
+  }
+#endif
+}
+
+TEST_CASE("NUL separated buffers")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"config", {"-c", "--config"}, "config", 1},
+    }};
+  SUBCASE("terminated") {
+    const char cmdline[] =
+      "/usr/sbin/sshd\0-v\0-c\0/etc/ssh/sshd_config\0foreground\0";
+    const std::size_t len = sizeof(cmdline) - 1;
+    argagg::parser_results args = parser.parse(cmdline, len);
+    CHECK(std::string(args.program) == "/usr/sbin/sshd");
+    CHECK(args.buffers.empty());
+    CHECK(args["config"].as<std::string>() == "/etc/ssh/sshd_config");
+    CHECK(args["config"][0].arg > cmdline);
+    CHECK(args["config"][0].arg < cmdline + len);
+    REQUIRE(args.count() == 1);
+    CHECK(args.as<std::string>(0) == "foreground");
+  }
+  SUBCASE("unterminated") {
+    const char cmdline[] = "daemon: worker\0-v\0extra";
+    const std::size_t len = sizeof(cmdline) - 1;
+    argagg::parser_results args = parser.parse(cmdline, len);
+    CHECK(std::string(args.program) == "daemon: worker");
+    CHECK(args.buffers.size() == 1);
+    CHECK(args.has_option("verbose") == true);
+    REQUIRE(args.count() == 1);
+    CHECK(args.as<std::string>(0) == "extra");
+  }
+  SUBCASE("empty arguments and empty buffers") {
+    const char cmdline[] = "prog\0\0-v\0";
+    argagg::parser_results args = parser.parse(cmdline, sizeof(cmdline) - 1);
+    CHECK(args.has_option("verbose") == true);
+    REQUIRE(args.count() == 1);
+    CHECK(args.as<std::string>(0) == "");
+    argagg::parser_results none = parser.parse(cmdline, 0);
+    CHECK(none.program == nullptr);
+    CHECK(none.count() == 0);
+  }
+}
+
+/**
+ * A minimal string view since std::string_view needs C++17.
+ */
+struct test_string_view {
+  const char* ptr;
+  std::size_t len;
+  const char* data() const { return ptr; }
+  std::size_t size() const { return len; }
+};
+
+
+TEST_CASE("iterator ranges")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"output", {"-o", "--output"}, "output", 1},
+    }};
+  SUBCASE("strings are parsed in place") {
+    const std::vector<std::string> argv {
+      "test", "-vo", "out.txt", "a", "--output=b"};
+    argagg::parser_results args = parser.parse(argv.begin(), argv.end());
+    CHECK(args.buffers.empty());
+    CHECK(args.program == argv[0].c_str());
+    CHECK(args.has_option("verbose") == true);
+    REQUIRE(args["output"].count() == 2);
+    CHECK(args["output"][0].arg == argv[2].c_str());
+    CHECK(args["output"].as<std::string>() == "b");
+    REQUIRE(args.count() == 1);
+    CHECK(args.pos[0] == argv[3].c_str());
+  }
+  SUBCASE("views are copied") {
+    // Slices of a single string which aren't NUL-terminated.
+    const std::string line = "test-v--outputout.txtpositional";
+    const std::vector<test_string_view> argv {
+      {line.data(), 4}, {line.data() + 4, 2}, {line.data() + 6, 8},
+      {line.data() + 14, 7}, {line.data() + 21, 10}};
+    argagg::parser_results args = parser.parse(argv.begin(), argv.end());
+    CHECK(args.buffers.size() == 1);
+    CHECK(std::string(args.program) == "test");
+    CHECK(args.has_option("verbose") == true);
+    CHECK(args["output"].as<std::string>() == "out.txt");
+    REQUIRE(args.count() == 1);
+    CHECK(args.as<std::string>(0) == "positional");
+  }
+  SUBCASE("pointer and length pairs") {
+    const char frame[] = "test--verbose-ox";
+    const std::vector<std::pair<const char*, int>> argv {
+      {frame, 4}, {frame + 4, 9}, {frame + 13, 3}};
+    argagg::parser_results args = parser.parse(argv.begin(), argv.end());
+    CHECK(args.has_option("verbose") == true);
+    CHECK(args["output"].as<std::string>() == "x");
+    CHECK(args.count() == 0);
+  }
+  SUBCASE("empty range") {
+    const std::vector<test_string_view> argv;
+    argagg::parser_results args = parser.parse(argv.begin(), argv.end());
+    CHECK(args.program == nullptr);
+    CHECK(args.count() == 0);
+  }
+}
+
+/**
+ * A parse_state handler that only counts what it's handed.
+ */
+struct counting_handler {
+  std::size_t options = 0;
+  std::size_t positionals = 0;
+  const char* last_arg = nullptr;
+  void option(const argagg::definition&, const char* arg) {
+    ++options;
+    last_arg = arg;
+  }
+  void positional(const char* arg) {
+    ++positionals;
+    last_arg = arg;
+  }
+};
+
+
+TEST_CASE("parse state")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"output", {"-o", "--a-rather-long-output-flag"}, "output", 1},
+    }};
+  const argagg::parser_map map =
+    argagg::validate_definitions(parser.definitions);
+  SUBCASE("feeding tokens one at a time") {
+    argagg::parser_results results {nullptr, {}, {}, {}};
+    argagg::parser_results_handler handler {results};
+    argagg::parse_state state(map);
+    std::string token;
+    for (const char* arg : {"-v", "a", "--a-rather-long-output-flag", "x"}) {
+      // The token is overwritten between calls.
+      token = arg;
+      state.feed(token.c_str(), token.size(), handler);
+      if (token == "--a-rather-long-output-flag") {
+        CHECK(state.expects_option_argument() == true);
+      }
+    }
+    state.finish();
+    CHECK(results["verbose"].count() == 1);
+    CHECK(results["output"].count() == 1);
+    CHECK(results.count() == 1);
+  }
+  SUBCASE("snapshots") {
+    counting_handler handler;
+    argagg::parse_state state(map);
+    state.feed("-vo", handler);
+    CHECK(handler.options == 1);
+    const argagg::parse_state snapshot = state;
+
+    // Whatever comes next is the argument for -o, even if it looks like a
+    // flag.
+    counting_handler flag_handler;
+    state.feed("-v", flag_handler);
+    CHECK(flag_handler.options == 1);
+    CHECK(std::string(flag_handler.last_arg) == "-v");
+    state.finish();
+
+    counting_handler speculative;
+    argagg::parse_state fork = snapshot;
+    fork.feed("--", speculative);
+    fork.feed("--", speculative);
+    fork.feed("-v", speculative);
+    CHECK(speculative.options == 1);
+    CHECK(speculative.positionals == 1);
+    CHECK(std::string(speculative.last_arg) == "-v");
+    fork.finish();
+
+    argagg::parse_state unfinished = snapshot;
+    CHECK(unfinished.expects_option_argument() == true);
+    CHECK_THROWS_AS({
+      unfinished.finish();
+    }, const argagg::option_lacks_argument_error&);
+  }
+}
+
+TEST_CASE("subcommands")
+{
+  argagg::command git {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"dir", {"-C"}, "run as if started in dir", 1},
+    }};
+  git.add("commit", {
+      {"message", {"-m", "--message"}, "commit message", 1},
+      {"all", {"-a", "--all"}, "commit all changes", 0},
+    });
+  argagg::command& remote = git.add("remote", {
+      {"remote_verbose", {"--remote-verbose"}, "remote verbosity", 0},
+    });
+  remote.add("add", {
+      {"fetch", {"-f", "--fetch"}, "fetch after adding", 0},
+    });
+  remote.add("remove", {});
+  SUBCASE("dispatch") {
+    std::vector<const char*> argv {
+      "git", "-C", "repo", "commit", "-am", "msg", "-v", "file"};
+    argagg::command_results args = git.parse(argv.size(), &(argv.front()));
+    CHECK(args.selected == &git.subcommand("commit"));
+    REQUIRE(args.path.size() == 2);
+    CHECK(args.path[0] == &git);
+    REQUIRE(args.names.size() == 1);
+    CHECK(std::string(args.names[0]) == "commit");
+    CHECK(args.results["dir"].as<std::string>() == "repo");
+    CHECK(args.results["message"].as<std::string>() == "msg");
+    CHECK(args.results.has_option("all") == true);
+    CHECK(args.results.has_option("verbose") == true);
+    REQUIRE(args.results.count() == 1);
+    CHECK(args.results.as<std::string>(0) == "file");
+    // Only the commands that were reached have been validated.
+    CHECK(git.subcommand("commit").compiled != nullptr);
+    CHECK(git.subcommand("remote").compiled == nullptr);
+  }
+  SUBCASE("nested") {
+    std::vector<const char*> argv {
+      "git", "remote", "--remote-verbose", "add", "-fv", "origin", "url"};
+    argagg::command_results args = git.parse(argv.size(), &(argv.front()));
+    CHECK(args.selected == &remote.subcommand("add"));
+    CHECK(args.path.size() == 3);
+    CHECK(args.results.has_option("remote_verbose") == true);
+    CHECK(args.results.has_option("fetch") == true);
+    CHECK(args.results.has_option("verbose") == true);
+    CHECK(args.results.has_option("message") == false);
+    CHECK(args.results.count() == 2);
+  }
+  SUBCASE("no subcommand") {
+    std::vector<const char*> argv {"git", "-v"};
+    argagg::command_results args = git.parse(argv.size(), &(argv.front()));
+    CHECK(args.selected == &git);
+    CHECK(args.names.empty());
+    CHECK(args.results.has_option("verbose") == true);
+  }
+  SUBCASE("errors") {
+    std::vector<const char*> unknown {"git", "bogus"};
+    CHECK_THROWS_AS({
+      git.parse(unknown.size(), &(unknown.front()));
+    }, const argagg::unknown_subcommand&);
+    std::vector<const char*> misplaced {"git", "-m", "msg", "commit"};
+    CHECK_THROWS_AS({
+      git.parse(misplaced.size(), &(misplaced.front()));
+    }, const argagg::unexpected_option_error&);
+    CHECK_THROWS_AS({
+      git.subcommand("bogus");
+    }, const argagg::unknown_subcommand&);
+  }
+  SUBCASE("separator stops dispatch") {
+    std::vector<const char*> argv {"git", "--", "commit"};
+    argagg::command_results args = git.parse(argv.size(), &(argv.front()));
+    CHECK(args.selected == &git);
+    REQUIRE(args.results.count() == 1);
+    CHECK(args.results.as<std::string>(0) == "commit");
+  }
+  SUBCASE("positionals after a leaf") {
+    std::vector<const char*> argv {"git", "remote", "remove", "add"};
+    argagg::command_results args = git.parse(argv.size(), &(argv.front()));
+    CHECK(args.selected == &remote.subcommand("remove"));
+    REQUIRE(args.results.count() == 1);
+    CHECK(args.results.as<std::string>(0) == "add");
+  }
+  SUBCASE("subcommand flags shadow global ones") {
+    git.add("shadow", {
+        {"quiet", {"-v"}, "takes over -v", 0},
+        {"dir", {"--dir"}, "a dir of its own", 1},
+      });
+    std::vector<const char*> argv {
+      "git", "-C", "outer", "shadow", "-v", "--verbose", "--dir", "inner"};
+    argagg::command_results args = git.parse(argv.size(), &(argv.front()));
+    REQUIRE(args.scopes.size() == 2);
+    CHECK(args.scopes[1]["quiet"].count() == 1);
+    CHECK(args.scopes[0]["verbose"].count() == 1);
+    CHECK(args.scopes[0]["dir"].as<std::string>() == "outer");
+    CHECK(args.scopes[1]["dir"].as<std::string>() == "inner");
+    // The selected command's options hide those of the same name.
+    CHECK(args.results["dir"].as<std::string>() == "inner");
+    CHECK(args.results["verbose"].count() == 1);
+
+    std::vector<const char*> global {"git", "shadow", "-C", "x"};
+    args = git.parse(global.size(), &(global.front()));
+    CHECK(args.scopes[0]["dir"].as<std::string>() == "x");
+    CHECK(args.scopes[1].has_option("dir") == false);
+
+    git.add("conflict", {
+        {"a", {"-x"}, "", 0},
+        {"b", {"-x"}, "conflicts with -x of the same command", 0},
+      });
+    std::vector<const char*> conflict {"git", "conflict"};
+    CHECK_THROWS_AS({
+      git.parse(conflict.size(), &(conflict.front()));
+    }, const argagg::invalid_flag&);
+  }
+  SUBCASE("help of each subcommand") {
+    argagg::command tool {{
+        {"help", {"-h", "--help"}, "print help", 0},
+      }};
+    tool.add("build", {
+        {"help", {"-h", "--help"}, "print help for build", 0},
+        {"jobs", {"-j"}, "number of jobs", 1},
+      });
+    tool.add("clean", {});
+    std::vector<const char*> build {"tool", "build", "--help"};
+    argagg::command_results args = tool.parse(build.size(), &(build.front()));
+    CHECK(args.selected == &tool.subcommand("build"));
+    CHECK(args.scopes[0]["help"].count() == 0);
+    CHECK(args.scopes[1]["help"].count() == 1);
+    CHECK(args.results["help"].count() == 1);
+    std::vector<const char*> clean {"tool", "clean", "-h"};
+    args = tool.parse(clean.size(), &(clean.front()));
+    CHECK(args.scopes[0]["help"].count() == 1);
+    CHECK(args.results["help"].count() == 1);
+
+    std::ostringstream bash;
+    argagg::write_bash_completion(bash, "tool", tool);
+    CHECK(bash.str().find(
+        "    \"/build\")\n"
+        "      flags=\"-h --help -j\"\n"
+        "      argflags=\" -j 1 \"\n") != std::string::npos);
+  }
+}
+
+TEST_CASE("completion")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"version", {"--version"}, "print the version", 0},
+      {"output", {"-o", "--output"}, "output filename", 1},
+    }};
+  auto complete = [&parser](std::vector<const char*> argv) {
+      return parser.complete(argv.size(), &(argv.front()));
+    };
+  using candidates = std::vector<std::string>;
+  CHECK(complete({"test", "-"}).candidates == candidates({
+    "--output", "--verbose", "--version", "-o", "-v"}));
+  CHECK(complete({"test", "--ver"}).candidates == candidates({
+    "--verbose", "--version"}));
+  CHECK(complete({"test", "-v"}).candidates == candidates({"-v"}));
+  CHECK(complete({"test", "--x"}).candidates.empty());
+  CHECK(complete({"test", "-vo"}).candidates.empty());
+  CHECK(complete({"test", "f"}).candidates.empty());
+  CHECK(complete({"test", "--", "-"}).candidates.empty());
+  CHECK(complete({"test"}).candidates.empty());
+  SUBCASE("option arguments") {
+    auto option = complete({"test", "-v", "--output", "-"});
+    CHECK(option.candidates.empty());
+    REQUIRE(option.option != nullptr);
+    CHECK(std::string(option.option->name) == "output");
+    CHECK(std::string(complete({"test", "--output=f"}).option->name)
+          == "output");
+    CHECK(complete({"test", "--bogus", "x", "--ver"}).option == nullptr);
+    parser.allow_abbreviations = true;
+    CHECK(std::string(complete({"test", "--out", "f"}).option->name)
+          == "output");
+    CHECK(std::string(complete({"test", "--out=f"}).option->name)
+          == "output");
+  }
+  SUBCASE("subcommands") {
+    argagg::command git {{
+        {"dir", {"-C"}, "run as if started in dir", 1},
+      }};
+    git.add("commit", {{"message", {"-m", "--message"}, "message", 1}});
+    git.add("clone", {});
+    git.add("remote", {});
+    git.add("broken", {{"broken", {"bad"}, "invalid flag", 0}});
+    auto complete = [&git](std::vector<const char*> argv) {
+        return git.complete(argv.size(), &(argv.front()));
+      };
+    CHECK(complete({"git", ""}).candidates == candidates({
+      "broken", "clone", "commit", "remote"}));
+    CHECK(complete({"git", "-C", "dir", "c"}).candidates == candidates({
+      "clone", "commit"}));
+    CHECK(complete({"git", "-C", "c"}).candidates.empty());
+    CHECK(complete({"git", "commit", "-"}).candidates == candidates({
+      "--message", "-C", "-m"}));
+    CHECK(complete({"git", "commit", "c"}).candidates.empty());
+    CHECK(complete({"git", "--", "c"}).candidates.empty());
+    CHECK(git.subcommand("broken").compiled == nullptr);
+  }
+  SUBCASE("scripts") {
+    argagg::command git {{
+        {"dir", {"-C"}, "run as if started in dir", 1},
+      }};
+    git.add("remote", {}).add("add", {
+        {"fetch", {"-f", "--fetch"}, "fetch", 0},
+        {"track", {"-t"}, "branches to track", 2},
+      });
+    std::ostringstream bash;
+    argagg::write_bash_completion(bash, "my-git", git);
+    CHECK(bash.str().find(
+        "    \"/remote/add\")\n"
+        "      flags=\"-C -f --fetch -t\"\n"
+        "      argflags=\" -C 1 -t 2 \"\n"
+        "      commands=\"\"\n") != std::string::npos);
+    CHECK(bash.str().find(
+        "complete -o filenames -F _argagg_my_git my-git\n")
+      != std::string::npos);
+    std::ostringstream zsh;
+    argagg::write_zsh_completion(zsh, "test", parser);
+    CHECK(zsh.str().find("#compdef test\n") == 0);
+    CHECK(zsh.str().find(
+        "    \"\")\n"
+        "      flags=\"-v --verbose --version -o --output\"\n"
+        "      argflags=\" -o 1 --output 1 \"\n"
+        "      commands=\"\"\n") != std::string::npos);
+    CHECK(zsh.str().find("compdef _argagg_test test\n") != std::string::npos);
+    // Writing the scripts doesn't validate anything.
+    CHECK(git.compiled == nullptr);
+  }
+#ifdef ARGAGG_HAS_POSIX_IO
+  SUBCASE("bash skips arguments of short flag groups") {
+    std::ostringstream script;
+    argagg::write_bash_completion(script, "test", parser);
+    write_file("argagg_test_completion.bash", script.str());
+    // Completing "-" lists the flags unless it's taken for an argument, in
+    // which case it completes file names and none start with "-".
+    auto complete = [](const std::string& words) {
+        const std::string command =
+          "bash -c 'source ./argagg_test_completion.bash; "
+          "COMP_WORDS=(test " + words + " -); "
+          "COMP_CWORD=$((${#COMP_WORDS[@]} - 1)); _argagg_test; "
+          "echo \"${COMPREPLY[*]}\"' 2>/dev/null";
+        std::string output;
+        FILE* pipe = ::popen(command.c_str(), "r");
+        REQUIRE(pipe != nullptr);
+        char buffer[256];
+        while (std::fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+          output += buffer;
+        }
+        ::pclose(pipe);
+        return output;
+      };
+    if (std::system("bash -c true > /dev/null 2>&1") == 0) {
+      const std::string flags = "-v --verbose --version -o --output\n";
+      CHECK(complete("-v") == flags);
+      CHECK(complete("-o") == "\n");
+      CHECK(complete("-vo") == "\n");
+      CHECK(complete("-vo x") == flags);
+      CHECK(complete("-ofoo") == flags);
+      CHECK(complete("-vofoo") == flags);
+      CHECK(complete("--output") == "\n");
+    }
+    std::remove("argagg_test_completion.bash");
+  }
+#endif
+}
+
+// A type without a default constructor for the parallel conversion test
+struct byte_offset {
+  explicit byte_offset(long value) : value(value) {}
+  long value;
+};
+namespace argagg {
+namespace convert {
+  template <>
+  byte_offset arg(const char* s)
+  {
+    return byte_offset(arg<long>(s));
+  }
+} // namespace convert
+} // namespace argagg
+
+TEST_CASE("parallel positional conversion")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+    }};
+  std::vector<std::string> offsets;
+  for (int i = 0; i < 10000; ++i) {
+    offsets.push_back(std::to_string(i * 3));
+  }
+  std::vector<const char*> argv {"test", "-v"};
+  for (const auto& offset : offsets) {
+    argv.push_back(offset.c_str());
+  }
+  SUBCASE("matches serial conversion") {
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    const auto serial = args.all_as<long>();
+    CHECK(args.all_as<long>(4, 1000) == serial);
+    CHECK(args.all_as<long>(3, 1000) == serial);
+    CHECK(args.all_as<long>(0, 1000) == serial);
+    CHECK(args.all_as<long>(64, 1) == serial);
+    CHECK(args.all_as<long>(4) == serial);
+    CHECK(args.all_as<std::string>(4, 1000) == offsets);
+    CHECK(args.all_as<bool>(4, 1000) == args.all_as<bool>());  }
+  SUBCASE("without default construction") {
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    const auto serial = args.all_as<byte_offset>();
+    const auto parallel = args.all_as<byte_offset>(4, 1000);
+    REQUIRE(serial.size() == offsets.size());
+    REQUIRE(parallel.size() == offsets.size());
+    for (std::size_t i = 0; i < offsets.size(); ++i) {
+      CHECK(serial[i].value == static_cast<long>(i * 3));
+      CHECK(parallel[i].value == static_cast<long>(i * 3));
+    }
+  }
+  SUBCASE("reports lowest failing index") {
+    argv[2 + 9000] = "nine thousand";
+    argv[2 + 2500] = "two thousand five hundred";
+    argv[2 + 7000] = "seven thousand";
+    argagg::parser_results args = parser.parse(argv.size(), &(argv.front()));
+    for (unsigned int threads = 1; threads <= 8; ++threads) {
+      std::string message;
+      try {
+        args.all_as<int>(threads, 100);
+      } catch (const std::invalid_argument& e) {
+        message = e.what();
+      }
+      CHECK(message ==
+            "unable to convert argument to integer: "
+            "\"two thousand five hundred\"");
+    }
+  }
+}
+
+
 TEST_CASE("custom conversion function")
 {
   argagg::parser parser {{
@@ -1178,8 +2432,207 @@ TEST_CASE("write options help")
       {"verbose", {"-v", "--verbose"}, "be verbose", 0},
       {"output", {"-o", "--output"}, "output filename", 1},
     }};
-  // Just checking for no exceptions for now.
-  std::cout << parser;
+  std::ostringstream os;
+  os << parser;
+  CHECK(os.str() ==
+        "    -h, --help     print help\n"
+        "    -v, --verbose  be verbose\n"
+        "    -o, --output   output filename\n");
+
+  SUBCASE("long flags and help") {
+    parser.definitions.push_back({
+      "long", {"--a-flag-that-is-much-too-long"},
+      "help that is long enough to be wrapped onto a second line under the "
+      "help column\nand keeps its own line breaks", 0});
+    parser.definitions.push_back({"quiet", {"-q"}, "", 0});
+    std::ostringstream long_os;
+    long_os << parser;
+    CHECK(long_os.str() ==
+          "    -h, --help                print help\n"
+          "    -v, --verbose             be verbose\n"
+          "    -o, --output              output filename\n"
+          "    --a-flag-that-is-much-too-long\n"
+          "                              help that is long enough to be "
+          "wrapped onto a\n"
+          "                              second line under the help column\n"
+          "                              and keeps its own line breaks\n"
+          "    -q\n");
+    // The help is already narrow enough that wrapping doesn't change it.
+    CHECK(argagg::fmt_string(long_os.str()) == long_os.str());
+  }
+
+  SUBCASE("cache") {
+    const auto help = parser.help();
+    CHECK(parser.help() == help);
+    const argagg::parser copy = parser;
+    CHECK(copy.help() == help);
+    parser.definitions[1].help = "be loud";
+    const auto changed = parser.help();
+    CHECK(changed != help);
+    CHECK(changed->text.find("-v, --verbose  be loud\n") != std::string::npos);
+    CHECK(help->text.find("be verbose") != std::string::npos);
+    CHECK(copy.help() == help);
+    parser.definitions.pop_back();
+    CHECK(parser.help()->text.find("--output") == std::string::npos);
+    // The same number of other definitions, likely in the same storage.
+    parser.definitions.clear();
+    parser.definitions.push_back({"all", {"-a"}, "show all", 0});
+    parser.definitions.push_back({"brief", {"-b"}, "be brief", 0});
+    std::ostringstream replaced;
+    replaced << parser;
+    CHECK(replaced.str() ==
+          "    -a  show all\n"
+          "    -b  be brief\n");
+  }
+}
+
+
+TEST_CASE("help groups")
+{
+  argagg::parser parser {{
+      {"cache", {"--cache-size"}, "cache size in MiB", 1, "", "storage"},
+      {"help", {"-h", "--help"}, "print help", 0},
+      {"port", {"-p", "--port"}, "port to listen on", 1, "", "network"},
+      {"dir", {"-d", "--data-dir"}, "where to keep data", 1, "", "storage"},
+    }};
+  CHECK(argagg::definition_groups(parser.definitions) ==
+        std::vector<std::string>({"", "storage", "network"}));
+
+  std::ostringstream os;
+  os << parser;
+  CHECK(os.str() ==
+        "    -h, --help  print help\n"
+        "\n"
+        "storage:\n"
+        "    --cache-size    cache size in MiB\n"
+        "    -d, --data-dir  where to keep data\n"
+        "\n"
+        "network:\n"
+        "    -p, --port  port to listen on\n");
+
+  CHECK(parser.help("storage")->text ==
+        "storage:\n"
+        "    --cache-size    cache size in MiB\n"
+        "    -d, --data-dir  where to keep data\n");
+  CHECK(parser.help("")->text == "    -h, --help  print help\n");
+  CHECK(parser.help("nope") == nullptr);
+  CHECK(parser.help_index()->text ==
+        "    storage  2 options\n"
+        "    network  1 option\n");
+
+  SUBCASE("cache") {
+    const auto storage = parser.help("storage");
+    CHECK(parser.help("storage") == storage);
+    CHECK(parser.help_groups()->rendered.size() == 2);
+    CHECK(parser.help_groups()->rendered.count("network") == 0);
+    parser.definitions[0].group = "network";
+    CHECK(parser.help_groups()->rendered.empty());
+    CHECK(parser.help("storage") != storage);
+    CHECK(parser.help("network")->text.find("--cache-size") !=
+          std::string::npos);
+  }
+
+  SUBCASE("documentation") {
+    const argagg::documentation doc {"daemon", "8", "", "", ""};
+    std::ostringstream man;
+    argagg::write_man_page(man, doc, parser);
+    CHECK(man.str().find(
+            "\\fB\\-h\\fR, \\fB\\-\\-help\\fR\n"
+            "print help\n"
+            ".SS storage\n"
+            ".TP\n"
+            "\\fB\\-\\-cache\\-size\\fR\n") != std::string::npos);
+    std::ostringstream markdown;
+    argagg::write_markdown(markdown, doc, parser);
+    CHECK(markdown.str().find(
+            "## Options\n"
+            "\n"
+            "- `-h`, `--help`: print help\n"
+            "\n"
+            "### storage\n"
+            "\n"
+            "- `--cache-size`: cache size in MiB\n") != std::string::npos);
+  }
+}
+
+
+TEST_CASE("help search")
+{
+  argagg::parser parser {{
+      {"help", {"-h", "--help"}, "print help", 0},
+      {"compression", {"--compression"}, "Compression level of new data files",
+       1, "", "storage"},
+      {"cache", {"--cache-size"}, "size of the block cache in MiB", 1},
+      {"dry_run", {"--dry-run"}, "don't write any files", 0},
+      {"level", {"--log-level"}, "how much to LOG", 1},
+    }};
+
+  auto names = [](const std::vector<argagg::help_match>& matches) {
+      std::vector<std::string> result;
+      for (const auto& match : matches) {
+        result.push_back(match.option->name);
+      }
+      return result;
+    };
+
+  // Words in names and flags count more than words in the help and full
+  // words more than prefixes.
+  CHECK(names(parser.search_help("level")) ==
+        std::vector<std::string>({"level", "compression"}));
+  CHECK(names(parser.search_help("LOG")) ==
+        std::vector<std::string>({"level"}));
+  CHECK(names(parser.search_help("file")) ==
+        std::vector<std::string>({"compression", "dry_run"}));
+  CHECK(names(parser.search_help("dry")) ==
+        std::vector<std::string>({"dry_run"}));
+  CHECK(names(parser.search_help("c")) ==
+        std::vector<std::string>({"compression", "cache"}));
+  CHECK(parser.search_help("nothing").empty());
+  CHECK(parser.search_help("").empty());
+
+  // Definitions matching more of the words come first.
+  const auto matches = parser.search_help("cache files");
+  CHECK(names(matches) ==
+        std::vector<std::string>({"cache", "compression", "dry_run"}));
+  CHECK(matches[0].matched_words == 1);
+  CHECK(names(parser.search_help("data files")) ==
+        std::vector<std::string>({"compression", "dry_run"}));
+  CHECK(parser.search_help("data files")[0].matched_words == 2);
+
+  CHECK(argagg::render_help_matches(parser.search_help("cache")) ==
+        "    --cache-size  size of the block cache in MiB\n");
+
+  SUBCASE("index") {
+    const auto index = parser.help_search_index();
+    CHECK(parser.help_search_index() == index);
+    CHECK(index->terms.size() <= index->postings.size());
+    parser.definitions.push_back(
+      {"threads", {"-t"}, "number of worker threads", 1});
+    CHECK(parser.help_search_index() != index);
+    CHECK(names(parser.search_help("worker")) ==
+          std::vector<std::string>({"threads"}));
+  }
+
+  SUBCASE("modified in place") {
+    CHECK(names(parser.search_help("zebra")).empty());
+    parser.definitions[1].help = std::string("short");
+    CHECK(names(parser.search_help("short")) ==
+          std::vector<std::string>({"compression"}));
+    CHECK(names(parser.search_help("level")) ==
+          std::vector<std::string>({"level"}));
+    parser.definitions[1].flags[0] = "--zebra";
+    CHECK(names(parser.search_help("zebra")) ==
+          std::vector<std::string>({"compression"}));
+  }
+
+  SUBCASE("index of other definitions") {
+    const auto index = argagg::build_help_search_index(parser.definitions);
+    const std::vector<argagg::definition> fewer(
+      parser.definitions.begin(), parser.definitions.begin() + 1);
+    CHECK(names(argagg::search_help(index, fewer, "help")) ==
+          std::vector<std::string>({"help"}));
+    CHECK(argagg::search_help(index, fewer, "cache").empty());
+  }
 }
 
 
@@ -1214,6 +2667,56 @@ TEST_CASE("fmt_ostream")
 }
 
 
+TEST_CASE("fmt_ostream writes lines as they complete")
+{
+  std::ostringstream os;
+  {
+    argagg::fmt_ostream fmt(os, 5);
+    fmt << "aa bb cc";
+    CHECK(os.str() == "");
+    fmt << " dd\n  ee ff gg";
+    CHECK(os.str() == "aa bb\ncc dd\n");
+    fmt << std::flush;
+    CHECK(os.str() == "aa bb\ncc dd\n");
+    fmt << '\n' << "hh";
+    CHECK(os.str() == "aa bb\ncc dd\n  ee\n  ff gg\n");
+  }
+  CHECK(os.str() == "aa bb\ncc dd\n  ee\n  ff gg\nhh\n");
+
+  SUBCASE("same as fmt_string one character at a time") {
+    std::ostringstream chars;
+    {
+      argagg::fmt_ostream fmt(chars);
+      for (const char c : std::string(ipsum)) {
+        fmt.put(c);
+      }
+    }
+    CHECK(chars.str() == fmt_ipsum);
+  }
+
+  SUBCASE("large writes") {
+    std::string report;
+    for (int i = 0; i < 20000; ++i) {
+      report += "line " + std::to_string(i) + " of a rather long report\n";
+    }
+    std::ostringstream large;
+    {
+      argagg::fmt_ostream fmt(large, 20);
+      fmt << report;
+    }
+    CHECK(large.str() == argagg::fmt_string(report, 20));
+  }
+
+  SUBCASE("failed output") {
+    std::ostringstream bad;
+    bad.setstate(std::ios::badbit);
+    argagg::fmt_ostream fmt(bad);
+    fmt << "a line\n";
+    CHECK(!fmt);
+  }
+}
+
+
 TEST_CASE("fmt_string")
 {
   std::string test_formatted = argagg::fmt_string(ipsum);
@@ -1238,3 +2741,181 @@ TEST_CASE("fmt_string indent")
     "        Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do\n"
     "        eiusmod tempor incididunt ut labore et dolore magna aliqua.\n");
 }
+
+
+TEST_CASE("fmt_string long words")
+{
+  const std::string long_word(80, 'x');
+  CHECK(argagg::fmt_string(long_word + " aaa bbb\n") ==
+        long_word + "\naaa bbb\n");
+  CHECK(argagg::fmt_string("aaa " + long_word + " bbb ccc") ==
+        "aaa\n" + long_word + "\nbbb ccc\n");
+}
+
+
+TEST_CASE("wrap_text")
+{
+  std::string out = "> ";
+  const char text[] = "  one two three four\n\n\tfive  \nsix";
+  argagg::wrap_text(text, sizeof(text) - 1, 5, out);
+  CHECK(out == "> "
+               "  one\n"
+               "  two\n"
+               "  three four\n"
+               "\n"
+               "five\n"
+               "six\n");
+  CHECK(argagg::wrap_line("  one two three", 5) == "  one\n  two three\n");
+  std::string empty;
+  argagg::wrap_text("", 0, 75, empty);
+  CHECK(empty.empty());
+}
+
+
+TEST_CASE("display width")
+{
+  CHECK(argagg::is_ascii("", 0) == true);
+  const std::string ascii(40, 'a');
+  CHECK(argagg::is_ascii(ascii.data(), ascii.size()) == true);
+  for (std::size_t i = 0; i < ascii.size(); ++i) {
+    std::string text = ascii;
+    text[i] = '\xc2';
+    CHECK(argagg::is_ascii(text.data(), text.size()) == false);
+  }
+  auto width = [](const std::string& text) {
+      return argagg::display_width(text.data(), text.size());
+    };
+  CHECK(width("timeout") == 7);
+  CHECK(width("10 \xc2\xb5s") == 5);                // "10 µs"
+  CHECK(width("\xe2\x86\x92") == 1);                // "→"
+  CHECK(width("\xe6\x97\xa5\xe6\x9c\xac") == 4);    // "日本"
+  CHECK(width("e\xcc\x81") == 1);                   // "e" + combining acute
+  CHECK(width("\xf0\x9f\x98\x80") == 2);            // emoji
+  CHECK(width("\xff\xc3") == 2);                    // invalid bytes
+  CHECK(width("\xe6\x97") == 2);                    // truncated sequence
+  CHECK(argagg::codepoint_width(0x36F) == 0);
+  CHECK(argagg::codepoint_width(0x370) == 1);
+  CHECK(argagg::codepoint_width(0xFF01) == 2);
+}
+
+
+TEST_CASE("fmt_string display width")
+{
+  // Each "日本" is four columns wide but six bytes long.
+  std::string cjk;
+  for (int i = 0; i < 4; ++i) {
+    cjk += "\xe6\x97\xa5\xe6\x9c\xac ";
+  }
+  CHECK(argagg::fmt_string(cjk + "x", 10) ==
+        "\xe6\x97\xa5\xe6\x9c\xac \xe6\x97\xa5\xe6\x9c\xac\n"
+        "\xe6\x97\xa5\xe6\x9c\xac \xe6\x97\xa5\xe6\x9c\xac x\n");
+  CHECK(argagg::fmt_string("  12 \xc2\xb5s 34 \xc2\xb5s 5", 8) ==
+        "  12 \xc2\xb5s\n  34 \xc2\xb5s 5\n");
+  CHECK(argagg::fmt_string("aa bb cc dd", 5) == "aa bb\ncc dd\n");
+  std::ostringstream os;
+  {
+    argagg::fmt_ostream fmt(os, 5);
+    fmt << "aa bb cc dd";
+  }
+  CHECK(os.str() == "aa bb\ncc dd\n");
+
+  argagg::parser parser {{
+      {"delay", {"-d"}, "delay in \xc2\xb5s \xe2\x86\x92 "
+                        "\xe6\x97\xa5\xe6\x9c\xac\xe6\x97\xa5\xe6\x9c\xac", 1},
+    }};
+  CHECK(parser.help()->text ==
+        "    -d  delay in \xc2\xb5s \xe2\x86\x92 "
+        "\xe6\x97\xa5\xe6\x9c\xac\xe6\x97\xa5\xe6\x9c\xac\n");
+}
+
+
+TEST_CASE("documentation")
+{
+  argagg::parser parser {{
+      {"help", {"-h", "--help"}, "shows this help message", 0},
+      {"output", {"-o", "--output"}, "where to write\n.png or 'jpg'", 1},
+    }};
+  const argagg::documentation doc {
+    "draw-it", "1", "draws *things*", "[options] FILE",
+    "Draws a file.\n\nUse a \\ to continue.",
+  };
+
+  SUBCASE("man page") {
+    std::ostringstream os;
+    argagg::write_man_page(os, doc, parser);
+    CHECK(os.str() ==
+          ".\\\" Generated by argagg, do not edit.\n"
+          ".TH \"DRAW-IT\" \"1\"\n"
+          ".SH NAME\n"
+          "draw\\-it \\- draws *things*\n"
+          ".SH SYNOPSIS\n"
+          ".B draw\\-it\n"
+          "[options] FILE\n"
+          ".SH DESCRIPTION\n"
+          "Draws a file.\n"
+          ".PP\n"
+          "Use a \\e to continue.\n"
+          ".SH OPTIONS\n"
+          ".TP\n"
+          "\\fB\\-h\\fR, \\fB\\-\\-help\\fR\n"
+          "shows this help message\n"
+          ".TP\n"
+          "\\fB\\-o\\fR, \\fB\\-\\-output\\fR\n"
+          "where to write\n"
+          ".br\n"
+          "\\&.png or 'jpg'\n");
+  }
+
+  SUBCASE("markdown") {
+    std::ostringstream os;
+    argagg::write_markdown(os, doc, parser);
+    CHECK(os.str() ==
+          "# draw-it(1)\n"
+          "\n"
+          "draws \\*things\\*\n"
+          "\n"
+          "## Synopsis\n"
+          "\n"
+          "```\n"
+          "draw-it [options] FILE\n"
+          "```\n"
+          "\n"
+          "## Description\n"
+          "\n"
+          "Draws a file.\n"
+          "\n"
+          "Use a \\\\ to continue.\n"
+          "\n"
+          "## Options\n"
+          "\n"
+          "- `-h`, `--help`: shows this help message\n"
+          "- `-o`, `--output`: where to write  \n"
+          "  .png or 'jpg'\n");
+  }
+
+  SUBCASE("help source") {
+    const std::string text = argagg::render_usage_and_help(doc, parser);
+    CHECK(text ==
+          "Usage: draw-it [options] FILE\n"
+          "    -h, --help    shows this help message\n"
+          "    -o, --output  where to write\n"
+          "                  .png or 'jpg'\n");
+    std::ostringstream os;
+    argagg::write_help_source(os, "draw_help", "say \"hi\"??\n\t\xc2\xb5");
+    CHECK(os.str() ==
+          "// Generated by argagg, do not edit.\n"
+          "#include <cstddef>\n"
+          "\n"
+          "extern const char draw_help[];\n"
+          "extern const std::size_t draw_help_size;\n"
+          "\n"
+          "const char draw_help[] =\n"
+          "  \"say \\\"hi\\\"\\?\\?\\n\"\n"
+          "  \"\\011\\302\\265\";\n"
+          "\n"
+          "const std::size_t draw_help_size = sizeof(draw_help) - 1;\n");
+    CHECK_THROWS_AS(
+      argagg::write_help_source(os, "draw-help", text),
+      const std::invalid_argument&);
+  }
+}
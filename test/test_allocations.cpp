@@ -0,0 +1,128 @@
+#include "../include/argagg/argagg.hpp"
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+
+// These tests replace the global allocation functions so they live in their
+// own executable where nothing else has to put up with that.
+
+// Once GCC inlines the replaced operator new it no longer sees that the
+// memory comes from malloc() and takes the frees below for mismatches.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+/**
+ * Counts the allocations made by the current thread so that tests can check
+ * that something doesn't allocate without other threads getting in the way.
+ */
+static thread_local std::size_t allocation_count = 0;
+
+static void* counted_allocation(std::size_t size) noexcept
+{
+  ++allocation_count;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(std::size_t size)
+{
+  if (void* p = counted_allocation(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+  if (void* p = counted_allocation(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return counted_allocation(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return counted_allocation(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+  std::free(p);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+#endif
+
+
+/**
+ * A parse_state handler that only counts what it's handed.
+ */
+struct counting_handler {
+  std::size_t options = 0;
+  std::size_t positionals = 0;
+  void option(const argagg::definition&, const char*) {
+    ++options;
+  }
+  void positional(const char*) {
+    ++positionals;
+  }
+};
+
+
+TEST_CASE("parse state doesn't allocate")
+{
+  argagg::parser parser {{
+      {"verbose", {"-v", "--verbose"}, "be verbose", 0},
+      {"output", {"-o", "--a-rather-long-output-flag"}, "output", 1},
+    }};
+  const argagg::parser_map map =
+    argagg::validate_definitions(parser.definitions);
+  const std::vector<std::string> tokens {
+    "-v", "positional", "--a-rather-long-output-flag", "x",
+    "--a-rather-long-output-flag=y", "-vox", "--", "-v"};
+  counting_handler handler;
+  argagg::parse_state state(map);
+  const std::size_t before = allocation_count;
+  for (const auto& token : tokens) {
+    state.feed(token.c_str(), token.size(), handler);
+  }
+  state.finish();
+  CHECK(allocation_count == before);
+  CHECK(handler.options == 5);
+  CHECK(handler.positionals == 2);
+}
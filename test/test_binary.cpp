@@ -0,0 +1,186 @@
+#include "../include/argagg/argagg.hpp"
+#include "../include/argagg/convert/binary.hpp"
+
+#include "doctest.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+TEST_CASE("hex")
+{
+  argagg::parser argparser {{
+      { "key", {"-k", "--key"},
+        "key as hexadecimal digits (e.g. 'deadbeef')", 1},
+    }};
+  SUBCASE("empty") {
+    std::vector<const char*> argv {
+      "test", "-k", ""};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto key = args["key"].as<argagg::hex<>>();
+    CHECK(key.bytes.empty());
+  }
+  SUBCASE("mixed case") {
+    std::vector<const char*> argv {
+      "test", "-k", "deadBEEF"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto key = args["key"].as<argagg::hex<>>();
+    CHECK(key.bytes == std::vector<std::uint8_t>({0xde, 0xad, 0xbe, 0xef}));
+  }
+  SUBCASE("long") {
+    // Long enough to exercise the vectorized loop and the scalar tail.
+    const std::string digits = "00112233445566778899aabbccddeeffAABBCCDDEEFF0f";
+    std::vector<const char*> argv {
+      "test", "-k", digits.c_str()};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto key = args["key"].as<argagg::hex<>>();
+    CHECK(key.bytes == std::vector<std::uint8_t>({
+      0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb,
+      0xcc, 0xdd, 0xee, 0xff, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x0f}));
+  }
+  SUBCASE("every byte") {
+    static const char digits[] = "0123456789abcdef";
+    std::string s;
+    for (int i = 0; i < 256; ++i) {
+      s += digits[i >> 4];
+      s += digits[i & 0xf];
+    }
+    auto bytes = argagg::convert::arg<argagg::hex<>>(s.c_str()).bytes;
+    REQUIRE(bytes.size() == 256);
+    bool all_match = true;
+    for (int i = 0; i < 256; ++i) {
+      all_match = all_match && bytes[i] == i;
+    }
+    CHECK(all_match);
+  }
+  SUBCASE("odd number of digits") {
+    std::vector<const char*> argv {
+      "test", "-k", "abc"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      args["key"].as<argagg::hex<>>();
+    }, const std::invalid_argument&);
+  }
+  SUBCASE("invalid digit") {
+    // Invalid characters in both the vectorized loop and the scalar tail.
+    for (const char* digits : {
+        "0011223344556677g8", "0011223344556677889g", "00112233 4556677889a",
+        "@0", "`0", "0G", "0/", "0:"}) {
+      std::string message;
+      try {
+        argagg::convert::arg<argagg::hex<>>(digits);
+      } catch (const std::invalid_argument& e) {
+        message = e.what();
+      }
+      CHECK(message.find("invalid hex character") == 0);
+    }
+    std::string message;
+    try {
+      argagg::convert::arg<argagg::hex<>>("00112233445566778x");
+    } catch (const std::invalid_argument& e) {
+      message = e.what();
+    }
+    CHECK(message == "invalid hex character 'x' at offset 17");
+  }
+  SUBCASE("fixed size") {
+    std::vector<const char*> argv {
+      "test", "-k", "000102030405060708090a0b0c0d0e0f"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    using key128 = argagg::hex<std::array<std::uint8_t, 16>>;
+    using key256 = argagg::hex<std::array<std::uint8_t, 32>>;
+    auto key = args["key"].as<key128>();
+    for (std::size_t i = 0; i < key.bytes.size(); ++i) {
+      CHECK(key.bytes[i] == i);
+    }
+    CHECK_THROWS_AS({
+      args["key"].as<key256>();
+    }, const std::invalid_argument&);
+  }
+}
+
+
+TEST_CASE("base64")
+{
+  argagg::parser argparser {{
+      { "nonce", {"-n", "--nonce"},
+        "nonce as base64 (e.g. '3q2+7w==')", 1},
+    }};
+  SUBCASE("empty") {
+    CHECK(argagg::convert::arg<argagg::base64<>>("").bytes.empty());
+  }
+  SUBCASE("padding") {
+    // Test vectors from RFC 4648.
+    const std::vector<std::pair<const char*, std::string>> vectors {
+      {"Zg==", "f"},
+      {"Zm8=", "fo"},
+      {"Zm9v", "foo"},
+      {"Zm9vYg==", "foob"},
+      {"Zm9vYmE=", "fooba"},
+      {"Zm9vYmFy", "foobar"},
+      {"Zg", "f"},
+      {"Zm8", "fo"},
+      {"Zm9vYmE", "fooba"},
+    };
+    for (const auto& v : vectors) {
+      const auto bytes = argagg::convert::arg<argagg::base64<>>(v.first).bytes;
+      CHECK(std::string(bytes.begin(), bytes.end()) == v.second);
+    }
+  }
+  SUBCASE("whole alphabet") {
+    std::vector<const char*> argv {
+      "test", "-n", "3q2+7w=="};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto nonce = args["nonce"].as<argagg::base64<>>();
+    CHECK(nonce.bytes == std::vector<std::uint8_t>({0xde, 0xad, 0xbe, 0xef}));
+    auto all = argagg::convert::arg<argagg::base64<>>(
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+    CHECK(all.bytes.size() == 48);
+    CHECK(all.bytes[0] == 0x00);
+    CHECK(all.bytes[1] == 0x10);
+    CHECK(all.bytes[2] == 0x83);
+    CHECK(all.bytes[47] == 0xbf);
+  }
+  SUBCASE("invalid length") {
+    for (const char* s : {"Z", "Zm9vY", "Zg=", "Z===", "Zm9v="}) {
+      CHECK_THROWS_AS({
+        argagg::convert::arg<argagg::base64<>>(s);
+      }, const std::invalid_argument&);
+    }
+  }
+  SUBCASE("invalid character") {
+    std::string message;
+    try {
+      argagg::convert::arg<argagg::base64<>>("Zm9v-mFy");
+    } catch (const std::invalid_argument& e) {
+      message = e.what();
+    }
+    CHECK(message == "invalid base64 character '-' at offset 4");
+    CHECK_THROWS_AS({
+      argagg::convert::arg<argagg::base64<>>("Zg=a");
+    }, const std::invalid_argument&);
+    CHECK_THROWS_AS({
+      argagg::convert::arg<argagg::base64<>>("Z===");
+    }, const std::invalid_argument&);
+  }
+  SUBCASE("fixed size") {
+    std::vector<const char*> argv {
+      "test", "-n", "Zm9vYmFy"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    using nonce48 = argagg::base64<std::array<std::uint8_t, 6>>;
+    using nonce96 = argagg::base64<std::array<std::uint8_t, 12>>;
+    auto nonce = args["nonce"].as<nonce48>();
+    CHECK(std::string(nonce.bytes.begin(), nonce.bytes.end()) == "foobar");
+    CHECK_THROWS_AS({
+      args["nonce"].as<nonce96>();
+    }, const std::invalid_argument&);
+  }
+}
@@ -0,0 +1,152 @@
+#include "../include/argagg/argagg.hpp"
+#include "../include/argagg/convert/choices.hpp"
+
+#include "doctest.h"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+
+enum class compression {
+  none,
+  gzip,
+  bzip2,
+  xz,
+  zstd,
+};
+namespace argagg {
+  template <>
+  struct choices<compression> {
+    static std::array<choice<compression>, 5> values()
+    {
+      return {{
+        {"none", compression::none},
+        {"gzip", compression::gzip},
+        {"bzip2", compression::bzip2},
+        {"xz", compression::xz},
+        {"zstd", compression::zstd},
+      }};
+    }
+  };
+namespace convert {
+  template <>
+  struct converter<compression> : choice_converter<compression> {};
+} // namespace convert
+} // namespace argagg
+
+
+TEST_CASE("choices")
+{
+  argagg::parser argparser {{
+      { "compression", {"-c", "--compression"},
+        "compression algorithm (one of: " +
+        argagg::choices_list<compression>() + ")", 1},
+    }};
+  SUBCASE("every choice") {
+    std::vector<const char*> argv {
+      "test", "-c", "none", "-c", "gzip", "-c", "bzip2", "-c", "xz",
+      "-c", "zstd"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK(args["compression"].count() == 5);
+    CHECK(args["compression"][0].as<compression>() == compression::none);
+    CHECK(args["compression"][1].as<compression>() == compression::gzip);
+    CHECK(args["compression"][2].as<compression>() == compression::bzip2);
+    CHECK(args["compression"][3].as<compression>() == compression::xz);
+    CHECK(args["compression"][4].as<compression>() == compression::zstd);
+  }
+  SUBCASE("invalid choice") {
+    std::vector<const char*> argv {
+      "test", "--compression", "lz4"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      args["compression"].as<compression>();
+    }, const std::invalid_argument&);
+    try {
+      args["compression"].as<compression>();
+    } catch (const std::invalid_argument& e) {
+      CHECK(std::string(e.what()) ==
+        "invalid choice \"lz4\", expected one of: none, gzip, bzip2, xz, zstd");
+    }
+    CHECK(args["compression"].as<compression>(compression::none) ==
+          compression::none);
+  }
+  SUBCASE("prefixes and case don't match") {
+    std::vector<const char*> argv {
+      "test", "-c", "gz", "-c", "GZIP", "-c", "", "-c", "zstdx"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    for (const auto& result : args["compression"].all) {
+      CHECK_THROWS_AS({
+        result.as<compression>();
+      }, const std::invalid_argument&);
+    }
+  }
+  SUBCASE("help lists choices") {
+    std::ostringstream os;
+    os << argparser;
+    // The help is wrapped so collapse the line breaks and indentation.
+    std::string help;
+    for (const char c : os.str()) {
+      const bool space = std::isspace(static_cast<unsigned char>(c));
+      if (!space || help.empty() || help.back() != ' ') {
+        help += space ? ' ' : c;
+      }
+    }
+    CHECK(help.find("(one of: none, gzip, bzip2, xz, zstd)") !=
+          std::string::npos);
+  }
+}
+
+
+TEST_CASE("choice_index")
+{
+  // Enough names that several of them have to share buckets.
+  static const char* const names[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+    "hotel", "india", "juliett", "kilo", "lima", "mike", "november",
+    "oscar", "papa", "quebec", "romeo", "sierra", "tango", "uniform",
+    "victor", "whiskey", "xray", "yankee", "zulu", "", "a", "b", "ab",
+  };
+  std::array<argagg::choice<int>, 30> table;
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    table[i] = {names[i], static_cast<int>(i)};
+  }
+  argagg::convert::choice_index<int, 30> index(table);
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    const auto found = index.find(names[i]);
+    REQUIRE(found != nullptr);
+    CHECK(found->value == static_cast<int>(i));
+  }
+  CHECK(index.find("alph") == nullptr);
+  CHECK(index.find("zulu ") == nullptr);
+  CHECK(index.find("ba") == nullptr);
+
+  table[29] = {"alpha", 29};
+  using index_type = argagg::convert::choice_index<int, 30>;
+  CHECK_THROWS_AS({
+    index_type duplicate_index(table);
+  }, const std::invalid_argument&);
+}
+
+
+TEST_CASE("choice_index with colliding hashes")
+{
+  // These pairs have the same 32 bit FNV-1a hash, so no displacement can
+  // separate them and the index falls back to a linear search.
+  CHECK(argagg::convert::choice_hash("costarring") ==
+        argagg::convert::choice_hash("liquid"));
+  const std::array<argagg::choice<int>, 4> table {{
+    {"costarring", 0}, {"liquid", 1}, {"declinate", 2}, {"macallums", 3},
+  }};
+  argagg::convert::choice_index<int, 4> index(table);
+  CHECK(index.linear);
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    const auto found = index.find(table[i].name);
+    REQUIRE(found != nullptr);
+    CHECK(found->value == static_cast<int>(i));
+  }
+  CHECK(index.find("liqui") == nullptr);
+}
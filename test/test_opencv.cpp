@@ -5,6 +5,7 @@
 
 #include <cstring>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 
@@ -333,3 +334,212 @@ TEST_CASE("cv::Rect_ example")
     CHECK(rect.height == 42.0);
   }
 }
+
+
+TEST_CASE("cv::Mat_ example")
+{
+  argagg::parser argparser {{
+      { "matrix", {"-m", "--matrix"},
+        "matrix as a semicolon separated list of comma separated rows (e.g. "
+        "'1,2;3,4')", 1},
+    }};
+  SUBCASE("zero elements") {
+    std::vector<const char*> argv {
+      "test", "-m", ""};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      args["matrix"].as<cv::Mat_<int>>();
+    }, const std::invalid_argument&);
+  }
+  SUBCASE("one element") {
+    std::vector<const char*> argv {
+      "test", "-m", "7"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto m = args["matrix"].as<cv::Mat_<int>>();
+    CHECK(m.rows == 1);
+    CHECK(m.cols == 1);
+    CHECK(m(0, 0) == 7);
+  }
+  SUBCASE("row vector") {
+    std::vector<const char*> argv {
+      "test", "-m", "1,2,3"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto m = args["matrix"].as<cv::Mat_<int>>();
+    CHECK(m.rows == 1);
+    CHECK(m.cols == 3);
+    CHECK(m(0, 0) == 1);
+    CHECK(m(0, 1) == 2);
+    CHECK(m(0, 2) == 3);
+  }
+  SUBCASE("column vector") {
+    std::vector<const char*> argv {
+      "test", "-m", "1;-2;3"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto m = args["matrix"].as<cv::Mat_<int>>();
+    CHECK(m.rows == 3);
+    CHECK(m.cols == 1);
+    CHECK(m(0, 0) == 1);
+    CHECK(m(1, 0) == -2);
+    CHECK(m(2, 0) == 3);
+  }
+  SUBCASE("double") {
+    std::vector<const char*> argv {
+      "test", "-m", "1.5,2.25;3.125,-4"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto m = args["matrix"].as<cv::Mat_<double>>();
+    CHECK(m.rows == 2);
+    CHECK(m.cols == 2);
+    CHECK(m(0, 0) == 1.5);
+    CHECK(m(0, 1) == 2.25);
+    CHECK(m(1, 0) == 3.125);
+    CHECK(m(1, 1) == -4.0);
+  }
+  SUBCASE("ragged rows") {
+    std::vector<const char*> argv {
+      "test", "-m", "1,2;3"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      args["matrix"].as<cv::Mat_<int>>();
+    }, const std::invalid_argument&);
+  }
+  SUBCASE("trailing delimiter") {
+    std::vector<const char*> argv {
+      "test", "-m", "1,2;3,4;"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      args["matrix"].as<cv::Mat_<int>>();
+    }, const std::invalid_argument&);
+  }
+  SUBCASE("bad element") {
+    std::vector<const char*> argv {
+      "test", "-m", "1,2;3,x4"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      args["matrix"].as<cv::Mat_<int>>();
+    }, const std::invalid_argument&);
+  }
+  SUBCASE("out of range elements") {
+    std::vector<const char*> argv {
+      "test", "-m", "1,300", "-m", "255,-1", "-m", "2147483648",
+      "-m", "1e39", "-m", "255,0;-0,7"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      args["matrix"][0].as<cv::Mat_<uchar>>();
+    }, const std::out_of_range&);
+    CHECK(args["matrix"][0].as<cv::Mat_<short>>()(0, 1) == 300);
+    CHECK_THROWS_AS({
+      args["matrix"][1].as<cv::Mat_<uchar>>();
+    }, const std::out_of_range&);
+    CHECK_THROWS_AS({
+      args["matrix"][1].as<cv::Mat_<ushort>>();
+    }, const std::out_of_range&);
+    CHECK_THROWS_AS({
+      args["matrix"][1].as<cv::Mat_<schar>>();
+    }, const std::out_of_range&);
+    CHECK_THROWS_AS({
+      args["matrix"][2].as<cv::Mat_<int>>();
+    }, const std::out_of_range&);
+    CHECK(args["matrix"][2].as<cv::Mat_<double>>()(0, 0) == 2147483648.0);
+    CHECK_THROWS_AS({
+      args["matrix"][3].as<cv::Mat_<float>>();
+    }, const std::out_of_range&);
+    CHECK(args["matrix"][3].as<cv::Mat_<double>>()(0, 0) == 1e39);
+    auto m = args["matrix"][4].as<cv::Mat_<uchar>>();
+    CHECK(m(0, 0) == 255);
+    CHECK(m(1, 0) == 0);
+    CHECK(m(1, 1) == 7);
+  }
+}
+
+
+TEST_CASE("cv::Mat_ of cv::Point_ example")
+{
+  argagg::parser argparser {{
+      { "polygon", {"-p", "--polygon"},
+        "polygon as a semicolon separated list of points (e.g. "
+        "'0,0;10,0;10,10')", 1},
+    }};
+  SUBCASE("one point") {
+    std::vector<const char*> argv {
+      "test", "-p", "1,2"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto polygon = args["polygon"].as<cv::Mat_<cv::Point>>();
+    CHECK(polygon.rows == 1);
+    CHECK(polygon.cols == 1);
+    CHECK(polygon(0, 0).x == 1);
+    CHECK(polygon(0, 0).y == 2);
+  }
+  SUBCASE("many points") {
+    std::ostringstream os;
+    for (int i = 0; i < 10000; ++i) {
+      os << (i > 0 ? ";" : "") << i << ',' << -i;
+    }
+    const auto polygon_str = os.str();
+    std::vector<const char*> argv {
+      "test", "-p", polygon_str.c_str()};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto polygon = args["polygon"].as<cv::Mat_<cv::Point>>();
+    REQUIRE(polygon.rows == 10000);
+    CHECK(polygon.cols == 1);
+    bool all_match = true;
+    for (int i = 0; i < 10000; ++i) {
+      all_match = all_match && polygon(i, 0) == cv::Point(i, -i);
+    }
+    CHECK(all_match);
+  }
+  SUBCASE("float") {
+    std::vector<const char*> argv {
+      "test", "-p", "0.5,1.5;2.5,3.5"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto polygon = args["polygon"].as<cv::Mat_<cv::Point2f>>();
+    CHECK(polygon.rows == 2);
+    CHECK(polygon(0, 0).x == 0.5f);
+    CHECK(polygon(0, 0).y == 1.5f);
+    CHECK(polygon(1, 0).x == 2.5f);
+    CHECK(polygon(1, 0).y == 3.5f);
+  }
+  SUBCASE("too few components") {
+    std::vector<const char*> argv {
+      "test", "-p", "1;2"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      args["polygon"].as<cv::Mat_<cv::Point>>();
+    }, const std::invalid_argument&);
+  }
+  SUBCASE("too many components") {
+    std::vector<const char*> argv {
+      "test", "-p", "1,2,3;4,5,6"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    CHECK_THROWS_AS({
+      args["polygon"].as<cv::Mat_<cv::Point>>();
+    }, const std::invalid_argument&);
+  }
+  SUBCASE("three dimensional") {
+    std::vector<const char*> argv {
+      "test", "-p", "1,2,3;4,5,6"};
+    argagg::parser_results args =
+      argparser.parse(argv.size(), &(argv.front()));
+    auto points = args["polygon"].as<cv::Mat_<cv::Point3d>>();
+    CHECK(points.rows == 2);
+    CHECK(points(0, 0).x == 1.0);
+    CHECK(points(0, 0).y == 2.0);
+    CHECK(points(0, 0).z == 3.0);
+    CHECK(points(1, 0).x == 4.0);
+    CHECK(points(1, 0).y == 5.0);
+    CHECK(points(1, 0).z == 6.0);
+  }
+}